@@ -0,0 +1,349 @@
+#pragma once
+
+#define BOOST_SPIRIT_USE_PHOENIX_V3
+#include <boost/spirit/include/qi.hpp>
+
+#include "FloatParser.h"
+#include "LineIndex.h"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+// Face corner parsing
+//
+// Parses one face corner: v, v/vt, v//vn or v/vt/vn, exactly as the grammar's
+// original rule did with the blank skipper:
+//
+//   int_ >> -('/' >> ((int_ >> -('/' >> int_)) | ('/' >> int_)))
+//
+// i.e. blanks may surround each '/', indices are signed, an index that
+// overflows an int fails, and a '/' that is not followed by an index is left
+// unconsumed.
+//
+// Fast path (SSE2): a corner starting at a const char* is classified 32 bytes
+// at a time, in two 16 byte halves. Digit and blank masks give the position
+// and length of every index in the corner, and whether a '/' follows it, with
+// a few bit scans. Each index of up to 8 digits is then converted with three
+// multiplies on a 64 bit word (SWAR) instead of one multiply per digit.
+// Corners that do not fit in the 32 bytes, indices of more than 8 digits,
+// blanks next to a '/' and anything malformed are left to the scalar parser,
+// which also handles every other iterator type.
+//
+// Included by ObjParser.h, which defines FaceTriplet first.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+template <typename Iterator>
+void
+skipFaceBlanks(Iterator& first, const Iterator& last)
+{
+  while (first != last && (*first == ' ' || *first == '\t'))
+  {
+    ++first;
+  }
+}
+
+//------------------------------------------------------------------------------
+// qi::int_ after the blank skipper: an optional sign and decimal digits,
+// failing on overflow. first only advances on success.
+template <typename Iterator>
+bool
+parseFaceIndex(Iterator& first, const Iterator& last, int& value)
+{
+  static const uint64_t MAX_MAGNITUDE = uint64_t(INT_MAX) + 1;
+
+  Iterator it = first;
+  skipFaceBlanks(it, last);
+  bool negative = false;
+  if (it != last && (*it == '-' || *it == '+'))
+  {
+    negative = (*it == '-');
+    ++it;
+  }
+
+  bool hasDigits     = false;
+  uint64_t magnitude = 0;
+  for (; it != last && isDigit(*it); ++it)
+  {
+    magnitude = magnitude * 10 + static_cast<unsigned>(*it - '0');
+    hasDigits = true;
+    if (magnitude > MAX_MAGNITUDE)
+    {
+      return false;
+    }
+  }
+  if (!hasDigits || magnitude > MAX_MAGNITUDE - (negative ? 0 : 1))
+  {
+    return false;
+  }
+
+  value = negative ? static_cast<int>(-static_cast<int64_t>(magnitude))
+                   : static_cast<int>(magnitude);
+  first = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+bool
+parseFaceSlash(Iterator& first, const Iterator& last)
+{
+  Iterator it = first;
+  skipFaceBlanks(it, last);
+  if (it == last || *it != '/')
+  {
+    return false;
+  }
+  first = ++it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+bool
+parseFaceCornerScalar(
+  Iterator& first, const Iterator& last, FaceTriplet& corner)
+{
+  if (!parseFaceIndex(first, last, corner.vertexIndex))
+  {
+    return false;
+  }
+
+  Iterator it = first;
+  if (!parseFaceSlash(it, last))
+  {
+    return true;
+  }
+  if (parseFaceIndex(it, last, corner.uvIndex))
+  {
+    first         = it;
+    Iterator next = it;
+    if (
+      parseFaceSlash(next, last)
+      && parseFaceIndex(next, last, corner.normalIndex))
+    {
+      first = next;
+    }
+  }
+  else if (
+    parseFaceSlash(it, last) && parseFaceIndex(it, last, corner.normalIndex))
+  {
+    first = it;
+  }
+  return true;
+}
+
+#ifdef OBJPARSER_HAS_SSE2
+//------------------------------------------------------------------------------
+// The value of count (1 to 8) digits at c. Reads 8 bytes from c; the bytes
+// past the digits are shifted out, and the zero bytes shifted in act as
+// leading zeros. Then adjacent digits, pairs and quads are combined in place.
+inline int
+convertDigitsSwar(const char* c, unsigned count)
+{
+  uint64_t chunk;
+  std::memcpy(&chunk, c, sizeof(chunk));
+  chunk = (chunk << (8 * (8 - count))) & 0x0F0F0F0F0F0F0F0F;
+  chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FF;
+  chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFF;
+  chunk = (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFF;
+  return static_cast<int>(chunk);
+}
+
+//------------------------------------------------------------------------------
+// Digit and blank masks of the 16 bytes at c
+inline void
+classifyFaceBytes(const char* c, uint64_t& digits, uint64_t& blanks)
+{
+  const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c));
+
+  // Unsigned byte - '0' < 10, as a signed compare
+  const __m128i digitBytes = _mm_cmplt_epi8(
+    _mm_sub_epi8(bytes, _mm_set1_epi8(static_cast<char>('0' + 0x80))),
+    _mm_set1_epi8(static_cast<char>(10 - 0x80)));
+  const __m128i blankBytes = _mm_or_si128(
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+
+  digits = static_cast<uint32_t>(_mm_movemask_epi8(digitBytes));
+  blanks = static_cast<uint32_t>(_mm_movemask_epi8(blankBytes));
+}
+
+//------------------------------------------------------------------------------
+// The corner at c, which is not a blank, or nullptr to leave it to the scalar
+// parser. Looks at the 32 bytes from c, and reads 8 from any index that
+// starts within them, so 40 bytes from c must be readable.
+inline const char*
+parseFaceCornerSse2(const char* c, FaceTriplet& corner)
+{
+  static const unsigned WIDTH = 32;
+
+  uint64_t digits, blanks, highDigits, highBlanks;
+  classifyFaceBytes(c, digits, blanks);
+  classifyFaceBytes(c + 16, highDigits, highBlanks);
+  digits |= highDigits << 16;
+  blanks |= highBlanks << 16;
+
+  // Bit 32 stops every scan at the end of the block
+  const uint64_t END      = uint64_t(1) << WIDTH;
+  const uint64_t nonDigit = ~digits | END;
+  const uint64_t nonBlank = ~blanks | END;
+
+  // An optionally signed index at p, returning where it ends or 0
+  auto index = [&](unsigned p, int& value) -> unsigned {
+    const bool negative = c[p] == '-';
+    p += (c[p] == '-' || c[p] == '+') ? 1 : 0;
+    const unsigned count = countTrailingZeros(nonDigit >> p);
+    if (count == 0 || count > 8 || p + count >= WIDTH)
+    {
+      return 0;
+    }
+    const int magnitude = convertDigitsSwar(c + p, count);
+    value               = negative ? -magnitude : magnitude;
+    return p + count;
+  };
+
+  // Whether the next non-blank at or after p is a '/', as far as the fast
+  // path goes: a '/' straight at p, none at all, or unknown
+  enum class Slash
+  {
+    At,
+    None,
+    Unknown
+  };
+  auto slashAt = [&](unsigned p) {
+    const unsigned next = p + countTrailingZeros(nonBlank >> p);
+    if (next >= WIDTH || (c[next] == '/' && next != p))
+    {
+      return Slash::Unknown;
+    }
+    return (c[next] == '/') ? Slash::At : Slash::None;
+  };
+
+  FaceTriplet result = corner;
+  unsigned p         = index(0, result.vertexIndex);
+  if (p == 0)
+  {
+    return nullptr;
+  }
+
+  Slash slash = slashAt(p);
+  if (slash == Slash::At)
+  {
+    ++p;
+    if (c[p] == '/')
+    {
+      p = index(p + 1, result.normalIndex);
+    }
+    else if ((p = index(p, result.uvIndex)) != 0)
+    {
+      slash = slashAt(p);
+      if (slash == Slash::At)
+      {
+        p = index(p + 1, result.normalIndex);
+      }
+    }
+  }
+  if (p == 0 || slash == Slash::Unknown)
+  {
+    return nullptr;
+  }
+
+  corner = result;
+  return c + p;
+}
+#endif
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Parses the corner at first, after any blanks, advancing first past it on
+// success. Only the indices present are written to corner.
+template <typename Iterator>
+bool
+parseFaceCorner(Iterator& first, const Iterator& last, FaceTriplet& corner)
+{
+  return detail::parseFaceCornerScalar(first, last, corner);
+}
+
+//------------------------------------------------------------------------------
+inline bool
+parseFaceCorner(const char*& first, const char* last, FaceTriplet& corner)
+{
+#ifdef OBJPARSER_HAS_SSE2
+  const char* c = first;
+  detail::skipFaceBlanks(c, last);
+  if (last - c >= 40)
+  {
+    if (const char* end = detail::parseFaceCornerSse2(c, corner))
+    {
+      first = end;
+      return true;
+    }
+  }
+#endif
+  return detail::parseFaceCornerScalar(first, last, corner);
+}
+
+//------------------------------------------------------------------------------
+// Spirit Qi primitive wrapping parseFaceCorner. It skips the blanks around
+// each '/' itself, so it is only a drop in for the rule above under the
+// blank skipper.
+struct FastFaceCornerParser
+    : boost::spirit::qi::primitive_parser<FastFaceCornerParser>
+{
+  template <typename Context, typename Iterator>
+  struct attribute
+  {
+    using type = FaceTriplet;
+  };
+
+  template <
+    typename Iterator,
+    typename Context,
+    typename Skipper,
+    typename Attribute>
+  bool
+  parse(
+    Iterator& first,
+    const Iterator& last,
+    Context&,
+    const Skipper& skipper,
+    Attribute& attr) const
+  {
+    boost::spirit::qi::skip_over(first, last, skipper);
+
+    FaceTriplet corner;
+    if (!parseFaceCorner(first, last, corner))
+    {
+      return false;
+    }
+    boost::spirit::traits::assign_to(corner, attr);
+    return true;
+  }
+
+  template <typename Context>
+  boost::spirit::info
+  what(Context&) const
+  {
+    return boost::spirit::info("face corner");
+  }
+
+  // A rule stores its parser in a boost::function, which copies the whole of
+  // its small object buffer. With no members of its own the parser would
+  // leave that buffer uninitialized, and GCC warns.
+  char unused = 0;
+};
+
+//------------------------------------------------------------------------------
+const boost::proto::terminal<FastFaceCornerParser>::type fastFaceCorner = {{}};
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -0,0 +1,339 @@
+#pragma once
+
+#define BOOST_SPIRIT_USE_PHOENIX_V3
+#include <boost/spirit/include/qi.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <limits>
+#include <charconv>
+#include <locale.h>
+#ifdef __APPLE__
+# include <xlocale.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Decimal to float conversion
+//
+// Accepts the same syntax as qi::double_ (sign, leading or trailing dot,
+// optional exponent, nan and inf) but converts straight to a correctly
+// rounded float instead of rounding to double and then again to float.
+//
+// Fast path (Clinger): with at most 19 digits in total the decimal
+// mantissa m fits in a uint64_t. When m <= 2^53 and |exponent| <= 22, both m
+// and 10^exponent are exact doubles, so one multiply or divide gives the
+// correctly rounded double d. Rounding d to float is then also correct,
+// unless d landed exactly on a halfway point between two floats, in which
+// case the true value may have been on either side of it.
+//
+// Slow path: that halfway case, more than 19 digits and large
+// exponents are handed to the standard library's correctly rounded
+// conversion.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+inline bool
+isDigit(char c)
+{
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+//------------------------------------------------------------------------------
+// Case insensitive match of a lower case keyword
+template <typename Iterator>
+bool
+matchKeyword(Iterator& first, const Iterator& last, const char* keyword)
+{
+  Iterator it = first;
+  for (; *keyword; ++keyword, ++it)
+  {
+    if (it == last || (*it | 0x20) != *keyword)
+    {
+      return false;
+    }
+  }
+  first = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+bool
+parseNonFinite(Iterator& first, const Iterator& last, float& value)
+{
+  Iterator it = first;
+  if (matchKeyword(it, last, "nan"))
+  {
+    // Like qi::double_, allow and ignore a trailing "(...)"
+    if (it != last && *it == '(')
+    {
+      while (++it != last && *it != ')')
+      {
+      }
+      if (it == last)
+      {
+        return false;
+      }
+      ++it;
+    }
+    value = std::numeric_limits<float>::quiet_NaN();
+    first = it;
+    return true;
+  }
+  if (matchKeyword(it, last, "inf"))
+  {
+    matchKeyword(it, last, "inity");
+    value = std::numeric_limits<float>::infinity();
+    first = it;
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// Both arguments are exact doubles for these exponents
+inline double
+scaleByPowerOfTen(double mantissa, int exponent)
+{
+  static const double POWERS[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  return (exponent < 0) ? mantissa / POWERS[-exponent]
+                        : mantissa * POWERS[exponent];
+}
+
+//------------------------------------------------------------------------------
+// True if d is exactly halfway between two adjacent normal floats, i.e. its
+// 53 bit significand has a 1 straight after the 24 bits a float keeps and
+// nothing below that
+inline bool
+isFloatHalfway(double d)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  const uint64_t dropped = bits & ((uint64_t(1) << 29) - 1);
+  return dropped == (uint64_t(1) << 28);
+}
+
+//------------------------------------------------------------------------------
+// [first, last) is an unsigned decimal number already validated by the caller
+inline float
+convertFloat(const char* first, const char* last)
+{
+#ifdef __cpp_lib_to_chars
+  float value = 0.0f;
+  if (std::from_chars(first, last, value).ec == std::errc())
+  {
+    return value;
+  }
+  // Out of range values are left unset by from_chars, so let strtof pick
+  // between inf, zero and a denormal
+#endif
+  // strtof needs a terminated string. It would also read the decimal point
+  // of the current C locale, so it is given the "C" locale explicitly.
+  std::string token(first, last);
+#ifdef _MSC_VER
+  static const _locale_t cLocale = _create_locale(LC_NUMERIC, "C");
+  return _strtof_l(token.c_str(), nullptr, cLocale);
+#else
+  static const locale_t cLocale
+    = newlocale(LC_NUMERIC_MASK, "C", static_cast<locale_t>(0));
+  return strtof_l(token.c_str(), nullptr, cLocale);
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline float
+slowParseFloat(const char* first, const char* last)
+{
+  return convertFloat(first, last);
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+float
+slowParseFloat(Iterator first, const Iterator& last)
+{
+  char buffer[64];
+  size_t length = 0;
+  for (; first != last && length < sizeof(buffer); ++first)
+  {
+    buffer[length++] = *first;
+  }
+  if (first == last)
+  {
+    return convertFloat(buffer, buffer + length);
+  }
+
+  std::string token(buffer, length);
+  token.append(first, last);
+  return convertFloat(token.data(), token.data() + token.size());
+}
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Parses a number at first, advancing first past it on success.
+// Out of range values become +/-inf or +/-0, as with strtof.
+template <typename Iterator>
+bool
+parseFloat(Iterator& first, const Iterator& last, float& value)
+{
+  using detail::isDigit;
+
+  static const int MAX_DIGITS = 19;
+
+  Iterator it   = first;
+  bool negative = false;
+  if (it != last && (*it == '-' || *it == '+'))
+  {
+    negative = (*it == '-');
+    ++it;
+  }
+
+  // Digits are accumulated without an overflow check; anything longer than
+  // MAX_DIGITS (leading zeros included) takes the slow path, which rereads
+  // the text anyway
+  const Iterator numberBegin = it;
+  uint64_t mantissa          = 0;
+  int digitCount             = 0;
+  int exponent               = 0;
+
+  for (; it != last && isDigit(*it); ++it, ++digitCount)
+  {
+    mantissa = mantissa * 10 + static_cast<unsigned>(*it - '0');
+  }
+
+  if (it != last && *it == '.')
+  {
+    Iterator fraction = it;
+    ++fraction;
+    if (digitCount != 0 || (fraction != last && isDigit(*fraction)))
+    {
+      it = fraction;
+      for (; it != last && isDigit(*it); ++it, ++digitCount, --exponent)
+      {
+        mantissa = mantissa * 10 + static_cast<unsigned>(*it - '0');
+      }
+    }
+  }
+
+  if (digitCount == 0)
+  {
+    if (!detail::parseNonFinite(it, last, value))
+    {
+      return false;
+    }
+    value = negative ? -value : value;
+    first = it;
+    return true;
+  }
+
+  // An exponent only counts if it has digits, otherwise the 'e' is left
+  if (it != last && (*it == 'e' || *it == 'E'))
+  {
+    Iterator expIt   = it;
+    bool expNegative = false;
+    ++expIt;
+    if (expIt != last && (*expIt == '-' || *expIt == '+'))
+    {
+      expNegative = (*expIt == '-');
+      ++expIt;
+    }
+    if (expIt != last && isDigit(*expIt))
+    {
+      int explicitExponent = 0;
+      for (; expIt != last && isDigit(*expIt); ++expIt)
+      {
+        if (explicitExponent < 100000)
+        {
+          explicitExponent = explicitExponent * 10 + (*expIt - '0');
+        }
+      }
+      exponent += expNegative ? -explicitExponent : explicitExponent;
+      it = expIt;
+    }
+  }
+
+  const bool fitsMantissa = digitCount <= MAX_DIGITS;
+  float result            = 0.0f;
+  if (fitsMantissa && mantissa == 0)
+  {
+    result = 0.0f;
+  }
+  else if (
+    fitsMantissa && mantissa <= (uint64_t(1) << 53) && exponent >= -22
+    && exponent <= 22)
+  {
+    const double d = detail::scaleByPowerOfTen(double(mantissa), exponent);
+    result         = detail::isFloatHalfway(d)
+               ? detail::slowParseFloat(numberBegin, it)
+               : static_cast<float>(d);
+  }
+  else
+  {
+    result = detail::slowParseFloat(numberBegin, it);
+  }
+
+  value = negative ? -result : result;
+  first = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Spirit Qi primitive wrapping parseFloat, a drop in for qi::float_
+struct FastFloatParser
+    : boost::spirit::qi::primitive_parser<FastFloatParser>
+{
+  template <typename Context, typename Iterator>
+  struct attribute
+  {
+    using type = float;
+  };
+
+  template <
+    typename Iterator,
+    typename Context,
+    typename Skipper,
+    typename Attribute>
+  bool
+  parse(
+    Iterator& first,
+    const Iterator& last,
+    Context&,
+    const Skipper& skipper,
+    Attribute& attr) const
+  {
+    boost::spirit::qi::skip_over(first, last, skipper);
+
+    float value;
+    if (!parseFloat(first, last, value))
+    {
+      return false;
+    }
+    boost::spirit::traits::assign_to(value, attr);
+    return true;
+  }
+
+  template <typename Context>
+  boost::spirit::info
+  what(Context&) const
+  {
+    return boost::spirit::info("float");
+  }
+};
+
+//------------------------------------------------------------------------------
+// Usable directly in qi expressions, e.g. 'v' >> fastFloat >> fastFloat
+const boost::proto::terminal<FastFloatParser>::type fastFloat = {{}};
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
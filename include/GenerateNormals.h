@@ -0,0 +1,414 @@
+#pragma once
+
+#include "ObjParser.h"
+#include "Triangulate.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Smooth normal generation
+//
+// generateNormals() gives every face corner without a normal index a normal
+// averaged from the faces around its position, appends those normals to the
+// aggregate and points the corners at them. Each face contributes its normal
+// weighted by its area or by the angle of its corner at that position. Faces
+// whose normals are further apart than the crease angle do not smooth into
+// each other, so a position on a hard edge gets one normal for each side.
+// Corners around one position that end up with the same normal share it.
+//
+// Each position's normals are summed by the thread that owns the position,
+// never by the faces that touch it, so no two threads write the same sum. The
+// corners of each position are found with a parallel counting sort (see
+// sortByKey()). Normals are numbered by position, the same for any thread
+// count.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+enum class NormalWeighting
+{
+  Area,     // by the area of each face
+  Angle,    // by the angle of each face at the corner
+};
+
+//------------------------------------------------------------------------------
+struct NormalOptions
+{
+  // Zero uses every hardware core
+  unsigned threadCount = 1;
+
+  // Faces are never split into ranges smaller than this
+  size_t minFacesPerThread = 1 << 14;
+
+  NormalWeighting weighting = NormalWeighting::Area;
+
+  // In degrees. Faces meeting at a sharper angle than this keep separate
+  // normals along their shared edge; 180 smooths over every edge.
+  float creaseAngle = 180.0f;
+
+  // Discard the normals the data has and generate one for every corner
+  bool replaceExisting = false;
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+inline bool
+hasNormalIndex(const FaceTriplet& corner)
+{
+  return corner.normalIndex != 0;
+}
+
+inline bool
+hasNormalIndex(const ResolvedCorner& corner)
+{
+  return corner.normalIndex != ResolvedCorner::ABSENT;
+}
+
+inline void
+setNormalIndex(FaceTriplet& corner, size_t index)
+{
+  corner.normalIndex = int(index + 1);
+}
+
+inline void
+setNormalIndex(ResolvedCorner& corner, size_t index)
+{
+  corner.normalIndex = uint32_t(index);
+}
+
+inline size_t
+maxNormalCount(const FaceTriplet&)
+{
+  return size_t(std::numeric_limits<int>::max());
+}
+
+inline size_t
+maxNormalCount(const ResolvedCorner&)
+{
+  return ResolvedCorner::ABSENT;
+}
+
+//------------------------------------------------------------------------------
+// Both normal layouts, resized and written one normal at a time
+inline void
+resizeNormals(std::vector<VertexNormal>& normals, size_t size)
+{
+  normals.resize(size);
+}
+
+inline void
+resizeNormals(NormalArrays& normals, size_t size)
+{
+  normals.i.resize(size);
+  normals.j.resize(size);
+  normals.k.resize(size);
+}
+
+inline void
+setNormal(std::vector<VertexNormal>& normals, size_t idx, const VertexNormal& n)
+{
+  normals[idx] = n;
+}
+
+inline void
+setNormal(NormalArrays& normals, size_t idx, const VertexNormal& n)
+{
+  normals.i[idx] = n.i;
+  normals.j[idx] = n.j;
+  normals.k[idx] = n.k;
+}
+
+//------------------------------------------------------------------------------
+struct Vector3
+{
+  float x;
+  float y;
+  float z;
+};
+
+inline float
+dot(const Vector3& a, const Vector3& b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// A zero vector stays zero
+inline Vector3
+normalized(const Vector3& v)
+{
+  const float length = std::sqrt(dot(v, v));
+  return (length > 0.0f) ? Vector3{v.x / length, v.y / length, v.z / length}
+                         : Vector3{0.0f, 0.0f, 0.0f};
+}
+
+//------------------------------------------------------------------------------
+// The unit normal of a face from Newell's method, and the weight each of its
+// corners gives it. Returns false if a corner has no position.
+template <typename Data, typename Corner>
+bool
+faceNormal(
+  const Data& data,
+  const Corner* first,
+  const Corner* last,
+  NormalWeighting weighting,
+  uint32_t* positions,
+  float* weights,
+  Vector3& unit)
+{
+  const size_t n = last - first;
+  for (size_t i = 0; i < n; ++i)
+  {
+    size_t index = 0;
+    if (!cornerPositionIndex(data, first[i], index))
+    {
+      return false;
+    }
+    positions[i] = uint32_t(index);
+  }
+
+  Vector3 sum = {0.0f, 0.0f, 0.0f};
+  for (size_t i = 0, prev = n - 1; i < n; prev = i++)
+  {
+    const VertexPosition a = data.positions[positions[prev]];
+    const VertexPosition b = data.positions[positions[i]];
+    sum.x += (a.y - b.y) * (a.z + b.z);
+    sum.y += (a.z - b.z) * (a.x + b.x);
+    sum.z += (a.x - b.x) * (a.y + b.y);
+  }
+  unit = normalized(sum);
+
+  if (weighting == NormalWeighting::Area)
+  {
+    const float area = 0.5f * std::sqrt(dot(sum, sum));
+    std::fill(weights, weights + n, area);
+    return true;
+  }
+  for (size_t i = 0; i < n; ++i)
+  {
+    const VertexPosition a = data.positions[positions[(i + n - 1) % n]];
+    const VertexPosition b = data.positions[positions[i]];
+    const VertexPosition c = data.positions[positions[(i + 1) % n]];
+
+    const Vector3 u = normalized({a.x - b.x, a.y - b.y, a.z - b.z});
+    const Vector3 v = normalized({c.x - b.x, c.y - b.y, c.z - b.z});
+    weights[i]      = std::acos(std::max(-1.0f, std::min(1.0f, dot(u, v))));
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Works on ObjAggregate, ObjFlatAggregate, ObjSoaAggregate and
+// ObjResolvedAggregate. Fails, leaving data untouched, if a face corner
+// refers to a position that does not exist or uses a relative index (parse
+// with parseAsResolvedAggregate() to keep those).
+template <typename Data>
+bool
+generateNormals(Data& data, const NormalOptions& options = {})
+{
+  using Corner = detail::FaceCorner<Data>;
+  using detail::Vector3;
+
+  const size_t faces     = detail::faceCount(data);
+  const size_t positions = data.positions.size();
+  const size_t ranges
+    = rangeCount(faces, options.threadCount, options.minFacesPerThread);
+  const unsigned threads = unsigned(ranges);
+  auto rangeBegin = [&](size_t range) { return faces * range / ranges; };
+
+  // Corner numbering across all faces
+  std::vector<size_t> faceOffsets(faces + 1, 0);
+  for (size_t face = 0; face < faces; ++face)
+  {
+    const auto corners    = detail::faceRange(std::as_const(data), face);
+    const size_t arity    = corners.second - corners.first;
+    faceOffsets[face + 1] = faceOffsets[face] + arity;
+  }
+  const size_t cornerCount = faceOffsets.back();
+  if (cornerCount >= ResolvedCorner::ABSENT)
+  {
+    LOG_ERROR("Too many corners to generate normals for: %zu", cornerCount);
+    return false;
+  }
+
+  // Face normals, and the weight and position of every corner
+  std::vector<Vector3> faceNormals(faces);
+  std::vector<uint32_t> cornerFaces(cornerCount);
+  std::vector<uint32_t> cornerPositions(cornerCount);
+  std::vector<float> cornerWeights(cornerCount);
+  std::vector<char> needsNormal(cornerCount);
+  std::vector<char> failed(ranges, 0);
+  parallelFor(ranges, threads, [&](size_t range) {
+    for (size_t face = rangeBegin(range); face < rangeBegin(range + 1); ++face)
+    {
+      const auto corners  = detail::faceRange(std::as_const(data), face);
+      const size_t offset = faceOffsets[face];
+      if (!detail::faceNormal(
+            data,
+            corners.first,
+            corners.second,
+            options.weighting,
+            cornerPositions.data() + offset,
+            cornerWeights.data() + offset,
+            faceNormals[face]))
+      {
+        failed[range] = 1;
+        return;
+      }
+      for (size_t c = offset; c < faceOffsets[face + 1]; ++c)
+      {
+        cornerFaces[c] = uint32_t(face);
+        needsNormal[c] = options.replaceExisting
+                         || !detail::hasNormalIndex(corners.first[c - offset]);
+      }
+    }
+  });
+  if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+  {
+    LOG_ERROR("A face corner refers to a position that does not exist");
+    return false;
+  }
+
+  // The corners around each position
+  std::vector<uint32_t> adjacent;
+  std::vector<size_t> starts;
+  sortByKey(
+    cornerCount,
+    positions,
+    threads,
+    options.minFacesPerThread,
+    [&](size_t c) { return cornerPositions[c]; },
+    adjacent,
+    starts);
+
+  // Sum a normal for each corner from the faces around its position that are
+  // within the crease angle of its own face. Positions are split into a few
+  // blocks per thread, each numbering its own normals.
+  const float cosCrease
+    = std::cos(std::min(options.creaseAngle, 180.0f) * 3.14159265f / 180.0f);
+  const bool smooth = options.creaseAngle >= 180.0f;
+
+  const size_t blocks
+    = (ranges > 1) ? std::max<size_t>(1, std::min(4 * ranges, positions)) : 1;
+  auto blockOf    = [&](uint32_t position) {
+    return size_t(uint64_t(position) * blocks / positions);
+  };
+  auto blockBegin = [&](size_t block) {
+    return (positions * block + blocks - 1) / blocks;
+  };
+
+  std::vector<uint32_t> cornerNormals(cornerCount);
+  std::vector<std::vector<VertexNormal>> blockNormals(blocks);
+  parallelFor(blocks, threads, [&](size_t block) {
+    std::vector<VertexNormal>& normals = blockNormals[block];
+    for (size_t p = blockBegin(block); p < blockBegin(block + 1); ++p)
+    {
+      const uint32_t* around = adjacent.data() + starts[p];
+      const size_t count     = starts[p + 1] - starts[p];
+      const size_t firstNew  = normals.size();
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (!needsNormal[around[i]])
+        {
+          continue;
+        }
+
+        // Faces with no area fall back to every face around the position
+        const Vector3& own = faceNormals[cornerFaces[around[i]]];
+        Vector3 sum        = {0.0f, 0.0f, 0.0f};
+        Vector3 all        = {0.0f, 0.0f, 0.0f};
+        for (size_t j = 0; j < count; ++j)
+        {
+          const Vector3& other = faceNormals[cornerFaces[around[j]]];
+          const float weight   = cornerWeights[around[j]];
+          all.x += weight * other.x;
+          all.y += weight * other.y;
+          all.z += weight * other.z;
+          if (smooth || detail::dot(own, other) >= cosCrease)
+          {
+            sum.x += weight * other.x;
+            sum.y += weight * other.y;
+            sum.z += weight * other.z;
+          }
+        }
+        const Vector3 unit
+          = detail::normalized((detail::dot(sum, sum) > 0.0f) ? sum : all);
+        const VertexNormal vn = {unit.x, unit.y, unit.z};
+
+        size_t local = firstNew;
+        while (local < normals.size() && !(normals[local] == vn))
+        {
+          ++local;
+        }
+        if (local == normals.size())
+        {
+          normals.push_back(vn);
+        }
+        cornerNormals[around[i]] = uint32_t(local);
+
+        // Every corner of a fully smoothed position gets the same sum
+        if (smooth)
+        {
+          for (size_t j = i + 1; j < count; ++j)
+          {
+            cornerNormals[around[j]] = uint32_t(local);
+          }
+          break;
+        }
+      }
+    }
+  });
+
+  // Append the normals block by block and point the corners at them
+  const size_t base = options.replaceExisting ? 0 : data.normals.size();
+  std::vector<size_t> normalOffsets(blocks + 1, base);
+  for (size_t block = 0; block < blocks; ++block)
+  {
+    const size_t count       = blockNormals[block].size();
+    normalOffsets[block + 1] = normalOffsets[block] + count;
+  }
+  if (normalOffsets.back() > detail::maxNormalCount(Corner()))
+  {
+    LOG_ERROR("Too many normals for the index type: %zu", normalOffsets.back());
+    return false;
+  }
+
+  detail::resizeNormals(data.normals, normalOffsets.back());
+  parallelFor(blocks, threads, [&](size_t block) {
+    const std::vector<VertexNormal>& normals = blockNormals[block];
+    for (size_t i = 0; i < normals.size(); ++i)
+    {
+      detail::setNormal(data.normals, normalOffsets[block] + i, normals[i]);
+    }
+  });
+  parallelFor(ranges, threads, [&](size_t range) {
+    for (size_t face = rangeBegin(range); face < rangeBegin(range + 1); ++face)
+    {
+      const auto corners = detail::faceRange(data, face);
+      size_t c           = faceOffsets[face];
+      for (Corner* corner = corners.first; corner != corners.second;
+           ++corner, ++c)
+      {
+        if (needsNormal[c])
+        {
+          detail::setNormalIndex(
+            *corner,
+            normalOffsets[blockOf(cornerPositions[c])] + cornerNormals[c]);
+        }
+      }
+    }
+  });
+  return true;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
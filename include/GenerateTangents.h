@@ -0,0 +1,560 @@
+#pragma once
+
+#include "GenerateNormals.h"
+#include "LineIndex.h"
+#include "Parallel.h"
+#include "UnifiedMesh.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Tangent space generation
+//
+// generateTangents() gives every vertex of a unified mesh a tangent and a
+// bitangent sign for normal mapping, following the MikkTSpace conventions that
+// bakers and engines share:
+//  - a triangle's tangent points the way u increases across it, and the
+//    triangle is orientation preserving if its texture coordinates wind the
+//    same way as its corners;
+//  - at each corner that tangent is projected onto the plane of the vertex
+//    normal and weighted by the angle of the triangle at the corner;
+//  - triangles of opposite orientation never share a tangent, so a vertex used
+//    by both is split in two and the copy appended to the mesh;
+//  - the sign is 1 for orientation preserving triangles and -1 otherwise, and
+//    the bitangent is sign * cross(normal, tangent).
+// Triangles with no texture area contribute nothing and take the tangent of
+// the vertices they use. Unlike MikkTSpace, corners of one orientation are not
+// split further where their tangents diverge sharply.
+//
+// The per-triangle work is done several triangles at a time, one per SSE2 or
+// AVX lane, on ranges of triangles in parallel. The corners are then sorted by
+// vertex, and each vertex's tangent is summed by the thread that owns it. The
+// result is the same for any thread count.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+struct TangentOptions
+{
+  // Zero uses every hardware core
+  unsigned threadCount = 1;
+
+  // Triangles are never split into ranges smaller than this
+  size_t minTrianglesPerThread = 1 << 14;
+
+  // A level that was not compiled in falls back to the next one down
+  SimdLevel simdLevel = BEST_SIMD_LEVEL;
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+// Lane types for the triangle kernel. Float1 is the scalar fallback and also
+// finishes the triangles the vector loops leave. All of them do the same IEEE
+// operations in the same order.
+struct Float1
+{
+  static constexpr size_t WIDTH = 1;
+  float value;
+
+  static Float1 load(const float* p) { return {*p}; }
+  void store(float* p) const { *p = value; }
+};
+
+inline Float1 operator+(Float1 a, Float1 b) { return {a.value + b.value}; }
+inline Float1 operator-(Float1 a, Float1 b) { return {a.value - b.value}; }
+inline Float1 operator*(Float1 a, Float1 b) { return {a.value * b.value}; }
+inline Float1 sqrtOf(Float1 a) { return {std::sqrt(a.value)}; }
+
+inline Float1
+clampUnit(Float1 a)
+{
+  return {std::max(-1.0f, std::min(1.0f, a.value))};
+}
+
+// num / den where den is positive, zero elsewhere
+inline Float1
+divideIfPositive(Float1 num, Float1 den)
+{
+  return {(den.value > 0.0f) ? num.value / den.value : 0.0f};
+}
+
+// -value where test is negative, zero where it is zero, value elsewhere
+inline Float1
+applySign(Float1 value, Float1 test)
+{
+  return {
+    (test.value < 0.0f)   ? -value.value
+    : (test.value > 0.0f) ? value.value
+                          : 0.0f};
+}
+
+#ifdef OBJPARSER_HAS_SSE2
+//------------------------------------------------------------------------------
+struct Float4
+{
+  static constexpr size_t WIDTH = 4;
+  __m128 value;
+
+  static Float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+  void store(float* p) const { _mm_storeu_ps(p, value); }
+};
+
+inline Float4
+operator+(Float4 a, Float4 b)
+{
+  return {_mm_add_ps(a.value, b.value)};
+}
+
+inline Float4
+operator-(Float4 a, Float4 b)
+{
+  return {_mm_sub_ps(a.value, b.value)};
+}
+
+inline Float4
+operator*(Float4 a, Float4 b)
+{
+  return {_mm_mul_ps(a.value, b.value)};
+}
+
+inline Float4 sqrtOf(Float4 a) { return {_mm_sqrt_ps(a.value)}; }
+
+inline Float4
+clampUnit(Float4 a)
+{
+  return {_mm_max_ps(
+    _mm_set1_ps(-1.0f), _mm_min_ps(_mm_set1_ps(1.0f), a.value))};
+}
+
+inline Float4
+divideIfPositive(Float4 num, Float4 den)
+{
+  const __m128 positive = _mm_cmpgt_ps(den.value, _mm_setzero_ps());
+  return {_mm_and_ps(positive, _mm_div_ps(num.value, den.value))};
+}
+
+inline Float4
+applySign(Float4 value, Float4 test)
+{
+  const __m128 zero     = _mm_setzero_ps();
+  const __m128 negative = _mm_cmplt_ps(test.value, zero);
+  const __m128 nonZero  = _mm_cmpneq_ps(test.value, zero);
+  const __m128 flipped
+    = _mm_xor_ps(value.value, _mm_and_ps(negative, _mm_set1_ps(-0.0f)));
+  return {_mm_and_ps(nonZero, flipped)};
+}
+#endif
+
+#ifdef __AVX2__
+//------------------------------------------------------------------------------
+struct Float8
+{
+  static constexpr size_t WIDTH = 8;
+  __m256 value;
+
+  static Float8 load(const float* p) { return {_mm256_loadu_ps(p)}; }
+  void store(float* p) const { _mm256_storeu_ps(p, value); }
+};
+
+inline Float8
+operator+(Float8 a, Float8 b)
+{
+  return {_mm256_add_ps(a.value, b.value)};
+}
+
+inline Float8
+operator-(Float8 a, Float8 b)
+{
+  return {_mm256_sub_ps(a.value, b.value)};
+}
+
+inline Float8
+operator*(Float8 a, Float8 b)
+{
+  return {_mm256_mul_ps(a.value, b.value)};
+}
+
+inline Float8 sqrtOf(Float8 a) { return {_mm256_sqrt_ps(a.value)}; }
+
+inline Float8
+clampUnit(Float8 a)
+{
+  return {_mm256_max_ps(
+    _mm256_set1_ps(-1.0f), _mm256_min_ps(_mm256_set1_ps(1.0f), a.value))};
+}
+
+inline Float8
+divideIfPositive(Float8 num, Float8 den)
+{
+  const __m256 positive
+    = _mm256_cmp_ps(den.value, _mm256_setzero_ps(), _CMP_GT_OQ);
+  return {_mm256_and_ps(positive, _mm256_div_ps(num.value, den.value))};
+}
+
+inline Float8
+applySign(Float8 value, Float8 test)
+{
+  const __m256 zero     = _mm256_setzero_ps();
+  const __m256 negative = _mm256_cmp_ps(test.value, zero, _CMP_LT_OQ);
+  const __m256 nonZero  = _mm256_cmp_ps(test.value, zero, _CMP_NEQ_UQ);
+  const __m256 flipped  = _mm256_xor_ps(
+    value.value, _mm256_and_ps(negative, _mm256_set1_ps(-0.0f)));
+  return {_mm256_and_ps(nonZero, flipped)};
+}
+#endif
+
+//------------------------------------------------------------------------------
+template <typename F>
+struct Lanes3
+{
+  F x;
+  F y;
+  F z;
+};
+
+template <typename F>
+Lanes3<F>
+operator-(const Lanes3<F>& a, const Lanes3<F>& b)
+{
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+template <typename F>
+F
+dot(const Lanes3<F>& a, const Lanes3<F>& b)
+{
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// A zero vector stays zero
+template <typename F>
+Lanes3<F>
+normalized(const Lanes3<F>& v)
+{
+  const F length = sqrtOf(dot(v, v));
+  return {
+    divideIfPositive(v.x, length),
+    divideIfPositive(v.y, length),
+    divideIfPositive(v.z, length)};
+}
+
+// v without its component along the unit vector n
+template <typename F>
+Lanes3<F>
+projected(const Lanes3<F>& v, const Lanes3<F>& n)
+{
+  const F along = dot(v, n);
+  return {v.x - n.x * along, v.y - n.y * along, v.z - n.z * along};
+}
+
+//------------------------------------------------------------------------------
+// The corners of WIDTH triangles gathered one lane per triangle, and what the
+// kernel works out for them
+template <size_t WIDTH>
+struct TriangleBatch
+{
+  float position[3][3][WIDTH];    // [corner][axis][lane]
+  float normal[3][3][WIDTH];
+  float texCoord[3][2][WIDTH];
+
+  float area[WIDTH];             // twice the signed texture area
+  float tangent[3][3][WIDTH];    // unit, in the normal's plane
+  float cosAngle[3][WIDTH];
+};
+
+template <typename F, size_t WIDTH>
+void
+tangentKernel(TriangleBatch<WIDTH>& batch)
+{
+  auto load3 = [](const float(&v)[3][WIDTH]) {
+    return Lanes3<F>{F::load(v[0]), F::load(v[1]), F::load(v[2])};
+  };
+
+  Lanes3<F> p[3];
+  Lanes3<F> n[3];
+  F u[3];
+  F v[3];
+  for (size_t k = 0; k < 3; ++k)
+  {
+    p[k] = load3(batch.position[k]);
+    n[k] = normalized(load3(batch.normal[k]));
+    u[k] = F::load(batch.texCoord[k][0]);
+    v[k] = F::load(batch.texCoord[k][1]);
+  }
+
+  // The direction u increases in, turned around where the texture is
+  // mirrored and dropped where it has no area
+  const Lanes3<F> d1 = p[1] - p[0];
+  const Lanes3<F> d2 = p[2] - p[0];
+  const F t21x       = u[1] - u[0];
+  const F t21y       = v[1] - v[0];
+  const F t31x       = u[2] - u[0];
+  const F t31y       = v[2] - v[0];
+  const F area       = t21x * t31y - t21y * t31x;
+  area.store(batch.area);
+
+  const Lanes3<F> os = {
+    applySign(d1.x * t31y - d2.x * t21y, area),
+    applySign(d1.y * t31y - d2.y * t21y, area),
+    applySign(d1.z * t31y - d2.z * t21y, area)};
+
+  for (size_t k = 0; k < 3; ++k)
+  {
+    const Lanes3<F>& next = p[(k == 2) ? 0 : k + 1];
+    const Lanes3<F>& prev = p[(k == 0) ? 2 : k - 1];
+
+    const Lanes3<F> t = normalized(projected(os, n[k]));
+    t.x.store(batch.tangent[k][0]);
+    t.y.store(batch.tangent[k][1]);
+    t.z.store(batch.tangent[k][2]);
+
+    const Lanes3<F> e1 = normalized(projected(prev - p[k], n[k]));
+    const Lanes3<F> e2 = normalized(projected(next - p[k], n[k]));
+    clampUnit(dot(e1, e2)).store(batch.cosAngle[k]);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Works out the angle-weighted tangent of every corner and the orientation of
+// every triangle from first on, WIDTH triangles at a time. Returns the first
+// triangle of the partial batch left over.
+template <typename F>
+size_t
+tangentTriangles(
+  const ObjUnifiedMesh& mesh,
+  size_t first,
+  size_t last,
+  Vector3* cornerTangents,
+  int8_t* orientations)
+{
+  constexpr size_t WIDTH = F::WIDTH;
+  TriangleBatch<WIDTH> batch;
+  for (; last - first >= WIDTH; first += WIDTH)
+  {
+    for (size_t lane = 0; lane < WIDTH; ++lane)
+    {
+      for (size_t k = 0; k < 3; ++k)
+      {
+        const uint32_t index        = mesh.indices[3 * (first + lane) + k];
+        const UnifiedVertex& vertex = mesh.vertices[index];
+        for (size_t axis = 0; axis < 3; ++axis)
+        {
+          batch.position[k][axis][lane] = vertex.position[axis];
+          batch.normal[k][axis][lane]   = vertex.normal[axis];
+        }
+        batch.texCoord[k][0][lane] = vertex.texCoord[0];
+        batch.texCoord[k][1][lane] = vertex.texCoord[1];
+      }
+    }
+
+    tangentKernel<F>(batch);
+
+    for (size_t lane = 0; lane < WIDTH; ++lane)
+    {
+      const size_t triangle  = first + lane;
+      const float area       = batch.area[lane];
+      orientations[triangle] = (area > 0.0f) ? 1 : (area < 0.0f) ? -1 : 0;
+      for (size_t k = 0; k < 3; ++k)
+      {
+        const float angle = std::acos(batch.cosAngle[k][lane]);
+        cornerTangents[3 * triangle + k] = {
+          angle * batch.tangent[k][0][lane],
+          angle * batch.tangent[k][1][lane],
+          angle * batch.tangent[k][2][lane]};
+      }
+    }
+  }
+  return first;
+}
+
+//------------------------------------------------------------------------------
+// The summed tangent of one orientation of a vertex. If its triangles have no
+// texture area, any unit vector perpendicular to the normal will do.
+inline UnifiedTangent
+finishTangent(const Vector3& sum, const UnifiedVertex& vertex, float sign)
+{
+  Vector3 t = normalized(sum);
+  if (dot(t, t) == 0.0f)
+  {
+    const Vector3 n
+      = normalized({vertex.normal[0], vertex.normal[1], vertex.normal[2]});
+    const Vector3 axis = (std::abs(n.x) < 0.9f) ? Vector3{1.0f, 0.0f, 0.0f}
+                                                : Vector3{0.0f, 1.0f, 0.0f};
+    const float along  = dot(axis, n);
+    t = normalized(
+      {axis.x - n.x * along, axis.y - n.y * along, axis.z - n.z * along});
+  }
+  return {{t.x, t.y, t.z}, sign};
+}
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Fills mesh.tangents, splitting vertices as described above. The normals and
+// texture coordinates should be set; generate normals first if the file has
+// none. Fails, leaving the mesh untouched, if an index refers to a vertex that
+// does not exist.
+inline bool
+generateTangents(ObjUnifiedMesh& mesh, const TangentOptions& options = {})
+{
+  using detail::Vector3;
+
+  const size_t triangles   = mesh.indices.size() / 3;
+  const size_t cornerCount = 3 * triangles;
+  const size_t vertexCount = mesh.vertices.size();
+  if (cornerCount != mesh.indices.size())
+  {
+    LOG_ERROR(
+      "Index count is not a multiple of three: %zu", mesh.indices.size());
+    return false;
+  }
+  const size_t ranges = rangeCount(
+    triangles, options.threadCount, options.minTrianglesPerThread);
+  const unsigned threads = unsigned(ranges);
+  auto rangeBegin = [&](size_t range) { return triangles * range / ranges; };
+
+  // Angle-weighted corner tangents and triangle orientations
+  std::vector<Vector3> cornerTangents(cornerCount);
+  std::vector<int8_t> orientations(triangles);
+  std::vector<char> failed(ranges, 0);
+  parallelFor(ranges, threads, [&](size_t range) {
+    size_t first      = rangeBegin(range);
+    const size_t last = rangeBegin(range + 1);
+    for (size_t c = 3 * first; c < 3 * last; ++c)
+    {
+      if (mesh.indices[c] >= vertexCount)
+      {
+        failed[range] = 1;
+        return;
+      }
+    }
+
+    Vector3* tangents = cornerTangents.data();
+    int8_t* signs     = orientations.data();
+    switch (options.simdLevel)
+    {
+#ifdef __AVX2__
+    case SimdLevel::Avx2:
+      first = detail::tangentTriangles<detail::Float8>(
+        mesh, first, last, tangents, signs);
+      break;
+#endif
+#ifdef OBJPARSER_HAS_SSE2
+# ifndef __AVX2__
+    case SimdLevel::Avx2:
+# endif
+    case SimdLevel::Sse2:
+      first = detail::tangentTriangles<detail::Float4>(
+        mesh, first, last, tangents, signs);
+      break;
+#endif
+    default: break;
+    }
+    detail::tangentTriangles<detail::Float1>(
+      mesh, first, last, tangents, signs);
+  });
+  if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+  {
+    LOG_ERROR("An index refers to a vertex that does not exist");
+    return false;
+  }
+
+  // The corners of each vertex
+  std::vector<uint32_t> corners;
+  std::vector<size_t> starts;
+  sortByKey(
+    cornerCount,
+    vertexCount,
+    threads,
+    3 * options.minTrianglesPerThread,
+    [&](size_t c) { return mesh.indices[c]; },
+    corners,
+    starts);
+
+  // Vertices are split into a few blocks per thread. Each block first counts
+  // its vertices used by both orientations, so that it knows where to append
+  // their copies.
+  const size_t blocks
+    = (ranges > 1) ? std::max<size_t>(1, std::min(4 * ranges, vertexCount))
+                   : 1;
+  auto blockBegin  = [&](size_t block) { return vertexCount * block / blocks; };
+  auto orientation = [&](uint32_t c) { return orientations[c / 3]; };
+
+  std::vector<size_t> splitOffsets(blocks + 1, 0);
+  parallelFor(blocks, threads, [&](size_t block) {
+    size_t splits = 0;
+    for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v)
+    {
+      bool preserving = false;
+      bool mirrored   = false;
+      for (size_t i = starts[v]; i < starts[v + 1]; ++i)
+      {
+        preserving = preserving || orientation(corners[i]) > 0;
+        mirrored   = mirrored || orientation(corners[i]) < 0;
+      }
+      splits += (preserving && mirrored) ? 1 : 0;
+    }
+    splitOffsets[block + 1] = splits;
+  });
+  std::partial_sum(
+    splitOffsets.begin(), splitOffsets.end(), splitOffsets.begin());
+  const size_t splitCount = vertexCount + splitOffsets.back();
+  if (splitCount > std::numeric_limits<uint32_t>::max())
+  {
+    LOG_ERROR("Too many vertices after splitting: %zu", splitCount);
+    return false;
+  }
+
+  // Sum each orientation of each vertex, and move the mirrored corners of
+  // split vertices to the copy
+  mesh.vertices.resize(splitCount);
+  mesh.tangents.resize(splitCount);
+  parallelFor(blocks, threads, [&](size_t block) {
+    size_t copy = vertexCount + splitOffsets[block];
+    for (size_t v = blockBegin(block); v < blockBegin(block + 1); ++v)
+    {
+      Vector3 sums[2] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+      bool preserving = false;
+      bool mirrored   = false;
+      for (size_t i = starts[v]; i < starts[v + 1]; ++i)
+      {
+        const uint32_t c = corners[i];
+        const int8_t o   = orientation(c);
+        Vector3& sum     = sums[(o < 0) ? 1 : 0];
+        sum.x += cornerTangents[c].x;
+        sum.y += cornerTangents[c].y;
+        sum.z += cornerTangents[c].z;
+        preserving = preserving || o > 0;
+        mirrored   = mirrored || o < 0;
+      }
+
+      const UnifiedVertex& vertex = mesh.vertices[v];
+      if (preserving && mirrored)
+      {
+        mesh.vertices[copy] = vertex;
+        mesh.tangents[copy] = detail::finishTangent(sums[1], vertex, -1.0f);
+        for (size_t i = starts[v]; i < starts[v + 1]; ++i)
+        {
+          if (orientation(corners[i]) < 0)
+          {
+            mesh.indices[corners[i]] = uint32_t(copy);
+          }
+        }
+        ++copy;
+      }
+      mesh.tangents[v] = (mirrored && !preserving)
+                           ? detail::finishTangent(sums[1], vertex, -1.0f)
+                           : detail::finishTangent(sums[0], vertex, 1.0f);
+    }
+  });
+  return true;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) \
+  || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define OBJPARSER_HAS_SSE2
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Line index
+//
+// One pass over a buffer that finds where every line starts and what kind of
+// line it is, without parsing any numbers. Line ends are found 16 (SSE2) or 32
+// (AVX2) bytes at a time: a byte is a line end if it is '\n', or a '\r' that
+// is not followed by '\n', matching the grammar's eol. Each line start is then
+// classified by its keyword.
+//
+// The kernel is picked at compile time. SSE2 is part of every x86-64 target;
+// AVX2 needs e.g. -mavx2 or /arch:AVX2 (see the OBJPARSER_AVX2 CMake option).
+// Anything else uses the scalar loop.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+enum class LineType : uint8_t
+{
+  Blank,       // nothing but blanks
+  Comment,     // #
+  Material,    // mtllib or usemtl
+  Position,    // v
+  Normal,      // vn
+  TexCoord,    // vt
+  Face,        // f
+  Other,       // anything else, including malformed keywords
+};
+
+//------------------------------------------------------------------------------
+enum class SimdLevel
+{
+  Scalar,
+  Sse2,
+  Avx2,
+};
+
+#if defined(__AVX2__)
+constexpr SimdLevel BEST_SIMD_LEVEL = SimdLevel::Avx2;
+#elif defined(OBJPARSER_HAS_SSE2)
+constexpr SimdLevel BEST_SIMD_LEVEL = SimdLevel::Sse2;
+#else
+constexpr SimdLevel BEST_SIMD_LEVEL = SimdLevel::Scalar;
+#endif
+
+//------------------------------------------------------------------------------
+// Lines are packed into 8 bytes each: the offset of their first non-blank
+// character in the upper 56 bits, and their LineType in the lower 8
+struct LineIndex
+{
+  const char* begin = nullptr;
+  const char* end   = nullptr;
+  std::vector<uint64_t> lines;
+
+  size_t size() const { return lines.size(); }
+  const char* line(size_t i) const { return begin + (lines[i] >> 8); }
+  LineType type(size_t i) const { return LineType(lines[i] & 0xff); }
+
+  // Where the text of line i ends: at the next line, or the end of the buffer
+  const char*
+  next(size_t i) const
+  {
+    return (i + 1 < lines.size()) ? line(i + 1) : end;
+  }
+
+  // The first line whose first non-blank character is at or after position
+  size_t
+  find(const char* position) const
+  {
+    const uint64_t key = uint64_t(position - begin) << 8;
+    return std::lower_bound(lines.begin(), lines.end(), key) - lines.begin();
+  }
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+inline unsigned
+countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline unsigned
+countTrailingZeros(uint64_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Skips the leading blanks of the line at c and classifies it by its keyword.
+// Keywords must be followed by a blank or the end of the line, except for
+// mtllib and usemtl, which the grammar accepts as prefixes.
+inline void
+addLine(LineIndex& index, const char* c, const char* end)
+{
+  while (c != end && (*c == ' ' || *c == '\t'))
+  {
+    ++c;
+  }
+
+  auto endsKeyword = [&](const char* k) {
+    return k == end || *k == ' ' || *k == '\t' || *k == '\r' || *k == '\n';
+  };
+
+  LineType type = LineType::Other;
+  if (endsKeyword(c))
+  {
+    type = LineType::Blank;
+  }
+  else if (*c == 'v')
+  {
+    if (endsKeyword(c + 1))
+    {
+      type = LineType::Position;
+    }
+    else if (endsKeyword(c + 2))
+    {
+      type = (c[1] == 'n')   ? LineType::Normal
+             : (c[1] == 't') ? LineType::TexCoord
+                             : LineType::Other;
+    }
+  }
+  else if (*c == 'f')
+  {
+    type = endsKeyword(c + 1) ? LineType::Face : LineType::Other;
+  }
+  else if (*c == '#')
+  {
+    type = LineType::Comment;
+  }
+  else if (
+    end - c >= 6
+    && (std::memcmp(c, "mtllib", 6) == 0 || std::memcmp(c, "usemtl", 6) == 0))
+  {
+    type = LineType::Material;
+  }
+
+  index.lines.push_back(
+    (uint64_t(c - index.begin) << 8) | static_cast<uint8_t>(type));
+}
+
+//------------------------------------------------------------------------------
+// Line ends in [c, end), from any position. Used on its own and for the tail
+// the vector loops leave.
+inline void
+indexLinesScalar(LineIndex& index, const char* c, const char* end)
+{
+  for (; c != end; ++c)
+  {
+    const bool lineEnd
+      = *c == '\n' || (*c == '\r' && (c + 1 == end || c[1] != '\n'));
+    if (lineEnd && c + 1 != end)
+    {
+      addLine(index, c + 1, end);
+    }
+  }
+}
+
+#ifdef OBJPARSER_HAS_SSE2
+//------------------------------------------------------------------------------
+// Each block is also loaded one byte further on, to see whether a '\r' is
+// followed by '\n'; that second load must stay inside the buffer
+inline void
+indexLinesSse2(LineIndex& index, const char* c, const char* end)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i carriage = _mm_set1_epi8('\r');
+  for (; end - c > 16; c += 16)
+  {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c));
+    const __m128i next
+      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + 1));
+    const __m128i lineEnds = _mm_or_si128(
+      _mm_cmpeq_epi8(bytes, newline),
+      _mm_andnot_si128(
+        _mm_cmpeq_epi8(next, newline), _mm_cmpeq_epi8(bytes, carriage)));
+
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(lineEnds));
+    for (; mask != 0; mask &= mask - 1)
+    {
+      addLine(index, c + countTrailingZeros(mask) + 1, end);
+    }
+  }
+  indexLinesScalar(index, c, end);
+}
+#endif
+
+#ifdef __AVX2__
+//------------------------------------------------------------------------------
+inline void
+indexLinesAvx2(LineIndex& index, const char* c, const char* end)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i carriage = _mm256_set1_epi8('\r');
+  for (; end - c > 32; c += 32)
+  {
+    const __m256i bytes
+      = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c));
+    const __m256i next
+      = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + 1));
+    const __m256i lineEnds = _mm256_or_si256(
+      _mm256_cmpeq_epi8(bytes, newline),
+      _mm256_andnot_si256(
+        _mm256_cmpeq_epi8(next, newline), _mm256_cmpeq_epi8(bytes, carriage)));
+
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(lineEnds));
+    for (; mask != 0; mask &= mask - 1)
+    {
+      addLine(index, c + countTrailingZeros(mask) + 1, end);
+    }
+  }
+  indexLinesScalar(index, c, end);
+}
+#endif
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Indexes every line of [begin, end). A level that was not compiled in falls
+// back to the next one down.
+inline LineIndex
+buildLineIndex(
+  const char* begin, const char* end, SimdLevel level = BEST_SIMD_LEVEL)
+{
+  LineIndex index;
+  index.begin = begin;
+  index.end   = end;
+  if (begin == end)
+  {
+    return index;
+  }
+
+  detail::addLine(index, begin, end);
+  switch (level)
+  {
+#ifdef __AVX2__
+  case SimdLevel::Avx2: detail::indexLinesAvx2(index, begin, end); break;
+#endif
+#ifdef OBJPARSER_HAS_SSE2
+# ifndef __AVX2__
+  case SimdLevel::Avx2:
+# endif
+  case SimdLevel::Sse2: detail::indexLinesSse2(index, begin, end); break;
+#endif
+  default: detail::indexLinesScalar(index, begin, end); break;
+  }
+  return index;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
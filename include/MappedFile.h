@@ -0,0 +1,100 @@
+#pragma once
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <string>
+#include <fstream>
+
+//------------------------------------------------------------------------------
+// Read-only memory mapping of a whole file
+//
+// The parser walks the buffer once from front to back, so the mapping is
+// advised for sequential access and the kernel is asked to start reading the
+// pages in ahead of time.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& filename) { open(filename); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  //----------------------------------------------------------------------------
+  bool
+  open(const std::string& filename)
+  {
+    namespace bip = boost::interprocess;
+
+    close();
+
+    // Mapping a zero length file is an error on every platform, so the size is
+    // needed up front. An empty file is still a valid (empty) view.
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in.is_open())
+    {
+      return false;
+    }
+    const std::streamoff fileSize = in.tellg();
+    in.close();
+    if (fileSize < 0)
+    {
+      return false;
+    }
+    if (fileSize == 0)
+    {
+      m_isOpen = true;
+      return true;
+    }
+
+    try
+    {
+      m_file   = bip::file_mapping(filename.c_str(), bip::read_only);
+      m_region = bip::mapped_region(m_file, bip::read_only);
+    }
+    catch (const bip::interprocess_exception&)
+    {
+      close();
+      return false;
+    }
+
+    // Hints only: failure (e.g. unsupported platform) is harmless
+    m_region.advise(bip::mapped_region::advice_sequential);
+    m_region.advise(bip::mapped_region::advice_willneed);
+
+    m_isOpen = true;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void
+  close()
+  {
+    m_region = boost::interprocess::mapped_region();
+    m_file   = boost::interprocess::file_mapping();
+    m_isOpen = false;
+  }
+
+  //----------------------------------------------------------------------------
+  bool isOpen() const { return m_isOpen; }
+  size_t size() const { return m_region.get_size(); }
+
+  const char* begin() const
+  {
+    return static_cast<const char*>(m_region.get_address());
+  }
+  const char* end() const { return begin() + size(); }
+
+private:
+  boost::interprocess::file_mapping m_file;
+  boost::interprocess::mapped_region m_region;
+  bool m_isOpen = false;
+};
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -0,0 +1,592 @@
+#pragma once
+
+#include "ObjParser.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <system_error>
+
+//------------------------------------------------------------------------------
+// Binary mesh cache
+//
+// loadCached() parses an OBJ file once and stores the result, in the
+// ObjFlatAggregate layout, in a binary file next to the source or in a cache
+// directory. Later loads of the same source map that file and return views
+// straight into the mapping, so a warm load costs one read of the source (to
+// hash it) and one of the cache, with no text parsing.
+//
+// A cache file is used only if its format version and element layout match
+// this build, and the absolute path, size, modification time and content hash
+// of the source match those recorded in it. Anything else counts as a miss:
+// the source is parsed and the cache file rewritten.
+//
+// The skipped line counts of a lenient parse are stored too. A lenient load
+// gets them back on a hit, and a strict load never uses such a cache.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+// Read-only view of a contiguous array owned by something else
+template <typename T>
+class ArrayView
+{
+public:
+  ArrayView() = default;
+  ArrayView(const T* data, size_t size)
+      : m_data(data)
+      , m_size(size)
+  {
+  }
+
+  const T* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  const T* begin() const { return m_data; }
+  const T* end() const { return m_data + m_size; }
+  const T& operator[](size_t idx) const { return m_data[idx]; }
+
+private:
+  const T* m_data = nullptr;
+  size_t m_size   = 0;
+};
+
+//------------------------------------------------------------------------------
+// ObjFlatAggregate layout, but read-only and backed either by a mapped cache
+// file or, if the cache could not be written, by a parsed aggregate in memory.
+// The views stay valid for as long as any copy of this object is alive.
+struct ObjCachedAggregate
+{
+  ArrayView<VertexPosition> positions;
+  ArrayView<VertexNormal> normals;
+  ArrayView<VertexTextureCoordinate> texCoords;
+  ArrayView<FaceTriplet> faceCorners;
+  ArrayView<size_t> faceOffsets;
+
+  // True if the data came from an existing cache file rather than a parse
+  bool cacheHit = false;
+
+  std::shared_ptr<const void> storage;
+
+  size_t faceCount() const { return faceOffsets.size() - 1; }
+  size_t faceArity(size_t face) const
+  {
+    return faceOffsets[face + 1] - faceOffsets[face];
+  }
+  const FaceTriplet* faceBegin(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face];
+  }
+  const FaceTriplet* faceEnd(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face + 1];
+  }
+
+  // Copies the data out into the classic layout
+  ObjAggregate
+  toAggregate() const
+  {
+    ObjAggregate data;
+    data.positions.assign(positions.begin(), positions.end());
+    data.normals.assign(normals.begin(), normals.end());
+    data.texCoords.assign(texCoords.begin(), texCoords.end());
+    data.faces.reserve(faceCount());
+    for (size_t i = 0; i < faceCount(); ++i)
+    {
+      data.faces.emplace_back(faceBegin(i), faceEnd(i));
+    }
+    return data;
+  }
+};
+
+//------------------------------------------------------------------------------
+struct CacheOptions : LoadOptions
+{
+  // Where cache files are written. Empty puts each one next to its source,
+  // named <source>.objcache.
+  std::string cacheDirectory;
+};
+
+//------------------------------------------------------------------------------
+// Implementation
+//------------------------------------------------------------------------------
+namespace cache
+{
+//------------------------------------------------------------------------------
+// Bump whenever the file layout or the meaning of any field changes
+static const uint32_t FORMAT_VERSION = 2;
+static const char MAGIC[8]           = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t ENDIAN_MARKER  = 0x01020304;
+static const size_t ARRAY_COUNT      = 5;
+static const size_t ALIGNMENT        = 8;
+static const size_t SKIP_KINDS       = 8;
+
+//------------------------------------------------------------------------------
+// The file is this header, the source path, then the positions, normals,
+// texture coordinates, face corners and face offsets arrays, each starting on
+// an ALIGNMENT boundary
+struct Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t elementSizes[ARRAY_COUNT];
+  uint32_t reserved;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint64_t sourceHash;
+  uint64_t pathLength;
+  uint64_t counts[ARRAY_COUNT];
+
+  // ParseDiagnostics of a lenient parse, all zero for a clean source
+  uint64_t skipped[SKIP_KINDS];
+  uint64_t firstSkippedOffset;
+};
+static_assert(sizeof(Header) % ALIGNMENT == 0, "Header must stay aligned");
+
+//------------------------------------------------------------------------------
+// Everything that must match for a cache file to be used
+struct SourceIdentity
+{
+  std::string path;
+  uint64_t size = 0;
+  int64_t time  = 0;
+  uint64_t hash = 0;
+};
+
+//------------------------------------------------------------------------------
+// The counters of ParseDiagnostics, in the order they are stored in the header
+static size_t ParseDiagnostics::*const SKIP_COUNTERS[SKIP_KINDS] = {
+  &ParseDiagnostics::parameterVertices,
+  &ParseDiagnostics::objects,
+  &ParseDiagnostics::groups,
+  &ParseDiagnostics::smoothingGroups,
+  &ParseDiagnostics::polylines,
+  &ParseDiagnostics::points,
+  &ParseDiagnostics::malformed,
+  &ParseDiagnostics::unknown};
+
+//------------------------------------------------------------------------------
+inline void
+elementSizes(uint32_t (&sizes)[ARRAY_COUNT])
+{
+  sizes[0] = sizeof(VertexPosition);
+  sizes[1] = sizeof(VertexNormal);
+  sizes[2] = sizeof(VertexTextureCoordinate);
+  sizes[3] = sizeof(FaceTriplet);
+  sizes[4] = sizeof(size_t);
+}
+
+//------------------------------------------------------------------------------
+inline uint64_t
+alignUp(uint64_t offset)
+{
+  return (offset + ALIGNMENT - 1) & ~uint64_t(ALIGNMENT - 1);
+}
+
+//------------------------------------------------------------------------------
+// Byte offset of each array from the start of the file, plus the file size in
+// the last entry
+inline std::array<uint64_t, ARRAY_COUNT + 1>
+arrayOffsets(const Header& header)
+{
+  std::array<uint64_t, ARRAY_COUNT + 1> offsets;
+  uint64_t offset = alignUp(sizeof(Header) + header.pathLength);
+  for (size_t i = 0; i < ARRAY_COUNT; ++i)
+  {
+    offsets[i] = offset;
+    offset     = alignUp(offset + header.counts[i] * header.elementSizes[i]);
+  }
+  offsets[ARRAY_COUNT] = offset;
+  return offsets;
+}
+
+//------------------------------------------------------------------------------
+inline uint64_t
+mix(uint64_t hash, uint64_t word)
+{
+  hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+  return hash ^ (hash >> 32);
+}
+
+//------------------------------------------------------------------------------
+// Non-cryptographic 64 bit hash. Four independent lanes keep the multiplies
+// out of each other's way so that hashing runs at close to memory speed.
+inline uint64_t
+hashBytes(const char* data, size_t size)
+{
+  uint64_t lanes[4] = {0x9e3779b97f4a7c15ull ^ size,
+                       0xc2b2ae3d27d4eb4full,
+                       0x165667b19e3779f9ull,
+                       0x27d4eb2f165667c5ull};
+
+  const char* c   = data;
+  const char* end = data + size;
+  for (; end - c >= 32; c += 32)
+  {
+    for (int lane = 0; lane < 4; ++lane)
+    {
+      uint64_t word;
+      std::memcpy(&word, c + lane * 8, sizeof(word));
+      lanes[lane] = mix(lanes[lane], word);
+    }
+  }
+
+  uint64_t hash = mix(mix(lanes[0], lanes[1]), mix(lanes[2], lanes[3]));
+  for (; c != end; ++c)
+  {
+    hash = mix(hash, static_cast<unsigned char>(*c));
+  }
+  return hash;
+}
+
+//------------------------------------------------------------------------------
+inline std::string
+cacheFilename(const std::string& sourcePath, const CacheOptions& options)
+{
+  namespace fs = std::filesystem;
+
+  if (options.cacheDirectory.empty())
+  {
+    return sourcePath + ".objcache";
+  }
+
+  // Sources with the same name in different directories must not collide
+  char pathHash[17];
+  std::snprintf(
+    pathHash,
+    sizeof(pathHash),
+    "%016llx",
+    static_cast<unsigned long long>(
+      hashBytes(sourcePath.data(), sourcePath.size())));
+
+  fs::path path = fs::path(options.cacheDirectory)
+                  / (fs::path(sourcePath).stem().string() + "-" + pathHash
+                     + ".objcache");
+  return path.string();
+}
+
+//------------------------------------------------------------------------------
+inline bool
+identify(
+  const std::string& filename, const MappedFile& source, SourceIdentity& id)
+{
+  namespace fs = std::filesystem;
+
+  std::error_code error;
+  const fs::path path = fs::absolute(filename, error).lexically_normal();
+  const auto time     = fs::last_write_time(path, error);
+  if (error)
+  {
+    return false;
+  }
+
+  id.path = path.string();
+  id.size = source.size();
+  id.time = static_cast<int64_t>(time.time_since_epoch().count());
+  id.hash = hashBytes(source.begin(), source.size());
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+ArrayView<T>
+arrayView(const char* base, uint64_t offset, uint64_t count)
+{
+  return {reinterpret_cast<const T*>(base + offset), count};
+}
+
+//------------------------------------------------------------------------------
+// Points the views at the arrays of a mapped cache file and restores the
+// skipped line counts (but not firstSkipped, which needs the source text).
+// Fails on anything that does not belong to this source or this build, and on
+// anything that could make the views reach outside the mapping.
+inline bool
+openCache(
+  const std::string& filename,
+  const SourceIdentity& id,
+  ObjCachedAggregate& data,
+  ParseDiagnostics& diagnostics)
+{
+  auto file = std::make_shared<MappedFile>();
+  if (!file->open(filename) || file->size() < sizeof(Header))
+  {
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, file->begin(), sizeof(header));
+
+  uint32_t sizes[ARRAY_COUNT];
+  elementSizes(sizes);
+  if (
+    std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+    || header.version != FORMAT_VERSION || header.byteOrder != ENDIAN_MARKER
+    || std::memcmp(header.elementSizes, sizes, sizeof(sizes)) != 0)
+  {
+    return false;
+  }
+
+  if (
+    header.sourceSize != id.size || header.sourceTime != id.time
+    || header.sourceHash != id.hash || header.pathLength != id.path.size()
+    || header.pathLength > file->size() - sizeof(Header)
+    || id.path.compare(
+         0,
+         std::string::npos,
+         file->begin() + sizeof(Header),
+         header.pathLength)
+         != 0)
+  {
+    return false;
+  }
+
+  // Guard the size arithmetic against absurd counts in a damaged file
+  for (uint64_t count : header.counts)
+  {
+    if (count > file->size())
+    {
+      return false;
+    }
+  }
+  const auto offsets = arrayOffsets(header);
+  if (offsets[ARRAY_COUNT] != file->size())
+  {
+    return false;
+  }
+
+  diagnostics = ParseDiagnostics();
+  for (size_t i = 0; i < SKIP_KINDS; ++i)
+  {
+    diagnostics.*SKIP_COUNTERS[i] = header.skipped[i];
+  }
+  if (
+    diagnostics.skippedLines() != 0 && header.firstSkippedOffset >= id.size)
+  {
+    return false;
+  }
+  diagnostics.firstSkipped.offset = header.firstSkippedOffset;
+
+  const char* base = file->begin();
+  data.positions
+    = arrayView<VertexPosition>(base, offsets[0], header.counts[0]);
+  data.normals = arrayView<VertexNormal>(base, offsets[1], header.counts[1]);
+  data.texCoords
+    = arrayView<VertexTextureCoordinate>(base, offsets[2], header.counts[2]);
+  data.faceCorners
+    = arrayView<FaceTriplet>(base, offsets[3], header.counts[3]);
+  data.faceOffsets = arrayView<size_t>(base, offsets[4], header.counts[4]);
+
+  const auto& faceOffsets = data.faceOffsets;
+  if (faceOffsets.empty() || faceOffsets[0] != 0)
+  {
+    return false;
+  }
+  for (size_t i = 1; i < faceOffsets.size(); ++i)
+  {
+    if (faceOffsets[i] < faceOffsets[i - 1])
+    {
+      return false;
+    }
+  }
+  if (faceOffsets[faceOffsets.size() - 1] != data.faceCorners.size())
+  {
+    return false;
+  }
+
+  data.storage = std::move(file);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Writes bytes followed by zeros up to the next ALIGNMENT boundary
+inline void
+writeAligned(std::ostream& out, const void* bytes, size_t size)
+{
+  static const char PADDING[ALIGNMENT] = {};
+
+  out.write(static_cast<const char*>(bytes), size);
+  out.write(PADDING, alignUp(size) - size);
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+void
+writeArray(std::ostream& out, const std::vector<T>& array)
+{
+  writeAligned(out, array.data(), array.size() * sizeof(T));
+}
+
+//------------------------------------------------------------------------------
+// Writes to a temporary file first and renames it into place, so that other
+// processes never map a partially written cache
+inline bool
+writeCache(
+  const std::string& filename,
+  const SourceIdentity& id,
+  const ObjFlatAggregate& data,
+  const ParseDiagnostics& diagnostics)
+{
+  namespace fs = std::filesystem;
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version   = FORMAT_VERSION;
+  header.byteOrder = ENDIAN_MARKER;
+  elementSizes(header.elementSizes);
+  header.sourceSize = id.size;
+  header.sourceTime = id.time;
+  header.sourceHash = id.hash;
+  header.pathLength = id.path.size();
+  header.counts[0]  = data.positions.size();
+  header.counts[1]  = data.normals.size();
+  header.counts[2]  = data.texCoords.size();
+  header.counts[3]  = data.faceCorners.size();
+  header.counts[4]  = data.faceOffsets.size();
+  for (size_t i = 0; i < SKIP_KINDS; ++i)
+  {
+    header.skipped[i] = diagnostics.*SKIP_COUNTERS[i];
+  }
+  header.firstSkippedOffset = diagnostics.firstSkipped.offset;
+
+  std::error_code error;
+  const fs::path directory = fs::path(filename).parent_path();
+  if (!directory.empty())
+  {
+    fs::create_directories(directory, error);
+  }
+
+  const std::string temporary
+    = filename + ".tmp" + std::to_string(std::random_device()());
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+      return false;
+    }
+
+    // The header size is a multiple of ALIGNMENT, so aligning after the path
+    // matches arrayOffsets()
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeAligned(out, id.path.data(), id.path.size());
+
+    writeArray(out, data.positions);
+    writeArray(out, data.normals);
+    writeArray(out, data.texCoords);
+    writeArray(out, data.faceCorners);
+    writeArray(out, data.faceOffsets);
+    if (!out.flush())
+    {
+      out.close();
+      fs::remove(temporary, error);
+      return false;
+    }
+  }
+
+  fs::rename(temporary, filename, error);
+  if (error)
+  {
+    fs::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline ObjCachedAggregate
+viewInMemory(ObjFlatAggregate&& parsed)
+{
+  auto owner = std::make_shared<ObjFlatAggregate>(std::move(parsed));
+
+  ObjCachedAggregate data;
+  data.positions = {owner->positions.data(), owner->positions.size()};
+  data.normals   = {owner->normals.data(), owner->normals.size()};
+  data.texCoords = {owner->texCoords.data(), owner->texCoords.size()};
+  data.faceCorners
+    = {owner->faceCorners.data(), owner->faceCorners.size()};
+  data.faceOffsets
+    = {owner->faceOffsets.data(), owner->faceOffsets.size()};
+  data.storage = std::move(owner);
+  return data;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace cache
+
+//------------------------------------------------------------------------------
+// Library Interface
+//------------------------------------------------------------------------------
+inline std::optional<ObjCachedAggregate>
+loadCached(const std::string& filename, const CacheOptions& options = {})
+{
+  MappedFile source(filename);
+  if (!source.isOpen())
+  {
+    reportFileFailure("File open failed", options.error);
+    return {};
+  }
+
+  cache::SourceIdentity id;
+  if (!cache::identify(filename, source, id))
+  {
+    reportFileFailure("File stat failed", options.error);
+    return {};
+  }
+
+  // A cache written by a lenient parse holds a partial mesh, which a strict
+  // load must not accept
+  const std::string cacheFile = cache::cacheFilename(id.path, options);
+  ObjCachedAggregate data;
+  ParseDiagnostics diagnostics;
+  if (
+    cache::openCache(cacheFile, id, data, diagnostics)
+    && (options.lenient || diagnostics.skippedLines() == 0))
+  {
+    if (diagnostics.skippedLines() != 0)
+    {
+      diagnostics.firstSkipped = locateFailure(
+        source.begin(),
+        source.begin() + diagnostics.firstSkipped.offset,
+        source.end(),
+        "skipped");
+    }
+    reportSkipped(diagnostics, options.diagnostics);
+    data.cacheHit = true;
+    return data;
+  }
+
+  diagnostics               = ParseDiagnostics();
+  ParseOptions parseOptions = options;
+  parseOptions.diagnostics  = &diagnostics;
+  auto parsed
+    = parseAsFlatAggregate(source.begin(), source.end(), parseOptions);
+  if (!parsed)
+  {
+    return {};
+  }
+  if (options.diagnostics)
+  {
+    *options.diagnostics = diagnostics;
+  }
+
+  ParseDiagnostics written;
+  if (
+    cache::writeCache(cacheFile, id, *parsed, diagnostics)
+    && cache::openCache(cacheFile, id, data, written))
+  {
+    return data;
+  }
+
+  LOG_WARNING("Cache write failed: %s", cacheFile.c_str());
+  return cache::viewInMemory(std::move(*parsed));
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
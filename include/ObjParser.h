@@ -9,11 +9,20 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <optional>
+#include <type_traits>
 #include <iostream>
 #include <fstream>
 
 #include "log.h"
+#include "FloatParser.h"
+#include "LineIndex.h"
+#include "MappedFile.h"
+#include "Parallel.h"
 
 //------------------------------------------------------------------------------
 // Types
@@ -100,7 +109,7 @@ struct FaceTriplet
 
 //------------------------------------------------------------------------------
 using Face = std::vector<FaceTriplet>;
-std::ostream&
+inline std::ostream&
 operator<<(std::ostream& os, const Face& face)
 {
   os << "f: ";
@@ -120,12 +129,555 @@ struct ObjAggregate
   std::vector<Face> faces;
 };
 
+//------------------------------------------------------------------------------
+// Same content as ObjAggregate, but the faces are stored in compressed sparse
+// row form: the corners of all faces back to back in a single array, and the
+// corners of face i are faceCorners[faceOffsets[i], faceOffsets[i + 1])
+struct ObjFlatAggregate
+{
+  std::vector<VertexPosition> positions;
+  std::vector<VertexNormal> normals;
+  std::vector<VertexTextureCoordinate> texCoords;
+  std::vector<FaceTriplet> faceCorners;
+  std::vector<size_t> faceOffsets = {0};
+
+  size_t faceCount() const { return faceOffsets.size() - 1; }
+  size_t faceArity(size_t face) const
+  {
+    return faceOffsets[face + 1] - faceOffsets[face];
+  }
+  const FaceTriplet* faceBegin(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face];
+  }
+  const FaceTriplet* faceEnd(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face + 1];
+  }
+};
+
+//------------------------------------------------------------------------------
+// Structure of arrays layout. Element i of every array in a group belongs to
+// the same vertex, normal or texture coordinate.
+struct PositionArrays
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  // Empty until a vertex with a w other than the default of 1.0 is parsed,
+  // from then on it holds one entry per vertex
+  std::vector<float> w;
+
+  size_t size() const { return x.size(); }
+  bool hasW() const { return !w.empty(); }
+  VertexPosition operator[](size_t idx) const
+  {
+    return {x[idx], y[idx], z[idx], hasW() ? w[idx] : 1.0f};
+  }
+};
+
+//------------------------------------------------------------------------------
+struct NormalArrays
+{
+  std::vector<float> i;
+  std::vector<float> j;
+  std::vector<float> k;
+
+  size_t size() const { return i.size(); }
+  VertexNormal operator[](size_t idx) const { return {i[idx], j[idx], k[idx]}; }
+};
+
+//------------------------------------------------------------------------------
+struct TexCoordArrays
+{
+  std::vector<float> u;
+  std::vector<float> v;
+  std::vector<float> w;
+
+  size_t size() const { return u.size(); }
+  VertexTextureCoordinate operator[](size_t idx) const
+  {
+    return {u[idx], v[idx], w[idx]};
+  }
+};
+
+//------------------------------------------------------------------------------
+// Faces use the same layout as ObjFlatAggregate
+struct ObjSoaAggregate
+{
+  PositionArrays positions;
+  NormalArrays normals;
+  TexCoordArrays texCoords;
+  std::vector<FaceTriplet> faceCorners;
+  std::vector<size_t> faceOffsets = {0};
+
+  size_t faceCount() const { return faceOffsets.size() - 1; }
+  size_t faceArity(size_t face) const
+  {
+    return faceOffsets[face + 1] - faceOffsets[face];
+  }
+  const FaceTriplet* faceBegin(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face];
+  }
+  const FaceTriplet* faceEnd(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face + 1];
+  }
+};
+
+//------------------------------------------------------------------------------
+// Attribute mask of parseAsAggregate and loadAsAggregate, choosing at compile
+// time which elements are kept. FaceUvs and FaceNormals only apply together
+// with Faces.
+enum class Attributes : unsigned
+{
+  Positions   = 1 << 0,
+  Normals     = 1 << 1,
+  TexCoords   = 1 << 2,
+  Faces       = 1 << 3,    // faces with the vertex index of each corner
+  FaceUvs     = 1 << 4,    // texture coordinate index of each corner
+  FaceNormals = 1 << 5,    // normal index of each corner
+  All         = (1 << 6) - 1,
+};
+
+constexpr Attributes
+operator|(Attributes lhs, Attributes rhs)
+{
+  return Attributes(unsigned(lhs) | unsigned(rhs));
+}
+
+constexpr bool
+hasAttributes(Attributes mask, Attributes attributes)
+{
+  return (unsigned(mask) & unsigned(attributes)) == unsigned(attributes);
+}
+
+//------------------------------------------------------------------------------
+// Each index of a face corner lives in its own base, so that the ones not
+// selected take no space
+namespace detail
+{
+struct CornerVertex
+{
+  int vertexIndex = 0;    // zero means undefined
+};
+
+struct CornerUv
+{
+  int uvIndex = 0;    // zero means undefined
+};
+
+struct CornerNormal
+{
+  int normalIndex = 0;    // zero means undefined
+};
+
+struct NoCornerUv
+{
+};
+
+struct NoCornerNormal
+{
+};
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// A FaceTriplet holding only the indices MASK selects. Converting from a
+// FaceTriplet drops the others.
+template <Attributes MASK>
+struct SelectedCorner
+    : detail::CornerVertex
+    , std::conditional_t<
+        hasAttributes(MASK, Attributes::FaceUvs),
+        detail::CornerUv,
+        detail::NoCornerUv>
+    , std::conditional_t<
+        hasAttributes(MASK, Attributes::FaceNormals),
+        detail::CornerNormal,
+        detail::NoCornerNormal>
+{
+  static constexpr bool HAS_UV = hasAttributes(MASK, Attributes::FaceUvs);
+  static constexpr bool HAS_NORMAL
+    = hasAttributes(MASK, Attributes::FaceNormals);
+
+  SelectedCorner() = default;
+  SelectedCorner(const FaceTriplet& corner)
+  {
+    this->vertexIndex = corner.vertexIndex;
+    if constexpr (HAS_UV)
+    {
+      this->uvIndex = corner.uvIndex;
+    }
+    if constexpr (HAS_NORMAL)
+    {
+      this->normalIndex = corner.normalIndex;
+    }
+  }
+
+  friend bool operator==(const SelectedCorner& lhs, const SelectedCorner& rhs)
+  {
+    bool equal = lhs.vertexIndex == rhs.vertexIndex;
+    if constexpr (HAS_UV)
+    {
+      equal = equal && lhs.uvIndex == rhs.uvIndex;
+    }
+    if constexpr (HAS_NORMAL)
+    {
+      equal = equal && lhs.normalIndex == rhs.normalIndex;
+    }
+    return equal;
+  }
+};
+
+//------------------------------------------------------------------------------
+// The elements MASK selects, with faces in the layout of ObjFlatAggregate.
+// The arrays of element types not selected stay empty.
+template <Attributes MASK>
+struct ObjSelectedAggregate
+{
+  static constexpr Attributes ATTRIBUTES = MASK;
+  static constexpr bool POSITIONS  = hasAttributes(MASK, Attributes::Positions);
+  static constexpr bool NORMALS    = hasAttributes(MASK, Attributes::Normals);
+  static constexpr bool TEX_COORDS = hasAttributes(MASK, Attributes::TexCoords);
+  static constexpr bool FACES      = hasAttributes(MASK, Attributes::Faces);
+
+  using Corner = SelectedCorner<MASK>;
+
+  std::vector<VertexPosition> positions;
+  std::vector<VertexNormal> normals;
+  std::vector<VertexTextureCoordinate> texCoords;
+  std::vector<Corner> faceCorners;
+  std::vector<size_t> faceOffsets = {0};
+
+  size_t faceCount() const { return faceOffsets.size() - 1; }
+  size_t faceArity(size_t face) const
+  {
+    return faceOffsets[face + 1] - faceOffsets[face];
+  }
+  const Corner* faceBegin(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face];
+  }
+  const Corner* faceEnd(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face + 1];
+  }
+};
+
+template <typename Data>
+constexpr bool IS_SELECTED_AGGREGATE = false;
+
+template <Attributes MASK>
+constexpr bool IS_SELECTED_AGGREGATE<ObjSelectedAggregate<MASK>> = true;
+
+// What parseAsAggregate and loadAsAggregate return for MASK. Selecting
+// everything keeps the ObjAggregate layout.
+template <Attributes MASK>
+using SelectedAggregate = std::conditional_t<
+  MASK == Attributes::All,
+  ObjAggregate,
+  ObjSelectedAggregate<MASK>>;
+
+//------------------------------------------------------------------------------
+// Appends an element if its type is selected, dropping it otherwise
+template <Attributes MASK>
+void
+storeSelected(ObjSelectedAggregate<MASK>& data, const VertexPosition& v)
+{
+  if constexpr (ObjSelectedAggregate<MASK>::POSITIONS)
+  {
+    data.positions.push_back(v);
+  }
+}
+
+template <Attributes MASK>
+void
+storeSelected(ObjSelectedAggregate<MASK>& data, const VertexNormal& n)
+{
+  if constexpr (ObjSelectedAggregate<MASK>::NORMALS)
+  {
+    data.normals.push_back(n);
+  }
+}
+
+template <Attributes MASK>
+void
+storeSelected(
+  ObjSelectedAggregate<MASK>& data, const VertexTextureCoordinate& uv)
+{
+  if constexpr (ObjSelectedAggregate<MASK>::TEX_COORDS)
+  {
+    data.texCoords.push_back(uv);
+  }
+}
+
+// A face from any range of FaceTriplet
+template <Attributes MASK, typename Corners>
+void
+storeSelectedFace(ObjSelectedAggregate<MASK>& data, const Corners& face)
+{
+  if constexpr (ObjSelectedAggregate<MASK>::FACES)
+  {
+    data.faceCorners.insert(data.faceCorners.end(), face.begin(), face.end());
+    data.faceOffsets.push_back(data.faceCorners.size());
+  }
+}
+
 //------------------------------------------------------------------------------
 using ObjVariant
   = boost::variant<VertexPosition, VertexNormal, VertexTextureCoordinate, Face>;
 
 using ObjVariantVec = std::vector<ObjVariant>;
 
+//------------------------------------------------------------------------------
+// Number of elements of each kind, as found by the countElements() pre-pass
+struct ObjCounts
+{
+  size_t positions   = 0;
+  size_t normals     = 0;
+  size_t texCoords   = 0;
+  size_t faces       = 0;
+  size_t faceCorners = 0;
+};
+
+//------------------------------------------------------------------------------
+// A face corner with zero-based indices, ready to index the element arrays
+struct ResolvedCorner
+{
+  static constexpr uint32_t ABSENT = UINT32_MAX;
+
+  uint32_t vertexIndex = ABSENT;
+  uint32_t uvIndex     = ABSENT;
+  uint32_t normalIndex = ABSENT;
+
+  friend std::ostream& operator<<(std::ostream& os, const ResolvedCorner& f)
+  {
+    return os << "(" << f.vertexIndex << ", " << f.uvIndex << ", "
+              << f.normalIndex << ") ";
+  }
+
+  friend bool operator==(const ResolvedCorner& lhs, const ResolvedCorner& rhs)
+  {
+    return lhs.vertexIndex == rhs.vertexIndex && lhs.uvIndex == rhs.uvIndex
+           && lhs.normalIndex == rhs.normalIndex;
+  }
+};
+
+//------------------------------------------------------------------------------
+// ObjFlatAggregate with the face indices resolved as each corner is parsed:
+// 1-based indices become zero-based, negative ones are resolved against the
+// elements parsed so far, and a missing uv or normal index is ABSENT. A line
+// with a vertex index of zero, or a relative index before the first element,
+// fails to parse.
+struct ObjResolvedAggregate
+{
+  std::vector<VertexPosition> positions;
+  std::vector<VertexNormal> normals;
+  std::vector<VertexTextureCoordinate> texCoords;
+  std::vector<ResolvedCorner> faceCorners;
+  std::vector<size_t> faceOffsets = {0};
+
+  // Elements before the parsed text, which relative indices also count. Only
+  // set when parsing part of a file, as the parallel parse does per chunk.
+  ObjCounts preceding;
+
+  size_t faceCount() const { return faceOffsets.size() - 1; }
+  size_t faceArity(size_t face) const
+  {
+    return faceOffsets[face + 1] - faceOffsets[face];
+  }
+  const ResolvedCorner* faceBegin(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face];
+  }
+  const ResolvedCorner* faceEnd(size_t face) const
+  {
+    return faceCorners.data() + faceOffsets[face + 1];
+  }
+};
+
+//------------------------------------------------------------------------------
+// The zero-based index of an OBJ index among count elements seen so far
+inline bool
+resolveIndex(int index, size_t count, uint32_t& resolved)
+{
+  if (index > 0)
+  {
+    resolved = static_cast<uint32_t>(index - 1);
+    return true;
+  }
+  if (index < 0 && static_cast<size_t>(-int64_t(index)) <= count)
+  {
+    resolved = static_cast<uint32_t>(int64_t(count) + index);
+    return true;
+  }
+  return false;
+}
+
+//------------------------------------------------------------------------------
+// Zero uv and normal indices are the ones FaceTriplet leaves undefined
+inline bool
+resolveCorner(
+  const ObjResolvedAggregate& data,
+  const FaceTriplet& corner,
+  ResolvedCorner& resolved)
+{
+  const ObjCounts& before = data.preceding;
+  return resolveIndex(
+           corner.vertexIndex,
+           before.positions + data.positions.size(),
+           resolved.vertexIndex)
+         && (corner.uvIndex == 0
+             || resolveIndex(
+               corner.uvIndex,
+               before.texCoords + data.texCoords.size(),
+               resolved.uvIndex))
+         && (corner.normalIndex == 0
+             || resolveIndex(
+               corner.normalIndex,
+               before.normals + data.normals.size(),
+               resolved.normalIndex));
+}
+
+//------------------------------------------------------------------------------
+inline bool
+storeResolvedCorner(ObjResolvedAggregate& data, const FaceTriplet& corner)
+{
+  ResolvedCorner resolved;
+  if (!resolveCorner(data, corner, resolved))
+  {
+    return false;
+  }
+  data.faceCorners.push_back(resolved);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+enum class ElementKind
+{
+  Any,    // the line did not start with a known keyword
+  Position,
+  Normal,
+  TexCoord,
+  Face,
+};
+
+inline const char*
+toString(ElementKind kind)
+{
+  switch (kind)
+  {
+  case ElementKind::Position: return "position";
+  case ElementKind::Normal: return "normal";
+  case ElementKind::TexCoord: return "texture coordinate";
+  case ElementKind::Face: return "face";
+  default: return "element";
+  }
+}
+
+//------------------------------------------------------------------------------
+// Where and why a parse failed. Fixed size so that reporting a failure never
+// allocates, however large the input.
+struct ParseError
+{
+  static constexpr size_t MAX_SNIPPET = 80;
+
+  const char* message  = "";    // static string, e.g. "unparsed"
+  size_t offset        = 0;     // in bytes from the start of the input
+  size_t line          = 0;     // 1-based, zero if there is no position
+  size_t column        = 0;     // 1-based, in bytes
+  ElementKind expected = ElementKind::Any;
+
+  // The input from the failure position to the end of its line, truncated
+  // to MAX_SNIPPET characters
+  char snippet[MAX_SNIPPET + 1] = {};
+};
+
+//------------------------------------------------------------------------------
+// Lines skipped by a lenient parse, counted by keyword
+struct ParseDiagnostics
+{
+  size_t parameterVertices = 0;    // vp
+  size_t objects           = 0;    // o
+  size_t groups            = 0;    // g
+  size_t smoothingGroups   = 0;    // s
+  size_t polylines         = 0;    // l
+  size_t points            = 0;    // p
+  size_t malformed         = 0;    // v, vn, vt or f lines that failed to parse
+  size_t unknown           = 0;    // anything else
+
+  // Location of the first skipped line (message is empty if there was none)
+  ParseError firstSkipped;
+
+  size_t
+  skippedLines() const
+  {
+    return parameterVertices + objects + groups + smoothingGroups + polylines
+           + points + malformed + unknown;
+  }
+
+  // Adds up the counts only; firstSkipped is left alone
+  ParseDiagnostics&
+  operator+=(const ParseDiagnostics& rhs)
+  {
+    parameterVertices += rhs.parameterVertices;
+    objects += rhs.objects;
+    groups += rhs.groups;
+    smoothingGroups += rhs.smoothingGroups;
+    polylines += rhs.polylines;
+    points += rhs.points;
+    malformed += rhs.malformed;
+    unknown += rhs.unknown;
+    return *this;
+  }
+};
+
+//------------------------------------------------------------------------------
+struct ParseOptions
+{
+  // Number of threads used to parse a contiguous buffer into an aggregate.
+  // The buffer is split at line boundaries and each chunk is parsed on its
+  // own thread. Zero uses every hardware core.
+  unsigned threadCount = 1;
+
+  // Buffers are never split into chunks smaller than this
+  size_t minChunkSize = 1 << 20;
+
+  // Count the elements in a quick pass over the buffer first, so that every
+  // output array is allocated once at its final size rather than grown
+  bool presize = false;
+
+  // If set, receives the details of a failure (failures are logged either way)
+  ParseError* error = nullptr;
+
+  // Instead of failing on a line that does not parse, skip to the next line
+  // and carry on. The skipped lines are counted in *diagnostics, if set.
+  bool lenient                  = false;
+  ParseDiagnostics* diagnostics = nullptr;
+
+  // Index every line of a contiguous buffer first (see LineIndex.h). Chunks
+  // are then split and presized from the index, and the scanner backend
+  // dispatches each line on its type and skips comment, material and blank
+  // lines without reading them. The grammars parse as usual.
+  bool lineIndex = false;
+
+  // Parse contiguous buffers with the uniform file fast path (see
+  // UniformParser.h) in front of the selected backend. Files in one fixed
+  // layout skip the general rules; any line outside it still uses them.
+  bool uniform = false;
+};
+
+//------------------------------------------------------------------------------
+struct LoadOptions : ParseOptions
+{
+  // Map the file into memory and parse it in place with raw char pointers.
+  // Otherwise the file is streamed through boost::spirit::istream_iterator,
+  // which is always parsed on a single thread.
+  bool memoryMap = true;
+};
+
 //------------------------------------------------------------------------------
 }    // namespace ObjParser
 
@@ -160,6 +712,9 @@ BOOST_FUSION_ADAPT_STRUCT(
   (int, normalIndex)
 )
 // clang-format on
+
+#include "FaceParser.h"
+
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
@@ -171,30 +726,25 @@ namespace qi      = boost::spirit::qi;
 namespace phoenix = boost::phoenix;
 
 //------------------------------------------------------------------------------
+// Only spaces and tabs are skipped between tokens. Line ends are matched by
+// the grammar itself, and comments and directives are tried once per line
+// rather than at every token.
 template <typename Iterator>
-struct SkipParser : public qi::grammar<Iterator>
-{
-  SkipParser()
-      : SkipParser::base_type(skipper)
-  {
-    using qi::char_;
-    using qi::eol;
-
-    comment = "#" >> *(char_ - eol);
-
-    // TODO(James): handle materials
-    materialLib = "mtllib" >> *(char_ - eol);
-    useMaterial = "usemtl" >> *(char_ - eol);
-
-    skipper = qi::space | comment | materialLib | useMaterial;
-  }
-  qi::rule<Iterator> skipper;
-  qi::rule<Iterator> comment;
-  qi::rule<Iterator> materialLib;
-  qi::rule<Iterator> useMaterial;
-};
+using SkipParser = qi::blank_type;
 
 //------------------------------------------------------------------------------
+// The element rules parse what follows the keyword. The start rule of each
+// derived grammar matches the keyword itself, a character at a time, so that
+// a line is dispatched on its first one or two characters and no element is
+// ever partly parsed and then abandoned. Each element rule runs to the end
+// of its line (an optional comment, then eol or eoi), so semantic actions only
+// ever see whole lines:
+//
+//   *(!eoi >> (
+//     'v' >> (no_skip['n'] >> normal | no_skip['t'] >> texCoord | position)
+//     | 'f' >> face
+//     | -directive >> lineEnd
+//   ))
 template <
   typename Data,
   typename Iterator,
@@ -204,26 +754,41 @@ struct ObjParserCommon : public qi::grammar<Iterator, Data(), Skipper>
   ObjParserCommon()
       : ObjParserCommon::base_type(start)
   {
-    using qi::double_;
+    using phoenix::bind;
+    using qi::_1;
+    using qi::_val;
+    using qi::char_;
+    using qi::eoi;
+    using qi::eol;
     using qi::int_;
+    using qi::lit;
+
+    comment = '#' >> *(char_ - eol);
+
+    // TODO(James): handle materials
+    directive = (lit("mtllib") | "usemtl") >> *(char_ - eol);
+    lineEnd   = -comment >> (eol | eoi);
 
-    position = 'v' >> double_ >> double_ >> double_ >> -(double_);
-    normal   = "vn" >> double_ >> double_ >> double_;
-    texCoord = "vt" >> double_ >> -(double_) >> -(double_);
+    position = fastFloat >> fastFloat >> fastFloat >> -(fastFloat) >> lineEnd;
+    normal   = fastFloat >> fastFloat >> fastFloat >> lineEnd;
+    texCoord = fastFloat >> -(fastFloat) >> -(fastFloat) >> lineEnd;
 
-    faceDuo     = int_ >> -('/' >> int_);
-    faceTriplet = int_ >> '/' >> -(int_) >> '/' >> int_;
-    face        = 'f' >> +(faceTriplet | faceDuo);
+    // v, v/vt, v//vn or v/vt/vn; see FaceParser.h
+    faceCorner = fastFaceCorner;
+    face       = +faceCorner >> lineEnd;
   }
 
   qi::rule<Iterator, VertexPosition(), Skipper> position;
   qi::rule<Iterator, VertexNormal(), Skipper> normal;
   qi::rule<Iterator, VertexTextureCoordinate(), Skipper> texCoord;
 
-  qi::rule<Iterator, FaceTriplet(), Skipper> faceDuo;
-  qi::rule<Iterator, FaceTriplet(), Skipper> faceTriplet;
+  qi::rule<Iterator, FaceTriplet(), Skipper> faceCorner;
   qi::rule<Iterator, Face(), Skipper> face;
 
+  qi::rule<Iterator> comment;
+  qi::rule<Iterator> directive;
+  qi::rule<Iterator, Skipper> lineEnd;
+
   qi::rule<Iterator, Data(), Skipper> start;
 };
 
@@ -237,8 +802,24 @@ struct ObjParserVariant : public Common
 {
   ObjParserVariant()
   {
-    Common::start
-      = *(Common::position | Common::normal | Common::texCoord | Common::face);
+    using phoenix::push_back;
+    using qi::_1;
+    using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
+
+    // clang-format off
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [push_back(_val, _1)]
+        | no_skip['t'] >> Common::texCoord  [push_back(_val, _1)]
+        | Common::position                  [push_back(_val, _1)]
+      )
+      | lit('f') >> Common::face            [push_back(_val, _1)]
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
   }
 };
 
@@ -256,6 +837,9 @@ struct ObjParserSemanticActions : public Common
     using phoenix::push_back;
     using qi::_1;
     using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
 
     auto _positions = bind(&Data::positions, _val);
     auto _normals   = bind(&Data::normals, _val);
@@ -263,59 +847,861 @@ struct ObjParserSemanticActions : public Common
     auto _faces     = bind(&Data::faces, _val);
 
     // clang-format off
-    Common::start = *(
-      Common::position      [push_back(_positions, _1)]
-      | Common::normal      [push_back(_normals, _1)]
-      | Common::texCoord    [push_back(_texCoords, _1)]
-      | Common::face        [push_back(_faces, _1)]
-    );
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [push_back(_normals, _1)]
+        | no_skip['t'] >> Common::texCoord  [push_back(_texCoords, _1)]
+        | Common::position                  [push_back(_positions, _1)]
+      )
+      | lit('f') >> Common::face            [push_back(_faces, _1)]
+      | -Common::directive >> Common::lineEnd
+    ));
     // clang-format on
   }
 };
 
+//------------------------------------------------------------------------------
+// Appends face corners straight into the flat corner array, closing each face
+// by recording the new end offset. No per-face container is created.
+template <
+  typename Data,
+  typename Iterator,
+  typename Skipper = SkipParser<Iterator>,
+  typename Common  = ObjParserCommon<Data, Iterator, Skipper>>
+struct ObjParserFlatActions : public Common
+{
+  ObjParserFlatActions()
+  {
+    using phoenix::bind;
+    using phoenix::push_back;
+    using phoenix::size;
+    using qi::_1;
+    using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
+
+    auto _positions = bind(&Data::positions, _val);
+    auto _normals   = bind(&Data::normals, _val);
+    auto _texCoords = bind(&Data::texCoords, _val);
+    auto _corners   = bind(&Data::faceCorners, _val);
+    auto _offsets   = bind(&Data::faceOffsets, _val);
+
+    // clang-format off
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [push_back(_normals, _1)]
+        | no_skip['t'] >> Common::texCoord  [push_back(_texCoords, _1)]
+        | Common::position                  [push_back(_positions, _1)]
+      )
+      | (lit('f') >> +Common::faceCorner[push_back(_corners, _1)]
+          >> Common::lineEnd)
+                            [push_back(_offsets, size(_corners))]
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
+  }
+};
+
+//------------------------------------------------------------------------------
+// Splits parsed elements across the structure of arrays
+struct AppendToArrays
+{
+  void operator()(PositionArrays& arrays, const VertexPosition& v) const
+  {
+    // hasW() cannot tell yet if this is the first position
+    const bool storeW = arrays.hasW() || v.w != 1.0f;
+    if (storeW && !arrays.hasW())
+    {
+      arrays.w.assign(arrays.size(), 1.0f);
+    }
+    arrays.x.push_back(v.x);
+    arrays.y.push_back(v.y);
+    arrays.z.push_back(v.z);
+    if (storeW)
+    {
+      arrays.w.push_back(v.w);
+    }
+  }
+
+  void operator()(NormalArrays& arrays, const VertexNormal& n) const
+  {
+    arrays.i.push_back(n.i);
+    arrays.j.push_back(n.j);
+    arrays.k.push_back(n.k);
+  }
+
+  void
+  operator()(TexCoordArrays& arrays, const VertexTextureCoordinate& uv) const
+  {
+    arrays.u.push_back(uv.u);
+    arrays.v.push_back(uv.v);
+    arrays.w.push_back(uv.w);
+  }
+};
+
+//------------------------------------------------------------------------------
+template <
+  typename Data,
+  typename Iterator,
+  typename Skipper = SkipParser<Iterator>,
+  typename Common  = ObjParserCommon<Data, Iterator, Skipper>>
+struct ObjParserSoaActions : public Common
+{
+  ObjParserSoaActions()
+  {
+    using phoenix::bind;
+    using phoenix::push_back;
+    using phoenix::size;
+    using qi::_1;
+    using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
+
+    phoenix::function<AppendToArrays> append;
+
+    auto _positions = bind(&Data::positions, _val);
+    auto _normals   = bind(&Data::normals, _val);
+    auto _texCoords = bind(&Data::texCoords, _val);
+    auto _corners   = bind(&Data::faceCorners, _val);
+    auto _offsets   = bind(&Data::faceOffsets, _val);
+
+    // clang-format off
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [append(_normals, _1)]
+        | no_skip['t'] >> Common::texCoord  [append(_texCoords, _1)]
+        | Common::position                  [append(_positions, _1)]
+      )
+      | (lit('f') >> +Common::faceCorner[push_back(_corners, _1)]
+          >> Common::lineEnd)
+                            [push_back(_offsets, size(_corners))]
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
+  }
+};
+
+//------------------------------------------------------------------------------
+struct StoreResolvedCorner
+{
+  bool
+  operator()(ObjResolvedAggregate& data, const FaceTriplet& corner) const
+  {
+    return storeResolvedCorner(data, corner);
+  }
+};
+
+//------------------------------------------------------------------------------
+// The flat grammar, resolving each corner as it is appended. A corner that
+// cannot be resolved fails its line.
+template <
+  typename Data,
+  typename Iterator,
+  typename Skipper = SkipParser<Iterator>,
+  typename Common  = ObjParserCommon<Data, Iterator, Skipper>>
+struct ObjParserResolvedActions : public Common
+{
+  ObjParserResolvedActions()
+  {
+    using phoenix::bind;
+    using phoenix::push_back;
+    using phoenix::size;
+    using qi::_1;
+    using qi::_pass;
+    using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
+
+    phoenix::function<StoreResolvedCorner> storeCorner;
+
+    auto _positions = bind(&Data::positions, _val);
+    auto _normals   = bind(&Data::normals, _val);
+    auto _texCoords = bind(&Data::texCoords, _val);
+    auto _corners   = bind(&Data::faceCorners, _val);
+    auto _offsets   = bind(&Data::faceOffsets, _val);
+
+    // clang-format off
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [push_back(_normals, _1)]
+        | no_skip['t'] >> Common::texCoord  [push_back(_texCoords, _1)]
+        | Common::position                  [push_back(_positions, _1)]
+      )
+      | (lit('f') >> +Common::faceCorner[_pass = storeCorner(_val, _1)]
+          >> Common::lineEnd)
+                            [push_back(_offsets, size(_corners))]
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
+  }
+};
+
+//------------------------------------------------------------------------------
+// Fills an ObjSelectedAggregate. A line of an element type that is not
+// selected is skipped unread up to its end when the keyword is followed by a
+// blank or the line end, so it is not checked either. Other spellings, such
+// as "vn1 2 3", are still parsed and dropped, so that the lines accepted and
+// the elements kept are otherwise those of the full grammar.
+template <
+  typename Data,
+  typename Iterator,
+  typename Skipper = SkipParser<Iterator>,
+  typename Common  = ObjParserCommon<Data, Iterator, Skipper>>
+struct ObjParserSelectedActions : public Common
+{
+  ObjParserSelectedActions()
+  {
+    using phoenix::bind;
+    using phoenix::push_back;
+    using phoenix::size;
+    using qi::_1;
+    using qi::_r1;
+    using qi::_val;
+    using qi::blank;
+    using qi::char_;
+    using qi::eoi;
+    using qi::eol;
+    using qi::lit;
+    using qi::no_skip;
+
+    auto _positions = bind(&Data::positions, _r1);
+    auto _normals   = bind(&Data::normals, _r1);
+    auto _texCoords = bind(&Data::texCoords, _r1);
+    auto _corners   = bind(&Data::faceCorners, _r1);
+    auto _offsets   = bind(&Data::faceOffsets, _r1);
+
+    // clang-format off
+    skippedLine = &(blank | eol | eoi) >> *(char_ - eol) >> (eol | eoi);
+
+    if constexpr (Data::POSITIONS)
+    {
+      positionLine = Common::position[push_back(_positions, _1)];
+    }
+    else
+    {
+      positionLine = no_skip[skippedLine] | Common::position;
+    }
+
+    if constexpr (Data::NORMALS)
+    {
+      normalLine = Common::normal[push_back(_normals, _1)];
+    }
+    else
+    {
+      normalLine = no_skip[skippedLine] | Common::normal;
+    }
+
+    if constexpr (Data::TEX_COORDS)
+    {
+      texCoordLine = Common::texCoord[push_back(_texCoords, _1)];
+    }
+    else
+    {
+      texCoordLine = no_skip[skippedLine] | Common::texCoord;
+    }
+
+    if constexpr (Data::FACES)
+    {
+      faceLine = (+Common::faceCorner[push_back(_corners, _1)]
+          >> Common::lineEnd)
+                            [push_back(_offsets, size(_corners))];
+    }
+    else
+    {
+      faceLine = no_skip[skippedLine] | Common::face;
+    }
+
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> normalLine(_val)
+        | no_skip['t'] >> texCoordLine(_val)
+        | positionLine(_val)
+      )
+      | lit('f') >> faceLine(_val)
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
+  }
+
+  qi::rule<Iterator, void(Data&), Skipper> positionLine;
+  qi::rule<Iterator, void(Data&), Skipper> normalLine;
+  qi::rule<Iterator, void(Data&), Skipper> texCoordLine;
+  qi::rule<Iterator, void(Data&), Skipper> faceLine;
+  qi::rule<Iterator> skippedLine;
+};
+
+//------------------------------------------------------------------------------
+// Grammars keep no state between parses, so each thread builds every grammar
+// type it uses once and then reuses it. Building one allocates an object for
+// every rule, which would otherwise dominate the cost of parsing small inputs.
+template <typename Grammar>
+const Grammar&
+threadLocalGrammar()
+{
+  thread_local const Grammar grammar;
+  return grammar;
+}
+
+//------------------------------------------------------------------------------
+// Parses without logging so that it may run on worker threads.
+// Returns nullptr on success, otherwise a description of the failure with
+// first left at the position where parsing stopped.
+template <typename Parser, typename Data, typename Iterator>
+const char*
+tryParseObj(const Parser& parser, Iterator& first, Iterator last, Data& data)
+{
+  const auto& skipper = threadLocalGrammar<SkipParser<Iterator>>();
+
+  try
+  {
+    if (!qi::phrase_parse(first, last, parser, skipper, data))
+    {
+      return "parse failed";
+    }
+    if (first != last)
+    {
+      return "unparsed";
+    }
+    return nullptr;
+  }
+  catch (const qi::expectation_failure<Iterator>&)
+  {
+    return "parse exception";
+  }
+  catch (...)
+  {
+    return "misc exception";
+  }
+}
+
+//------------------------------------------------------------------------------
+// The grammars have no use for a line index
+template <typename Parser, typename Data, typename Iterator>
+const char*
+tryParseObj(
+  const Parser& parser,
+  Iterator& first,
+  Iterator last,
+  Data& data,
+  const LineIndex*)
+{
+  return tryParseObj(parser, first, last, data);
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data, typename Iterator>
+const char*
+tryParseObj(
+  Iterator& first, Iterator last, Data& data, const LineIndex* index = nullptr)
+{
+  return tryParseObj(threadLocalGrammar<Parser>(), first, last, data, index);
+}
+
+//------------------------------------------------------------------------------
+inline bool
+isBlank(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+//------------------------------------------------------------------------------
+// Names the element a failed line was meant to be, going by its keyword
+template <typename Iterator>
+ElementKind
+classifyElement(Iterator it, Iterator last)
+{
+  auto endsKeyword = [&](Iterator c) {
+    return c == last || isBlank(*c) || *c == '\r' || *c == '\n';
+  };
+
+  if (it == last)
+  {
+    return ElementKind::Any;
+  }
+  const char keyword = *it++;
+  if (keyword == 'f')
+  {
+    return endsKeyword(it) ? ElementKind::Face : ElementKind::Any;
+  }
+  if (keyword != 'v')
+  {
+    return ElementKind::Any;
+  }
+  if (endsKeyword(it))
+  {
+    return ElementKind::Position;
+  }
+
+  const char suffix = *it++;
+  if (!endsKeyword(it))
+  {
+    return ElementKind::Any;
+  }
+  return (suffix == 'n') ? ElementKind::Normal
+         : (suffix == 't') ? ElementKind::TexCoord
+                           : ElementKind::Any;
+}
+
+//------------------------------------------------------------------------------
+// Describes a failure at position failure of [begin, last). The line and
+// column are found by walking the input once from begin.
+template <typename Iterator>
+ParseError
+locateFailure(
+  Iterator begin, Iterator failure, Iterator last, const char* message)
+{
+  ParseError error;
+  error.message = message;
+  error.line    = 1;
+  error.column  = 1;
+  for (; begin != failure; ++begin, ++error.offset)
+  {
+    if (*begin == '\n')
+    {
+      ++error.line;
+      error.column = 1;
+    }
+    else
+    {
+      ++error.column;
+    }
+  }
+
+  error.expected = classifyElement(failure, last);
+
+  size_t length = 0;
+  for (; failure != last && length < ParseError::MAX_SNIPPET; ++failure)
+  {
+    if (*failure == '\n' || *failure == '\r')
+    {
+      break;
+    }
+    error.snippet[length++] = *failure;
+  }
+  error.snippet[length] = '\0';
+  return error;
+}
+
+//------------------------------------------------------------------------------
+inline void
+reportFailure(const ParseError& failure, ParseError* error)
+{
+  LOG_ERROR(
+    "%s at line %zu, column %zu (expected %s): %s",
+    failure.message,
+    failure.line,
+    failure.column,
+    toString(failure.expected),
+    failure.snippet);
+  if (error)
+  {
+    *error = failure;
+  }
+}
+
+//------------------------------------------------------------------------------
+// For failures that have no position in the input
+inline void
+reportFileFailure(const char* message, ParseError* error)
+{
+  LOG_ERROR("%s", message);
+  if (error)
+  {
+    *error         = ParseError();
+    error->message = message;
+  }
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+void
+countSkippedLine(Iterator it, Iterator last, ParseDiagnostics& diagnostics)
+{
+  if (classifyElement(it, last) != ElementKind::Any)
+  {
+    ++diagnostics.malformed;
+    return;
+  }
+
+  char keyword[2];
+  size_t length = 0;
+  for (; it != last && !isBlank(*it) && *it != '\r' && *it != '\n'; ++it)
+  {
+    if (length == sizeof(keyword))
+    {
+      ++diagnostics.unknown;
+      return;
+    }
+    keyword[length++] = *it;
+  }
+
+  const std::string_view token(keyword, length);
+  size_t& counter = (token == "vp")  ? diagnostics.parameterVertices
+                    : (token == "o") ? diagnostics.objects
+                    : (token == "g") ? diagnostics.groups
+                    : (token == "s") ? diagnostics.smoothingGroups
+                    : (token == "l") ? diagnostics.polylines
+                    : (token == "p") ? diagnostics.points
+                                     : diagnostics.unknown;
+  ++counter;
+}
+
+//------------------------------------------------------------------------------
+// The flat layouts append face corners as they are parsed, so a face line that
+// fails part way leaves corners past the last face offset
+template <typename Data>
+void
+discardPartialFace(Data&)
+{
+}
+
+inline void
+discardPartialFace(ObjFlatAggregate& data)
+{
+  data.faceCorners.resize(data.faceOffsets.back());
+}
+
+inline void
+discardPartialFace(ObjSoaAggregate& data)
+{
+  data.faceCorners.resize(data.faceOffsets.back());
+}
+
+template <Attributes MASK>
+void
+discardPartialFace(ObjSelectedAggregate<MASK>& data)
+{
+  data.faceCorners.resize(data.faceOffsets.back());
+}
+
+inline void
+discardPartialFace(ObjResolvedAggregate& data)
+{
+  data.faceCorners.resize(data.faceOffsets.back());
+}
+
+//------------------------------------------------------------------------------
+// Lenient tryParseObj: wherever parsing stops short of last, the rest of that
+// line is counted in diagnostics and skipped, and parsing resumes on the next
+// line. firstSkipped is set to the first position skipped from. Exceptions
+// are still failures.
+template <typename Parser, typename Data, typename Iterator>
+const char*
+tryParseObjLenient(
+  Iterator& first,
+  Iterator last,
+  Data& data,
+  ParseDiagnostics& diagnostics,
+  Iterator& firstSkipped,
+  const LineIndex* index = nullptr)
+{
+  bool skipped = false;
+  for (;;)
+  {
+    const char* failure = tryParseObj<Parser>(first, last, data, index);
+    if (!failure || std::strcmp(failure, "unparsed") != 0)
+    {
+      return failure;
+    }
+
+    if (!skipped)
+    {
+      firstSkipped = first;
+      skipped      = true;
+    }
+    countSkippedLine(first, last, diagnostics);
+    discardPartialFace(data);
+    while (first != last && *first != '\n' && *first != '\r')
+    {
+      ++first;
+    }
+    if (first != last && *first++ == '\r' && first != last && *first == '\n')
+    {
+      ++first;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+inline void
+reportSkipped(const ParseDiagnostics& diagnostics, ParseDiagnostics* result)
+{
+  if (diagnostics.skippedLines() != 0)
+  {
+    LOG_WARNING(
+      "Skipped %zu lines, the first at line %zu: %s",
+      diagnostics.skippedLines(),
+      diagnostics.firstSkipped.line,
+      diagnostics.firstSkipped.snippet);
+  }
+  if (result)
+  {
+    *result = diagnostics;
+  }
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data, typename Iterator>
+bool
+parseObj(
+  Iterator first,
+  Iterator last,
+  Data& data,
+  const ParseOptions& options,
+  const LineIndex* index = nullptr)
+{
+  const Iterator begin = first;
+  const char* failure  = nullptr;
+  if (options.lenient)
+  {
+    ParseDiagnostics diagnostics;
+    Iterator firstSkipped = first;
+    failure               = tryParseObjLenient<Parser>(
+      first, last, data, diagnostics, firstSkipped, index);
+    if (!failure && diagnostics.skippedLines() != 0)
+    {
+      diagnostics.firstSkipped
+        = locateFailure(begin, firstSkipped, last, "skipped");
+    }
+    reportSkipped(diagnostics, options.diagnostics);
+  }
+  else
+  {
+    failure = tryParseObj<Parser>(first, last, data, index);
+  }
+
+  if (failure)
+  {
+    reportFailure(locateFailure(begin, first, last, failure), options.error);
+    return false;
+  }
+  return true;
+}
+
 //------------------------------------------------------------------------------
 template <typename Parser, typename Data, typename Iterator>
 bool
-parseObj(Iterator first, Iterator last, Data& data)
+parseObj(Iterator first, Iterator last, Data& data, ParseError* error = nullptr)
+{
+  ParseOptions options;
+  options.error = error;
+  return parseObj<Parser>(first, last, data, options);
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data, typename Iterator>
+std::optional<Data>
+parseImpl(Iterator& begin, Iterator& end, const ParseOptions& options)
+{
+  Data data;
+  if (parseObj<Parser>(begin, end, data, options))
+  {
+    return data;
+  }
+  return std::nullopt;
+}
+
+//------------------------------------------------------------------------------
+// Number of blank separated tokens before eol or a comment. Line end
+// characters also count as blanks, so eol may be the start of the next line.
+inline size_t
+countTokens(const char* c, const char* eol)
+{
+  size_t tokens = 0;
+  bool inToken  = false;
+  for (; c != eol && *c != '#'; ++c)
+  {
+    const bool separator = isBlank(*c) || *c == '\r' || *c == '\n';
+    tokens += (!separator && !inToken) ? 1 : 0;
+    inToken = !separator;
+  }
+  return tokens;
+}
+
+//------------------------------------------------------------------------------
+// Classifies each line by its keyword without parsing any numbers. The result
+// is only used to size allocations, so malformed lines need no special care.
+inline ObjCounts
+countElements(const char* begin, const char* end)
+{
+  ObjCounts counts;
+  const char* line = begin;
+  while (line < end)
+  {
+    const char* eol
+      = static_cast<const char*>(std::memchr(line, '\n', end - line));
+    if (!eol)
+    {
+      eol = end;
+    }
+
+    const char* c = line;
+    while (c != eol && isBlank(*c))
+    {
+      ++c;
+    }
+    if (eol - c >= 2)
+    {
+      if (c[0] == 'v')
+      {
+        if (isBlank(c[1]))
+        {
+          ++counts.positions;
+        }
+        else if (eol - c >= 3 && isBlank(c[2]))
+        {
+          counts.normals += (c[1] == 'n') ? 1 : 0;
+          counts.texCoords += (c[1] == 't') ? 1 : 0;
+        }
+      }
+      else if (c[0] == 'f' && isBlank(c[1]))
+      {
+        ++counts.faces;
+        counts.faceCorners += countTokens(c + 1, eol);
+      }
+    }
+
+    line = eol + 1;
+  }
+  return counts;
+}
+
+//------------------------------------------------------------------------------
+// countElements() for lines [firstLine, lastLine) of an index, where only the
+// face lines need to be read
+inline ObjCounts
+countElements(const LineIndex& index, size_t firstLine, size_t lastLine)
+{
+  ObjCounts counts;
+  for (size_t i = firstLine; i < lastLine; ++i)
+  {
+    switch (index.type(i))
+    {
+    case LineType::Position: ++counts.positions; break;
+    case LineType::Normal: ++counts.normals; break;
+    case LineType::TexCoord: ++counts.texCoords; break;
+    case LineType::Face:
+      ++counts.faces;
+      counts.faceCorners += countTokens(index.line(i) + 1, index.next(i));
+      break;
+    default: break;
+    }
+  }
+  return counts;
+}
+
+//------------------------------------------------------------------------------
+inline void
+reserveCapacity(ObjVariantVec& data, const ObjCounts& counts)
+{
+  data.reserve(
+    counts.positions + counts.normals + counts.texCoords + counts.faces);
+}
+
+//------------------------------------------------------------------------------
+inline void
+reserveCapacity(ObjAggregate& data, const ObjCounts& counts)
+{
+  data.positions.reserve(counts.positions);
+  data.normals.reserve(counts.normals);
+  data.texCoords.reserve(counts.texCoords);
+  data.faces.reserve(counts.faces);
+}
+
+//------------------------------------------------------------------------------
+inline void
+reserveCapacity(ObjFlatAggregate& data, const ObjCounts& counts)
 {
-  Parser parser;
-  SkipParser<Iterator> skipper;
+  data.positions.reserve(counts.positions);
+  data.normals.reserve(counts.normals);
+  data.texCoords.reserve(counts.texCoords);
+  data.faceCorners.reserve(counts.faceCorners);
+  data.faceOffsets.reserve(counts.faces + 1);
+}
 
-  try
+//------------------------------------------------------------------------------
+// The optional w array is left alone as most files never need it
+inline void
+reserveCapacity(ObjSoaAggregate& data, const ObjCounts& counts)
+{
+  data.positions.x.reserve(counts.positions);
+  data.positions.y.reserve(counts.positions);
+  data.positions.z.reserve(counts.positions);
+  data.normals.i.reserve(counts.normals);
+  data.normals.j.reserve(counts.normals);
+  data.normals.k.reserve(counts.normals);
+  data.texCoords.u.reserve(counts.texCoords);
+  data.texCoords.v.reserve(counts.texCoords);
+  data.texCoords.w.reserve(counts.texCoords);
+  data.faceCorners.reserve(counts.faceCorners);
+  data.faceOffsets.reserve(counts.faces + 1);
+}
+
+//------------------------------------------------------------------------------
+inline void
+reserveCapacity(ObjResolvedAggregate& data, const ObjCounts& counts)
+{
+  data.positions.reserve(counts.positions);
+  data.normals.reserve(counts.normals);
+  data.texCoords.reserve(counts.texCoords);
+  data.faceCorners.reserve(counts.faceCorners);
+  data.faceOffsets.reserve(counts.faces + 1);
+}
+
+//------------------------------------------------------------------------------
+// Only the arrays that will be filled
+template <Attributes MASK>
+void
+reserveCapacity(ObjSelectedAggregate<MASK>& data, const ObjCounts& counts)
+{
+  using Data = ObjSelectedAggregate<MASK>;
+  data.positions.reserve(Data::POSITIONS ? counts.positions : 0);
+  data.normals.reserve(Data::NORMALS ? counts.normals : 0);
+  data.texCoords.reserve(Data::TEX_COORDS ? counts.texCoords : 0);
+  data.faceCorners.reserve(Data::FACES ? counts.faceCorners : 0);
+  data.faceOffsets.reserve(Data::FACES ? counts.faces + 1 : 0);
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser>
+struct UniformParser;
+
+template <typename Parser>
+constexpr bool IS_UNIFORM_PARSER = false;
+
+template <typename Parser>
+constexpr bool IS_UNIFORM_PARSER<UniformParser<Parser>> = true;
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data>
+std::optional<Data>
+parseBufferImpl(const char* begin, const char* end, const ParseOptions& options)
+{
+  if constexpr (!IS_UNIFORM_PARSER<Parser>)
   {
-    using boost::spirit::qi::space;
-    if (!qi::phrase_parse(first, last, parser, skipper, data))
-    {
-      LOG_ERROR("parse failed: %s", std::string(first, last).c_str());
-      return false;
-    }
-    if (first != last)
+    if (options.uniform)
     {
-      LOG_ERROR("unparsed: %s", std::string(first, last).c_str());
-      return false;
+      return parseBufferImpl<UniformParser<Parser>, Data>(begin, end, options);
     }
-    return true;
   }
-  catch (const qi::expectation_failure<Iterator>& e)
+
+  Data data;
+  std::optional<LineIndex> index;
+  if (options.lineIndex)
   {
-    LOG_ERROR(
-      "parse exception: %s %s", e.what(), std::string(first, last).c_str());
+    index = buildLineIndex(begin, end);
   }
-  catch (...)
+  if (options.presize)
   {
-    LOG_ERROR("misc exception");
+    reserveCapacity(
+      data,
+      index ? countElements(*index, 0, index->size())
+            : countElements(begin, end));
   }
-
-  return false;
-}
-
-//------------------------------------------------------------------------------
-template <typename Parser, typename Data, typename Iterator>
-std::optional<Data>
-parseImpl(Iterator& begin, Iterator& end)
-{
-  Data data;
-  if (parseObj<Parser>(begin, end, data))
+  if (parseObj<Parser>(begin, end, data, options, index ? &*index : nullptr))
   {
     return data;
   }
@@ -325,12 +1711,12 @@ parseImpl(Iterator& begin, Iterator& end)
 //------------------------------------------------------------------------------
 template <typename Parser, typename Data, typename Iterator>
 std::optional<Data>
-loadAndParseImpl(const std::string& filename)
+loadAndParseImpl(const std::string& filename, const ParseOptions& options)
 {
   std::ifstream in(filename, std::ios::binary);
   if (!in.is_open())
   {
-    LOG_ERROR("File open failed");
+    reportFileFailure("File open failed", options.error);
     return std::nullopt;
   }
   in.unsetf(std::ios::skipws);
@@ -338,12 +1724,497 @@ loadAndParseImpl(const std::string& filename)
   Iterator begin(in);
   Iterator end;
 
-  return parseImpl<Parser, Data, Iterator>(begin, end);
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data>
+std::optional<Data>
+loadAndParseMappedImpl(const std::string& filename, const LoadOptions& options)
+{
+  MappedFile file(filename);
+  if (!file.isOpen())
+  {
+    reportFileFailure("File open failed", options.error);
+    return std::nullopt;
+  }
+
+  return parseBufferImpl<Parser, Data>(file.begin(), file.end(), options);
+}
+
+//------------------------------------------------------------------------------
+// Splits [begin, end) into at most chunkCount ranges which all start at the
+// beginning of a line, so that no element straddles two ranges
+inline std::vector<std::pair<const char*, const char*>>
+splitAtLines(const char* begin, const char* end, size_t chunkCount)
+{
+  std::vector<std::pair<const char*, const char*>> chunks;
+  const size_t size      = end - begin;
+  const char* chunkBegin = begin;
+  for (size_t i = 1; i <= chunkCount && chunkBegin != end; ++i)
+  {
+    const char* chunkEnd = end;
+    if (i < chunkCount)
+    {
+      chunkEnd = std::max(chunkBegin, begin + (size * i / chunkCount));
+      chunkEnd = std::find(chunkEnd, end, '\n');
+      if (chunkEnd != end)
+      {
+        ++chunkEnd;
+      }
+    }
+    chunks.emplace_back(chunkBegin, chunkEnd);
+    chunkBegin = chunkEnd;
+  }
+  return chunks;
+}
+
+//------------------------------------------------------------------------------
+// splitAtLines() with the boundaries taken from a line index. Chunks start at
+// the first non-blank character of a line; the blanks before it end the
+// previous chunk.
+inline std::vector<std::pair<const char*, const char*>>
+splitAtLines(const LineIndex& index, size_t chunkCount)
+{
+  std::vector<std::pair<const char*, const char*>> chunks;
+  const size_t size      = index.end - index.begin;
+  const char* chunkBegin = index.begin;
+  for (size_t i = 1; i <= chunkCount && chunkBegin != index.end; ++i)
+  {
+    const char* chunkEnd = index.end;
+    if (i < chunkCount)
+    {
+      const size_t line = index.find(
+        std::max(chunkBegin + 1, index.begin + (size * i / chunkCount)));
+      chunkEnd = (line < index.size()) ? index.line(line) : index.end;
+    }
+    chunks.emplace_back(chunkBegin, chunkEnd);
+    chunkBegin = chunkEnd;
+  }
+  return chunks;
+}
+
+//------------------------------------------------------------------------------
+// Moves one array of every chunk into its slice of the concatenated output.
+// The slice offsets are the exclusive prefix sums of the preceding chunk sizes.
+template <typename Data, typename Select>
+void
+mergeChunkArray(
+  std::vector<Data>& chunks, Data& result, unsigned threadCount, Select select)
+{
+  std::vector<size_t> offsets(chunks.size() + 1, 0);
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    offsets[i + 1] = offsets[i] + select(chunks[i]).size();
+  }
+
+  auto& dst = select(result);
+  dst.resize(offsets.back());
+  parallelFor(chunks.size(), threadCount, [&](size_t i) {
+    auto& src = select(chunks[i]);
+    std::move(src.begin(), src.end(), dst.begin() + offsets[i]);
+    src = std::decay_t<decltype(src)>();
+  });
+}
+
+//------------------------------------------------------------------------------
+// Corner offsets of each chunk are rebased on the number of corners in all
+// preceding chunks
+template <typename Data>
+void
+mergeChunkFaces(std::vector<Data>& chunks, Data& result, unsigned threadCount)
+{
+  std::vector<size_t> faceBase(chunks.size() + 1, 0);
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    faceBase[i + 1] = faceBase[i] + chunks[i].faceCount();
+  }
+  std::vector<size_t> cornerBase(chunks.size(), 0);
+  for (size_t i = 1; i < chunks.size(); ++i)
+  {
+    cornerBase[i] = cornerBase[i - 1] + chunks[i - 1].faceCorners.size();
+  }
+
+  result.faceOffsets.resize(faceBase.back() + 1);
+  parallelFor(chunks.size(), threadCount, [&](size_t i) {
+    const auto& src = chunks[i].faceOffsets;
+    std::transform(
+      src.begin() + 1,
+      src.end(),
+      result.faceOffsets.begin() + faceBase[i] + 1,
+      [&](size_t offset) { return offset + cornerBase[i]; });
+  });
+
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.faceCorners; });
+  // clang-format on
+}
+
+//------------------------------------------------------------------------------
+inline void
+mergeChunks(
+  std::vector<ObjAggregate>& chunks, ObjAggregate& result, unsigned threadCount)
+{
+  using Data = ObjAggregate;
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.faces; });
+  // clang-format on
+}
+
+//------------------------------------------------------------------------------
+inline void
+mergeChunks(
+  std::vector<ObjFlatAggregate>& chunks,
+  ObjFlatAggregate& result,
+  unsigned threadCount)
+{
+  using Data = ObjFlatAggregate;
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords; });
+  // clang-format on
+  mergeChunkFaces(chunks, result, threadCount);
+}
+
+//------------------------------------------------------------------------------
+// The optional w array is materialised for every chunk as soon as any one of
+// them has it, so that the merged array lines up with x, y and z
+inline void
+mergeChunks(
+  std::vector<ObjSoaAggregate>& chunks,
+  ObjSoaAggregate& result,
+  unsigned threadCount)
+{
+  using Data = ObjSoaAggregate;
+
+  const bool hasW = std::any_of(chunks.begin(), chunks.end(), [](Data& d) {
+    return d.positions.hasW();
+  });
+  if (hasW)
+  {
+    for (auto& chunk : chunks)
+    {
+      chunk.positions.w.resize(chunk.positions.size(), 1.0f);
+    }
+  }
+
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions.x; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions.y; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions.z; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions.w; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals.i; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals.j; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals.k; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords.u; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords.v; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords.w; });
+  // clang-format on
+  mergeChunkFaces(chunks, result, threadCount);
+}
+
+//------------------------------------------------------------------------------
+template <Attributes MASK>
+void
+mergeChunks(
+  std::vector<ObjSelectedAggregate<MASK>>& chunks,
+  ObjSelectedAggregate<MASK>& result,
+  unsigned threadCount)
+{
+  using Data = ObjSelectedAggregate<MASK>;
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords; });
+  // clang-format on
+  mergeChunkFaces(chunks, result, threadCount);
+}
+
+//------------------------------------------------------------------------------
+inline void
+mergeChunks(
+  std::vector<ObjResolvedAggregate>& chunks,
+  ObjResolvedAggregate& result,
+  unsigned threadCount)
+{
+  using Data = ObjResolvedAggregate;
+  // clang-format off
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.positions; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.normals; });
+  mergeChunkArray(chunks, result, threadCount,
+    [](Data& d) -> auto& { return d.texCoords; });
+  // clang-format on
+  mergeChunkFaces(chunks, result, threadCount);
+}
+
+//------------------------------------------------------------------------------
+// Relative indices in a chunk refer back across the chunks before it, so an
+// ObjResolvedAggregate chunk is told how many elements precede it. The counts
+// come from countElements(), which a line the grammar reads differently can
+// throw off; see precedingCountsMatch().
+template <typename Data>
+constexpr bool NEEDS_PRECEDING_COUNTS
+  = std::is_same_v<Data, ObjResolvedAggregate>;
+
+template <typename Data>
+void
+setPrecedingCounts(
+  std::vector<Data>& chunks, const std::vector<ObjCounts>& counts)
+{
+  if constexpr (NEEDS_PRECEDING_COUNTS<Data>)
+  {
+    for (size_t i = 1; i < chunks.size(); ++i)
+    {
+      ObjCounts& preceding = chunks[i].preceding;
+      preceding            = chunks[i - 1].preceding;
+      preceding.positions += counts[i - 1].positions;
+      preceding.normals += counts[i - 1].normals;
+      preceding.texCoords += counts[i - 1].texCoords;
+    }
+  }
+}
+
+// Whether every chunk but the last parsed as many elements as were counted
+template <typename Data>
+bool
+precedingCountsMatch(
+  const std::vector<Data>& chunks, const std::vector<ObjCounts>& counts)
+{
+  if constexpr (NEEDS_PRECEDING_COUNTS<Data>)
+  {
+    for (size_t i = 0; i + 1 < chunks.size(); ++i)
+    {
+      if (
+        chunks[i].positions.size() != counts[i].positions
+        || chunks[i].normals.size() != counts[i].normals
+        || chunks[i].texCoords.size() != counts[i].texCoords)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Each chunk is parsed by its own parser instance into its own Data, which
+// are then concatenated in file order. Face indices are absolute in the file
+// so they are copied through untouched and the result matches a serial parse.
+// Resolved relative indices are too, as long as the counts of the elements
+// preceding each chunk are right; if they turn out not to be, the whole
+// buffer is parsed again serially.
+template <typename Parser, typename Data>
+std::optional<Data>
+parseParallelImpl(
+  const char* begin, const char* end, const ParseOptions& options)
+{
+  const size_t minChunkSize = std::max<size_t>(1, options.minChunkSize);
+  const size_t maxChunks = std::max<size_t>(1, (end - begin) / minChunkSize);
+  const unsigned threadCount = static_cast<unsigned>(
+    std::min<size_t>(resolveThreadCount(options.threadCount), maxChunks));
+  if (threadCount <= 1)
+  {
+    return parseBufferImpl<Parser, Data>(begin, end, options);
+  }
+  if constexpr (!IS_UNIFORM_PARSER<Parser>)
+  {
+    if (options.uniform)
+    {
+      return parseParallelImpl<UniformParser<Parser>, Data>(
+        begin, end, options);
+    }
+  }
+
+  std::optional<LineIndex> index;
+  if (options.lineIndex)
+  {
+    index = buildLineIndex(begin, end);
+  }
+  const LineIndex* lines = index ? &*index : nullptr;
+
+  const auto ranges = lines ? splitAtLines(*lines, threadCount)
+                            : splitAtLines(begin, end, threadCount);
+  std::vector<Data> chunks(ranges.size());
+  std::vector<ObjCounts> counts(ranges.size());
+  std::vector<const char*> failures(ranges.size(), nullptr);
+  std::vector<const char*> failurePositions(ranges.size(), nullptr);
+  std::vector<ParseDiagnostics> diagnostics(ranges.size());
+  std::vector<const char*> firstSkipped(ranges.size(), nullptr);
+
+  if (options.presize || (NEEDS_PRECEDING_COUNTS<Data> && ranges.size() > 1))
+  {
+    parallelFor(ranges.size(), threadCount, [&](size_t i) {
+      const char* first = ranges[i].first;
+      const char* last  = ranges[i].second;
+      counts[i]
+        = lines ? countElements(*lines, lines->find(first), lines->find(last))
+                : countElements(first, last);
+    });
+    setPrecedingCounts(chunks, counts);
+  }
+
+  parallelFor(ranges.size(), threadCount, [&](size_t i) {
+    const char* first = ranges[i].first;
+    const char* last  = ranges[i].second;
+    if (options.presize)
+    {
+      reserveCapacity(chunks[i], counts[i]);
+    }
+    failures[i]
+      = options.lenient
+          ? tryParseObjLenient<Parser>(
+            first, last, chunks[i], diagnostics[i], firstSkipped[i], lines)
+          : tryParseObj<Parser>(first, last, chunks[i], lines);
+    failurePositions[i] = first;
+  });
+
+  if (!precedingCountsMatch(chunks, counts))
+  {
+    return parseBufferImpl<Parser, Data>(begin, end, options);
+  }
+
+  for (size_t i = 0; i < ranges.size(); ++i)
+  {
+    if (failures[i])
+    {
+      reportFailure(
+        locateFailure(begin, failurePositions[i], end, failures[i]),
+        options.error);
+      return std::nullopt;
+    }
+  }
+
+  if (options.lenient)
+  {
+    ParseDiagnostics total;
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      if (firstSkipped[i] && total.skippedLines() == 0)
+      {
+        total.firstSkipped
+          = locateFailure(begin, firstSkipped[i], end, "skipped");
+      }
+      total += diagnostics[i];
+    }
+    reportSkipped(total, options.diagnostics);
+  }
+
+  Data data;
+  mergeChunks(chunks, data, threadCount);
+  return data;
+}
+
+//------------------------------------------------------------------------------
+template <typename Parser, typename Data>
+std::optional<Data>
+loadAndParseParallelImpl(
+  const std::string& filename, const LoadOptions& options)
+{
+  MappedFile file(filename);
+  if (!file.isOpen())
+  {
+    reportFileFailure("File open failed", options.error);
+    return std::nullopt;
+  }
+
+  return parseParallelImpl<Parser, Data>(file.begin(), file.end(), options);
 }
 
+//------------------------------------------------------------------------------
+// Grammars behind the library interface. Defining OBJPARSER_USE_X3 swaps the
+// Spirit X3 grammar from ObjParserX3.h in for all of them.
+#ifdef OBJPARSER_USE_X3
+template <typename Data, typename Iterator>
+struct X3Grammar;
+
+template <typename Data, typename Iterator>
+using VariantGrammar = X3Grammar<Data, Iterator>;
+template <typename Data, typename Iterator>
+using AggregateGrammar = X3Grammar<Data, Iterator>;
+template <typename Data, typename Iterator>
+using FlatAggregateGrammar = X3Grammar<Data, Iterator>;
+template <typename Data, typename Iterator>
+using SoaAggregateGrammar = X3Grammar<Data, Iterator>;
+template <typename Data, typename Iterator>
+using ResolvedAggregateGrammar = X3Grammar<Data, Iterator>;
+template <typename Data, typename Iterator>
+using SelectedAggregateGrammar = X3Grammar<Data, Iterator>;
+#else
+template <typename Data, typename Iterator>
+using VariantGrammar = ObjParserVariant<Data, Iterator>;
+template <typename Data, typename Iterator>
+using AggregateGrammar = ObjParserSemanticActions<Data, Iterator>;
+template <typename Data, typename Iterator>
+using FlatAggregateGrammar = ObjParserFlatActions<Data, Iterator>;
+template <typename Data, typename Iterator>
+using SoaAggregateGrammar = ObjParserSoaActions<Data, Iterator>;
+template <typename Data, typename Iterator>
+using ResolvedAggregateGrammar = ObjParserResolvedActions<Data, Iterator>;
+template <typename Data, typename Iterator>
+using SelectedAggregateGrammar = ObjParserSelectedActions<Data, Iterator>;
+#endif
+
+//------------------------------------------------------------------------------
+// Backend policies for parseAsAggregate and loadAsAggregate. SpiritBackend
+// parses with the grammars above. ScannerBackend uses the hand-written scanner
+// from ObjScanner.h, which needs a contiguous const char* buffer; any other
+// input, such as a stream, is still parsed by the grammar.
+struct ObjScanner;
+
+struct SpiritBackend
+{
+  template <typename Data, typename Iterator>
+  using Grammar = std::conditional_t<
+    IS_SELECTED_AGGREGATE<Data>,
+    SelectedAggregateGrammar<Data, Iterator>,
+    AggregateGrammar<Data, Iterator>>;
+};
+
+struct ScannerBackend
+{
+  template <typename Data, typename Iterator>
+  using Grammar = std::conditional_t<
+    std::is_same_v<Iterator, const char*>,
+    ObjScanner,
+    SpiritBackend::Grammar<Data, Iterator>>;
+};
+
 //------------------------------------------------------------------------------
 }    // namespace ObjParser
 
+#ifdef OBJPARSER_USE_X3
+# include "ObjParserX3.h"
+#endif
+#include "ObjScanner.h"
+#include "UniformParser.h"
+
 //------------------------------------------------------------------------------
 // Library Interface
 //------------------------------------------------------------------------------
@@ -352,45 +2223,209 @@ namespace ObjParser
 //------------------------------------------------------------------------------
 template <typename Iterator>
 std::optional<ObjParser::ObjVariantVec>
-parseAsVariant(Iterator begin, Iterator end)
+parseAsVariant(Iterator begin, Iterator end, ParseError* error = nullptr)
 {
   using Data   = ObjVariantVec;
-  using Parser = ObjParser::ObjParserVariant<Data, Iterator>;
+  using Parser = VariantGrammar<Data, Iterator>;
+
+  ParseOptions options;
+  options.error = error;
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+// MASK chooses the elements to keep, e.g.
+//   parseAsAggregate<SpiritBackend, Attributes::Positions | Attributes::Faces>
+// returns an ObjSelectedAggregate with positions and vertex indices only; see
+// ObjParserSelectedActions for how the other lines are skipped.
+template <
+  typename Backend = SpiritBackend,
+  Attributes MASK  = Attributes::All,
+  typename Iterator>
+std::optional<SelectedAggregate<MASK>>
+parseAsAggregate(Iterator begin, Iterator end, ParseError* error = nullptr)
+{
+  using Data   = SelectedAggregate<MASK>;
+  using Parser = typename Backend::template Grammar<Data, Iterator>;
+
+  ParseOptions options;
+  options.error = error;
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+// Multi-threaded parse of a contiguous buffer (see ParseOptions::threadCount)
+template <typename Backend = SpiritBackend, Attributes MASK = Attributes::All>
+std::optional<SelectedAggregate<MASK>>
+parseAsAggregate(
+  const char* begin, const char* end, const ParseOptions& options)
+{
+  using Data   = SelectedAggregate<MASK>;
+  using Parser = typename Backend::template Grammar<Data, const char*>;
 
-  return parseImpl<Parser, Data, Iterator>(begin, end);
+  return parseParallelImpl<Parser, Data>(begin, end, options);
 }
 
 //------------------------------------------------------------------------------
 template <typename Iterator>
-std::optional<ObjParser::ObjAggregate>
-parseAsAggregate(Iterator begin, Iterator end)
+std::optional<ObjParser::ObjFlatAggregate>
+parseAsFlatAggregate(Iterator begin, Iterator end, ParseError* error = nullptr)
 {
-  using Data   = ObjAggregate;
-  using Parser = ObjParser::ObjParserSemanticActions<Data, Iterator>;
+  using Data   = ObjFlatAggregate;
+  using Parser = FlatAggregateGrammar<Data, Iterator>;
 
-  return parseImpl<Parser, Data, Iterator>(begin, end);
+  ParseOptions options;
+  options.error = error;
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
 }
 
 //------------------------------------------------------------------------------
-std::optional<ObjParser::ObjVariantVec>
-loadAsVariant(const std::string& filename)
+inline std::optional<ObjParser::ObjFlatAggregate>
+parseAsFlatAggregate(
+  const char* begin, const char* end, const ParseOptions& options)
+{
+  using Data   = ObjFlatAggregate;
+  using Parser = FlatAggregateGrammar<Data, const char*>;
+
+  return parseParallelImpl<Parser, Data>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+std::optional<ObjParser::ObjSoaAggregate>
+parseAsSoaAggregate(Iterator begin, Iterator end, ParseError* error = nullptr)
+{
+  using Data   = ObjSoaAggregate;
+  using Parser = SoaAggregateGrammar<Data, Iterator>;
+
+  ParseOptions options;
+  options.error = error;
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+inline std::optional<ObjParser::ObjSoaAggregate>
+parseAsSoaAggregate(
+  const char* begin, const char* end, const ParseOptions& options)
+{
+  using Data   = ObjSoaAggregate;
+  using Parser = SoaAggregateGrammar<Data, const char*>;
+
+  return parseParallelImpl<Parser, Data>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+template <typename Iterator>
+std::optional<ObjParser::ObjResolvedAggregate>
+parseAsResolvedAggregate(
+  Iterator begin, Iterator end, ParseError* error = nullptr)
+{
+  using Data   = ObjResolvedAggregate;
+  using Parser = ResolvedAggregateGrammar<Data, Iterator>;
+
+  ParseOptions options;
+  options.error = error;
+  return parseImpl<Parser, Data, Iterator>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+inline std::optional<ObjParser::ObjResolvedAggregate>
+parseAsResolvedAggregate(
+  const char* begin, const char* end, const ParseOptions& options)
+{
+  using Data   = ObjResolvedAggregate;
+  using Parser = ResolvedAggregateGrammar<Data, const char*>;
+
+  return parseParallelImpl<Parser, Data>(begin, end, options);
+}
+
+//------------------------------------------------------------------------------
+inline std::optional<ObjParser::ObjVariantVec>
+loadAsVariant(const std::string& filename, const LoadOptions& options = {})
+{
+  using Data = ObjVariantVec;
+
+  if (options.memoryMap)
+  {
+    using Parser = VariantGrammar<Data, const char*>;
+    return loadAndParseMappedImpl<Parser, Data>(filename, options);
+  }
+
+  using It     = boost::spirit::istream_iterator;
+  using Parser = VariantGrammar<Data, It>;
+  return loadAndParseImpl<Parser, Data, It>(filename, options);
+}
+
+//------------------------------------------------------------------------------
+template <typename Backend = SpiritBackend, Attributes MASK = Attributes::All>
+std::optional<SelectedAggregate<MASK>>
+loadAsAggregate(const std::string& filename, const LoadOptions& options = {})
 {
+  using Data = SelectedAggregate<MASK>;
+
+  if (options.memoryMap)
+  {
+    using Parser = typename Backend::template Grammar<Data, const char*>;
+    return loadAndParseParallelImpl<Parser, Data>(filename, options);
+  }
+
   using It     = boost::spirit::istream_iterator;
-  using Data   = ObjVariantVec;
-  using Parser = ObjParser::ObjParserVariant<Data, It>;
+  using Parser = typename Backend::template Grammar<Data, It>;
+  return loadAndParseImpl<Parser, Data, It>(filename, options);
+}
+
+//------------------------------------------------------------------------------
+inline std::optional<ObjParser::ObjFlatAggregate>
+loadAsFlatAggregate(
+  const std::string& filename, const LoadOptions& options = {})
+{
+  using Data = ObjFlatAggregate;
 
-  return loadAndParseImpl<Parser, Data, It>(filename);
+  if (options.memoryMap)
+  {
+    using Parser = FlatAggregateGrammar<Data, const char*>;
+    return loadAndParseParallelImpl<Parser, Data>(filename, options);
+  }
+
+  using It     = boost::spirit::istream_iterator;
+  using Parser = FlatAggregateGrammar<Data, It>;
+  return loadAndParseImpl<Parser, Data, It>(filename, options);
 }
 
 //------------------------------------------------------------------------------
-std::optional<ObjParser::ObjAggregate>
-loadAsAggregate(const std::string& filename)
+inline std::optional<ObjParser::ObjSoaAggregate>
+loadAsSoaAggregate(
+  const std::string& filename, const LoadOptions& options = {})
 {
+  using Data = ObjSoaAggregate;
+
+  if (options.memoryMap)
+  {
+    using Parser = SoaAggregateGrammar<Data, const char*>;
+    return loadAndParseParallelImpl<Parser, Data>(filename, options);
+  }
+
   using It     = boost::spirit::istream_iterator;
-  using Data   = ObjAggregate;
-  using Parser = ObjParser::ObjParserSemanticActions<Data, It>;
+  using Parser = SoaAggregateGrammar<Data, It>;
+  return loadAndParseImpl<Parser, Data, It>(filename, options);
+}
+
+//------------------------------------------------------------------------------
+inline std::optional<ObjParser::ObjResolvedAggregate>
+loadAsResolvedAggregate(
+  const std::string& filename, const LoadOptions& options = {})
+{
+  using Data = ObjResolvedAggregate;
 
-  return loadAndParseImpl<Parser, Data, It>(filename);
+  if (options.memoryMap)
+  {
+    using Parser = ResolvedAggregateGrammar<Data, const char*>;
+    return loadAndParseParallelImpl<Parser, Data>(filename, options);
+  }
+
+  using It     = boost::spirit::istream_iterator;
+  using Parser = ResolvedAggregateGrammar<Data, It>;
+  return loadAndParseImpl<Parser, Data, It>(filename, options);
 }
 
 //------------------------------------------------------------------------------
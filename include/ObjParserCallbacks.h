@@ -0,0 +1,344 @@
+#pragma once
+
+#include "ObjParser.h"
+
+#include <functional>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+// Push-style parsing
+//
+// Instead of materialising the whole file, every element is handed to a sink
+// as soon as it has been parsed. A sink is any type that provides:
+//
+//   void onPosition(const VertexPosition&);
+//   void onNormal(const VertexNormal&);
+//   void onTexCoord(const VertexTextureCoordinate&);
+//   void onFace(const Face&);
+//   void flush();    // optional, called once parsing has finished
+//
+// Elements arrive in file order. When reading from a stream only one block of
+// the input is held in memory at a time, so memory use does not depend on the
+// size of the file.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+// Types
+//------------------------------------------------------------------------------
+// Sink forwarding each element to a callback. Unset callbacks are ignored.
+struct ObjCallbacks
+{
+  std::function<void(const VertexPosition&)> position;
+  std::function<void(const VertexNormal&)> normal;
+  std::function<void(const VertexTextureCoordinate&)> texCoord;
+  std::function<void(const Face&)> face;
+
+  void onPosition(const VertexPosition& v)
+  {
+    if (position)
+    {
+      position(v);
+    }
+  }
+  void onNormal(const VertexNormal& n)
+  {
+    if (normal)
+    {
+      normal(n);
+    }
+  }
+  void onTexCoord(const VertexTextureCoordinate& uv)
+  {
+    if (texCoord)
+    {
+      texCoord(uv);
+    }
+  }
+  void onFace(const Face& f)
+  {
+    if (face)
+    {
+      face(f);
+    }
+  }
+};
+
+//------------------------------------------------------------------------------
+// Sink collecting elements of each type into batches of up to batchSize,
+// forwarding a batch once it is full and any partial batches on flush()
+struct ObjBatchCallbacks
+{
+  std::function<void(const std::vector<VertexPosition>&)> positions;
+  std::function<void(const std::vector<VertexNormal>&)> normals;
+  std::function<void(const std::vector<VertexTextureCoordinate>&)> texCoords;
+  std::function<void(const std::vector<Face>&)> faces;
+
+  size_t batchSize = 4096;
+
+  void onPosition(const VertexPosition& v) { add(m_positions, v, positions); }
+  void onNormal(const VertexNormal& n) { add(m_normals, n, normals); }
+  void onTexCoord(const VertexTextureCoordinate& uv)
+  {
+    add(m_texCoords, uv, texCoords);
+  }
+  void onFace(const Face& f) { add(m_faces, f, faces); }
+
+  void
+  flush()
+  {
+    send(m_positions, positions);
+    send(m_normals, normals);
+    send(m_texCoords, texCoords);
+    send(m_faces, faces);
+  }
+
+private:
+  template <typename T, typename Callback>
+  void
+  add(std::vector<T>& batch, const T& elem, const Callback& callback)
+  {
+    if (!callback)
+    {
+      return;
+    }
+    batch.push_back(elem);
+    if (batch.size() >= batchSize)
+    {
+      send(batch, callback);
+    }
+  }
+
+  template <typename T, typename Callback>
+  static void
+  send(std::vector<T>& batch, const Callback& callback)
+  {
+    if (!batch.empty())
+    {
+      callback(batch);
+      batch.clear();
+    }
+  }
+
+  std::vector<VertexPosition> m_positions;
+  std::vector<VertexNormal> m_normals;
+  std::vector<VertexTextureCoordinate> m_texCoords;
+  std::vector<Face> m_faces;
+};
+
+//------------------------------------------------------------------------------
+// Implementation
+//------------------------------------------------------------------------------
+static const size_t DEFAULT_STREAM_BLOCK_SIZE = 1 << 20;
+
+//------------------------------------------------------------------------------
+// The grammar attribute: a handle on the user's sink
+template <typename Sink>
+struct SinkRef
+{
+  Sink* sink = nullptr;
+};
+
+//------------------------------------------------------------------------------
+struct EmitElement
+{
+  template <typename Sink>
+  void operator()(SinkRef<Sink>& ref, const VertexPosition& v) const
+  {
+    ref.sink->onPosition(v);
+  }
+  template <typename Sink>
+  void operator()(SinkRef<Sink>& ref, const VertexNormal& n) const
+  {
+    ref.sink->onNormal(n);
+  }
+  template <typename Sink>
+  void operator()(SinkRef<Sink>& ref, const VertexTextureCoordinate& uv) const
+  {
+    ref.sink->onTexCoord(uv);
+  }
+  template <typename Sink>
+  void operator()(SinkRef<Sink>& ref, const Face& f) const
+  {
+    ref.sink->onFace(f);
+  }
+};
+
+//------------------------------------------------------------------------------
+template <
+  typename Data,
+  typename Iterator,
+  typename Skipper = SkipParser<Iterator>,
+  typename Common  = ObjParserCommon<Data, Iterator, Skipper>>
+struct ObjParserCallbacks : public Common
+{
+  ObjParserCallbacks()
+  {
+    using qi::_1;
+    using qi::_val;
+    using qi::eoi;
+    using qi::lit;
+    using qi::no_skip;
+
+    phoenix::function<EmitElement> emit;
+
+    // clang-format off
+    Common::start = *(!eoi >> (
+      lit('v') >> (
+        no_skip['n'] >> Common::normal      [emit(_val, _1)]
+        | no_skip['t'] >> Common::texCoord  [emit(_val, _1)]
+        | Common::position                  [emit(_val, _1)]
+      )
+      | lit('f') >> Common::face            [emit(_val, _1)]
+      | -Common::directive >> Common::lineEnd
+    ));
+    // clang-format on
+  }
+};
+
+//------------------------------------------------------------------------------
+template <typename Sink>
+auto
+flushSink(Sink& sink, int) -> decltype(sink.flush(), void())
+{
+  sink.flush();
+}
+
+template <typename Sink>
+void
+flushSink(Sink&, long)
+{
+}
+
+//------------------------------------------------------------------------------
+// Reads the stream one block at a time and parses every complete line in the
+// block. The trailing partial line is carried over to the front of the next
+// block; the buffer only grows if a single line is longer than it.
+template <typename Sink>
+bool
+streamWithCallbacks(
+  std::istream& in, Sink& sink, size_t blockSize, ParseError* error)
+{
+  using Data   = SinkRef<Sink>;
+  using Parser = ObjParserCallbacks<Data, const char*>;
+
+  const Parser& parser = threadLocalGrammar<Parser>();
+  Data data;
+  data.sink = &sink;
+
+  std::vector<char> buffer(std::max<size_t>(1, blockSize));
+  size_t carried = 0;
+
+  // Position of the current block in the whole stream. Blocks always start
+  // at the beginning of a line, so only offset and line need carrying over.
+  size_t blockOffset = 0;
+  size_t blockLine   = 0;
+  for (;;)
+  {
+    if (carried == buffer.size())
+    {
+      buffer.resize(buffer.size() * 2);
+    }
+    in.read(buffer.data() + carried, buffer.size() - carried);
+    const bool atEnd = in.eof() || in.bad();
+
+    const char* begin = buffer.data();
+    const char* end   = begin + carried + in.gcount();
+
+    const char* parseEnd = end;
+    if (!atEnd)
+    {
+      // Lines end at '\n' or at a lone '\r'. A '\r' that ends the block is
+      // carried over with the partial line, as a '\n' may follow it.
+      const char* lastEol = end;
+      if (lastEol != begin && *(lastEol - 1) == '\r')
+      {
+        --lastEol;
+      }
+      while (lastEol != begin && *(lastEol - 1) != '\n'
+             && *(lastEol - 1) != '\r')
+      {
+        --lastEol;
+      }
+      if (lastEol == begin)
+      {
+        carried = end - begin;
+        continue;
+      }
+      parseEnd = lastEol;
+    }
+
+    const char* first = begin;
+    if (const char* failure = tryParseObj(parser, first, parseEnd, data))
+    {
+      ParseError located = locateFailure(begin, first, parseEnd, failure);
+      located.offset += blockOffset;
+      located.line += blockLine;
+      reportFailure(located, error);
+      return false;
+    }
+
+    if (atEnd)
+    {
+      return !in.bad();
+    }
+    blockOffset += parseEnd - begin;
+    blockLine += std::count(begin, parseEnd, '\n');
+    carried = end - parseEnd;
+    std::memmove(buffer.data(), parseEnd, carried);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Library Interface
+//------------------------------------------------------------------------------
+template <typename Iterator, typename Sink>
+bool
+parseWithCallbacks(
+  Iterator begin, Iterator end, Sink& sink, ParseError* error = nullptr)
+{
+  using Data   = SinkRef<Sink>;
+  using Parser = ObjParserCallbacks<Data, Iterator>;
+
+  Data data;
+  data.sink     = &sink;
+  const bool ok = parseObj<Parser>(begin, end, data, error);
+  flushSink(sink, 0);
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+template <typename Sink>
+bool
+parseWithCallbacks(
+  std::istream& in,
+  Sink& sink,
+  size_t blockSize  = DEFAULT_STREAM_BLOCK_SIZE,
+  ParseError* error = nullptr)
+{
+  const bool ok = streamWithCallbacks(in, sink, blockSize, error);
+  flushSink(sink, 0);
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+template <typename Sink>
+bool
+loadWithCallbacks(
+  const std::string& filename,
+  Sink& sink,
+  size_t blockSize  = DEFAULT_STREAM_BLOCK_SIZE,
+  ParseError* error = nullptr)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open())
+  {
+    reportFileFailure("File open failed", error);
+    return false;
+  }
+
+  return parseWithCallbacks(in, sink, blockSize, error);
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
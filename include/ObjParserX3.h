@@ -0,0 +1,333 @@
+#pragma once
+
+#include "ObjParser.h"
+
+#include <boost/spirit/home/x3.hpp>
+
+#include <type_traits>
+
+//------------------------------------------------------------------------------
+// Spirit X3 grammar
+//
+// The same line-structured grammar as the Qi one in ObjParser.h, written with
+// X3. X3 parsers are plain objects whose types encode the whole expression,
+// so there is no rule type erasure and no Phoenix: the compiler sees, and can
+// inline, the entire parse.
+//
+// X3Grammar<Data, Iterator> stands in for a Qi grammar type anywhere the
+// implementation takes one, so the parallel, lenient and error reporting paths
+// are shared. Defining OBJPARSER_USE_X3 makes the library interface use it for
+// every output type; including this header directly makes it available next
+// to the Qi grammars.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+namespace x3grammar
+{
+namespace x3 = boost::spirit::x3;
+
+//------------------------------------------------------------------------------
+// X3 primitive wrapping parseFloat, the counterpart of FastFloatParser
+struct FastFloat : x3::parser<FastFloat>
+{
+  using attribute_type                = float;
+  static const bool has_attribute     = true;
+  static const bool handles_container = false;
+
+  template <
+    typename Iterator,
+    typename Context,
+    typename RContext,
+    typename Attribute>
+  bool
+  parse(
+    Iterator& first,
+    const Iterator& last,
+    const Context& context,
+    RContext&,
+    Attribute& attr) const
+  {
+    x3::skip_over(first, last, context);
+
+    float value;
+    if (!parseFloat(first, last, value))
+    {
+      return false;
+    }
+    x3::traits::move_to(value, attr);
+    return true;
+  }
+};
+
+const FastFloat fastFloat = {};
+
+//------------------------------------------------------------------------------
+// X3 primitive wrapping parseFaceCorner, the counterpart of
+// FastFaceCornerParser
+struct FastFaceCorner : x3::parser<FastFaceCorner>
+{
+  using attribute_type                = FaceTriplet;
+  static const bool has_attribute     = true;
+  static const bool handles_container = false;
+
+  template <
+    typename Iterator,
+    typename Context,
+    typename RContext,
+    typename Attribute>
+  bool
+  parse(
+    Iterator& first,
+    const Iterator& last,
+    const Context& context,
+    RContext&,
+    Attribute& attr) const
+  {
+    x3::skip_over(first, last, context);
+
+    FaceTriplet corner;
+    if (!parseFaceCorner(first, last, corner))
+    {
+      return false;
+    }
+    x3::traits::move_to(corner, attr);
+    return true;
+  }
+};
+
+const FastFaceCorner fastFaceCorner = {};
+
+//------------------------------------------------------------------------------
+// The output being parsed into is passed down through the context
+struct DataTag;
+
+template <typename Context>
+auto&
+dataOf(const Context& context)
+{
+  return x3::get<DataTag>(context);
+}
+
+//------------------------------------------------------------------------------
+// Where each parsed element goes, for each output type
+template <typename Data>
+auto&
+arrayFor(Data& data, const VertexPosition&)
+{
+  return data.positions;
+}
+
+template <typename Data>
+auto&
+arrayFor(Data& data, const VertexNormal&)
+{
+  return data.normals;
+}
+
+template <typename Data>
+auto&
+arrayFor(Data& data, const VertexTextureCoordinate&)
+{
+  return data.texCoords;
+}
+
+template <typename Data>
+auto&
+arrayFor(Data& data, const Face&)
+{
+  return data.faces;
+}
+
+template <typename Data, typename Element>
+void
+addElement(Data& data, const Element& element)
+{
+  if constexpr (std::is_same_v<Data, ObjVariantVec>)
+  {
+    data.emplace_back(element);
+  }
+  else if constexpr (std::is_same_v<Data, ObjSoaAggregate>)
+  {
+    AppendToArrays()(arrayFor(data, element), element);
+  }
+  else
+  {
+    arrayFor(data, element).push_back(element);
+  }
+}
+
+//------------------------------------------------------------------------------
+// The flat layouts take face corners one at a time rather than as a Face
+template <typename Data>
+constexpr bool STREAMS_CORNERS = std::is_same_v<Data, ObjFlatAggregate>
+                                 || std::is_same_v<Data, ObjSoaAggregate>
+                                 || std::is_same_v<Data, ObjResolvedAggregate>;
+
+//------------------------------------------------------------------------------
+// Semantic actions
+const auto onElement = [](auto& ctx) {
+  addElement(dataOf(ctx), x3::_attr(ctx));
+};
+const auto onCorner = [](auto& ctx) {
+  auto& data = dataOf(ctx);
+  if constexpr (std::is_same_v<
+                  std::decay_t<decltype(data)>,
+                  ObjResolvedAggregate>)
+  {
+    x3::_pass(ctx) = storeResolvedCorner(data, x3::_attr(ctx));
+  }
+  else
+  {
+    data.faceCorners.emplace_back(x3::_attr(ctx));
+  }
+};
+const auto onFaceEnd = [](auto& ctx) {
+  auto& data = dataOf(ctx);
+  data.faceOffsets.push_back(data.faceCorners.size());
+};
+
+//------------------------------------------------------------------------------
+// clang-format off
+const auto comment
+  = x3::rule<struct CommentTag>{"comment"}
+  = x3::lexeme['#' >> *(x3::char_ - x3::eol)];
+const auto directive
+  = x3::rule<struct DirectiveTag>{"directive"}
+  = x3::lexeme[(x3::lit("mtllib") | "usemtl") >> *(x3::char_ - x3::eol)];
+const auto lineEnd = -comment >> (x3::eol | x3::eoi);
+
+const auto position
+  = x3::rule<struct PositionTag, VertexPosition>{"position"}
+  = fastFloat >> fastFloat >> fastFloat >> -fastFloat >> lineEnd;
+const auto normal
+  = x3::rule<struct NormalTag, VertexNormal>{"normal"}
+  = fastFloat >> fastFloat >> fastFloat >> lineEnd;
+const auto texCoord
+  = x3::rule<struct TexCoordTag, VertexTextureCoordinate>{"texCoord"}
+  = fastFloat >> -fastFloat >> -fastFloat >> lineEnd;
+
+// v, v/vt, v//vn or v/vt/vn; see FaceParser.h
+const auto faceCorner
+  = x3::rule<struct FaceCornerTag, FaceTriplet>{"faceCorner"}
+  = fastFaceCorner;
+const auto face
+  = x3::rule<struct FaceTag, Face>{"face"}
+  = +faceCorner >> lineEnd;
+
+const auto vertex = x3::lit('v') >> (
+  x3::no_skip['n'] >> normal[onElement]
+  | x3::no_skip['t'] >> texCoord[onElement]
+  | position[onElement]
+);
+const auto ignoredLine = -directive >> lineEnd;
+
+// A line of an element type that ObjSelectedAggregate leaves out; see
+// ObjParserSelectedActions
+const auto skippedLine = x3::no_skip[
+  &(x3::blank | x3::eol | x3::eoi)
+  >> *(x3::char_ - x3::eol) >> (x3::eol | x3::eoi)
+];
+// clang-format on
+
+//------------------------------------------------------------------------------
+// kept if the element type is selected, else skippedLine or dropped
+template <bool SELECTED, typename Kept, typename Dropped>
+auto
+selectedLine(const Kept& kept, const Dropped& dropped)
+{
+  if constexpr (SELECTED)
+  {
+    return kept;
+  }
+  else
+  {
+    return skippedLine | dropped;
+  }
+}
+
+//------------------------------------------------------------------------------
+template <typename Data>
+auto
+start()
+{
+  // clang-format off
+  if constexpr (IS_SELECTED_AGGREGATE<Data>)
+  {
+    const auto corners = (+faceCorner[onCorner] >> lineEnd)[onFaceEnd];
+    return *(!x3::eoi >> (
+      x3::lit('v') >> (
+        x3::no_skip['n']
+          >> selectedLine<Data::NORMALS>(normal[onElement], normal)
+        | x3::no_skip['t']
+          >> selectedLine<Data::TEX_COORDS>(texCoord[onElement], texCoord)
+        | selectedLine<Data::POSITIONS>(position[onElement], position)
+      )
+      | x3::lit('f') >> selectedLine<Data::FACES>(corners, face)
+      | ignoredLine
+    ));
+  }
+  else if constexpr (STREAMS_CORNERS<Data>)
+  {
+    return *(!x3::eoi >> (
+      vertex
+      | (x3::lit('f') >> +faceCorner[onCorner] >> lineEnd)[onFaceEnd]
+      | ignoredLine
+    ));
+  }
+  else
+  {
+    return *(!x3::eoi >> (
+      vertex
+      | x3::lit('f') >> face[onElement]
+      | ignoredLine
+    ));
+  }
+  // clang-format on
+}
+
+//------------------------------------------------------------------------------
+}    // namespace x3grammar
+
+//------------------------------------------------------------------------------
+// Stateless handle selecting the X3 grammar; see tryParseObj below
+template <typename Data, typename Iterator>
+struct X3Grammar
+{
+};
+
+//------------------------------------------------------------------------------
+// Overload of the Qi tryParseObj, with the same contract
+template <typename Data, typename Iterator>
+const char*
+tryParseObj(
+  const X3Grammar<Data, Iterator>&, Iterator& first, Iterator last, Data& data)
+{
+  namespace x3 = boost::spirit::x3;
+
+  const auto parser
+    = x3::with<x3grammar::DataTag>(data)[x3grammar::start<Data>()];
+  try
+  {
+    if (!x3::phrase_parse(first, last, parser, x3::blank))
+    {
+      return "parse failed";
+    }
+    if (first != last)
+    {
+      return "unparsed";
+    }
+    return nullptr;
+  }
+  catch (const x3::expectation_failure<Iterator>&)
+  {
+    return "parse exception";
+  }
+  catch (...)
+  {
+    return "misc exception";
+  }
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
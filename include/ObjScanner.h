@@ -0,0 +1,486 @@
+#pragma once
+
+#include "ObjParser.h"
+
+//------------------------------------------------------------------------------
+// Hand-written scanner
+//
+// Accepts exactly the language of the Spirit grammars and fills an
+// ObjAggregate with the same values, but walks a contiguous char buffer with
+// raw pointers: a line is dispatched on its first character and every number
+// is read in place, with no rules, attributes or semantic actions in between.
+// It fills an ObjSelectedAggregate like ObjParserSelectedActions does,
+// skipping the lines of element types that are not selected.
+// The Spirit grammars stay the reference; the tests run both over the same
+// inputs and expect identical output, errors and diagnostics.
+//
+// ObjScanner stands in for a grammar type like X3Grammar does, so the
+// parallel, lenient and error reporting paths are shared. Select it on the
+// library interface with ScannerBackend, e.g.
+//   loadAsAggregate<ObjParser::ScannerBackend>("mesh.obj")
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+namespace scanner
+{
+//------------------------------------------------------------------------------
+// Every scan function below matches a Spirit parser of the same name. Like
+// the Spirit primitives they skip leading blanks themselves, and they only
+// advance first when they succeed.
+inline const char*
+skipBlanks(const char* c, const char* last)
+{
+  while (c != last && isBlank(*c))
+  {
+    ++c;
+  }
+  return c;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+scanFloat(const char*& first, const char* last, float& value)
+{
+  const char* c = skipBlanks(first, last);
+  if (!parseFloat(c, last, value))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// -comment >> (eol | eoi), where eol is any of \r\n, \r and \n
+inline bool
+scanLineEnd(const char*& first, const char* last)
+{
+  const char* c = skipBlanks(first, last);
+  if (c != last && *c == '#')
+  {
+    while (c != last && *c != '\n' && *c != '\r')
+    {
+      ++c;
+    }
+  }
+
+  if (c != last)
+  {
+    if (*c == '\r')
+    {
+      ++c;
+      c += (c != last && *c == '\n') ? 1 : 0;
+    }
+    else if (*c == '\n')
+    {
+      ++c;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+scanPosition(const char*& first, const char* last, VertexPosition& v)
+{
+  const char* c = first;
+  if (
+    !scanFloat(c, last, v.x) || !scanFloat(c, last, v.y)
+    || !scanFloat(c, last, v.z))
+  {
+    return false;
+  }
+  scanFloat(c, last, v.w);
+  if (!scanLineEnd(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+scanNormal(const char*& first, const char* last, VertexNormal& n)
+{
+  const char* c = first;
+  if (
+    !scanFloat(c, last, n.i) || !scanFloat(c, last, n.j)
+    || !scanFloat(c, last, n.k) || !scanLineEnd(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+scanTexCoord(const char*& first, const char* last, VertexTextureCoordinate& uv)
+{
+  const char* c = first;
+  if (!scanFloat(c, last, uv.u))
+  {
+    return false;
+  }
+  scanFloat(c, last, uv.v);
+  scanFloat(c, last, uv.w);
+  if (!scanLineEnd(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Corners are read by parseFaceCorner() (FaceParser.h), which the grammars
+// share. They are collected in scratch, so that each face is allocated once
+// at its final size when it is stored
+inline bool
+scanFace(const char*& first, const char* last, Face& scratch)
+{
+  scratch.clear();
+  const char* c = first;
+  FaceTriplet corner;
+  while (parseFaceCorner(c, last, corner))
+  {
+    scratch.push_back(corner);
+    corner = FaceTriplet();
+  }
+  if (scratch.empty() || !scanLineEnd(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// -directive >> lineEnd
+inline bool
+scanIgnoredLine(const char*& first, const char* last)
+{
+  const char* c = first;
+  if (
+    (last - c >= 6)
+    && (std::memcmp(c, "mtllib", 6) == 0 || std::memcmp(c, "usemtl", 6) == 0))
+  {
+    while (c != last && *c != '\n' && *c != '\r')
+    {
+      ++c;
+    }
+  }
+  if (!scanLineEnd(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Where scanned elements go. An ObjSelectedAggregate drops those of the types
+// its attribute mask leaves out.
+inline void
+store(ObjAggregate& data, const VertexPosition& v)
+{
+  data.positions.push_back(v);
+}
+
+inline void
+store(ObjAggregate& data, const VertexNormal& n)
+{
+  data.normals.push_back(n);
+}
+
+inline void
+store(ObjAggregate& data, const VertexTextureCoordinate& uv)
+{
+  data.texCoords.push_back(uv);
+}
+
+inline void
+store(ObjAggregate& data, const Face& face)
+{
+  data.faces.emplace_back(face.begin(), face.end());
+}
+
+template <Attributes MASK, typename Element>
+void
+store(ObjSelectedAggregate<MASK>& data, const Element& element)
+{
+  storeSelected(data, element);
+}
+
+template <Attributes MASK>
+void
+store(ObjSelectedAggregate<MASK>& data, const Face& face)
+{
+  storeSelectedFace(data, face);
+}
+
+//------------------------------------------------------------------------------
+// Skips the line at first unread if it holds an element type that MASK does
+// not select, going by the same keyword rules as the line index
+template <Attributes MASK>
+bool
+skipUnselectedLine(const char*& first, const char* last)
+{
+  using Data = ObjSelectedAggregate<MASK>;
+
+  auto endsKeyword = [&](const char* k) {
+    return k == last || isBlank(*k) || *k == '\r' || *k == '\n';
+  };
+
+  const char* c = first;
+  bool selected = true;
+  if (*c == 'v')
+  {
+    if (endsKeyword(c + 1))
+    {
+      selected = Data::POSITIONS;
+    }
+    else if (endsKeyword(c + 2))
+    {
+      selected = (c[1] == 'n')   ? Data::NORMALS
+                 : (c[1] == 't') ? Data::TEX_COORDS
+                                 : true;
+    }
+  }
+  else if (*c == 'f' && endsKeyword(c + 1))
+  {
+    selected = Data::FACES;
+  }
+  if (selected)
+  {
+    return false;
+  }
+
+  while (c != last && *c != '\n' && *c != '\r')
+  {
+    ++c;
+  }
+  scanLineEnd(c, last);
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Scans the line whose first non-blank character is at first. The element is
+// only added once the whole line has matched.
+template <typename Data>
+bool
+scanLine(const char*& first, const char* last, Data& data, Face& scratch)
+{
+  if constexpr (IS_SELECTED_AGGREGATE<Data>)
+  {
+    if (skipUnselectedLine<Data::ATTRIBUTES>(first, last))
+    {
+      return true;
+    }
+  }
+
+  const char* c = first;
+  if (*c == 'v')
+  {
+    ++c;
+    const char keyword = (c != last) ? *c : '\0';
+    const char* suffix = c + ((c != last) ? 1 : 0);
+    if (keyword == 'n')
+    {
+      VertexNormal n;
+      if (scanNormal(suffix, last, n))
+      {
+        store(data, n);
+        first = suffix;
+        return true;
+      }
+    }
+    else if (keyword == 't')
+    {
+      VertexTextureCoordinate uv;
+      if (scanTexCoord(suffix, last, uv))
+      {
+        store(data, uv);
+        first = suffix;
+        return true;
+      }
+    }
+
+    // The grammar falls back to a position after a failed vn or vt, and
+    // "vnan 1 2" is in fact one
+    VertexPosition v;
+    if (!scanPosition(c, last, v))
+    {
+      return false;
+    }
+    store(data, v);
+  }
+  else if (*c == 'f')
+  {
+    if (!scanFace(++c, last, scratch))
+    {
+      return false;
+    }
+    store(data, scratch);
+  }
+  else if (!scanIgnoredLine(c, last))
+  {
+    return false;
+  }
+  first = c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// scanLine() for a line of known type. Lines the grammar ignores are not read
+// at all. Any other line that does not match its type is handed to scanLine(),
+// which tries every alternative just as the grammar does.
+inline bool
+scanIndexedLine(
+  const char* line,
+  const char* last,
+  LineType type,
+  ObjAggregate& data,
+  Face& scratch)
+{
+  const char* c = line;
+  switch (type)
+  {
+  case LineType::Blank:
+  case LineType::Comment:
+  case LineType::Material: return true;
+  case LineType::Position:
+  {
+    VertexPosition v;
+    if (scanPosition(++c, last, v))
+    {
+      store(data, v);
+      return true;
+    }
+    break;
+  }
+  case LineType::Normal:
+  {
+    VertexNormal n;
+    if (scanNormal(c += 2, last, n))
+    {
+      store(data, n);
+      return true;
+    }
+    break;
+  }
+  case LineType::TexCoord:
+  {
+    VertexTextureCoordinate uv;
+    if (scanTexCoord(c += 2, last, uv))
+    {
+      store(data, uv);
+      return true;
+    }
+    break;
+  }
+  case LineType::Face:
+  {
+    if (scanFace(++c, last, scratch))
+    {
+      store(data, scratch);
+      return true;
+    }
+    break;
+  }
+  default: break;
+  }
+  return scanLine(line, last, data, scratch);
+}
+
+//------------------------------------------------------------------------------
+}    // namespace scanner
+
+//------------------------------------------------------------------------------
+// Stateless handle selecting the scanner; see tryParseObj below
+struct ObjScanner
+{
+};
+
+//------------------------------------------------------------------------------
+// Overload of the Qi tryParseObj, with the same contract, for an ObjAggregate
+// or an ObjSelectedAggregate. As with the grammar, a line that fails leaves
+// first at its first non-blank character.
+template <typename Data>
+const char*
+tryParseObj(
+  const ObjScanner&, const char*& first, const char* last, Data& data)
+{
+  try
+  {
+    Face scratch;
+    for (;;)
+    {
+      first = scanner::skipBlanks(first, last);
+      if (first == last)
+      {
+        return nullptr;
+      }
+      if (!scanner::scanLine(first, last, data, scratch))
+      {
+        return "unparsed";
+      }
+    }
+  }
+  catch (...)
+  {
+    return "misc exception";
+  }
+}
+
+//------------------------------------------------------------------------------
+// The same, walking the lines of an index of the buffer (see LineIndex.h)
+// rather than finding each line end while scanning
+inline const char*
+tryParseObj(
+  const ObjScanner& scanner,
+  const char*& first,
+  const char* last,
+  ObjAggregate& data,
+  const LineIndex* index)
+{
+  if (!index)
+  {
+    return tryParseObj(scanner, first, last, data);
+  }
+
+  try
+  {
+    Face scratch;
+    for (size_t i = index->find(first); i < index->size(); ++i)
+    {
+      const char* line = index->line(i);
+      if (line >= last)
+      {
+        break;
+      }
+      if (!scanner::scanIndexedLine(line, last, index->type(i), data, scratch))
+      {
+        first = line;
+        return "unparsed";
+      }
+    }
+    first = last;
+    return nullptr;
+  }
+  catch (...)
+  {
+    return "misc exception";
+  }
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
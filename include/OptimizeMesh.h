@@ -0,0 +1,345 @@
+#pragma once
+
+#include "Parallel.h"
+#include "UnifiedMesh.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Vertex cache and vertex fetch optimisation
+//
+// Meshes come out of the parser in the order the exporter wrote them, which
+// makes poor use of the GPU's post-transform vertex cache. The passes here
+// reorder a unified mesh for the GPU, without changing what it draws:
+//  - optimizeVertexCache() reorders the triangles with Tom Forsyth's linear
+//    speed algorithm. It models an LRU cache and greedily emits the triangle
+//    whose vertices score best. A vertex scores higher the more recently it
+//    was used and the fewer triangles it has left to draw.
+//  - optimizeVertexFetch() then renumbers the vertices in the order the
+//    triangles first use them, so that vertex fetches stream through memory.
+// analyzeVertexCache() reports how well an index buffer uses a FIFO cache:
+// ACMR, the vertices transformed per triangle, and ATVR, the vertices
+// transformed per vertex. ATVR is 1 at best, and ACMR 0.5 on a large regular
+// grid.
+//
+// Both passes are serial, one pass over the triangles each.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+// The cache the passes model and report on by default
+constexpr size_t VERTEX_CACHE_SIZE = 32;
+
+//------------------------------------------------------------------------------
+struct VertexCacheStatistics
+{
+  size_t transformed = 0;    // cache misses
+  float acmr         = 0.0f;
+  float atvr         = 0.0f;
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+// Forsyth's vertex score: a bonus for the cache position, where the last
+// triangle's vertices all score the same, plus one for having few triangles
+// left. Both are tabulated.
+class VertexScores
+{
+public:
+  static constexpr size_t MAX_VALENCE = 32;
+
+  explicit VertexScores(size_t cacheSize) : m_cache(cacheSize)
+  {
+    for (size_t position = 0; position < cacheSize; ++position)
+    {
+      const float age   = float(position - 3) / float(cacheSize - 3);
+      m_cache[position] = (position < 3) ? 0.75f : std::pow(1.0f - age, 1.5f);
+    }
+    m_valence[0] = 0.0f;
+    for (size_t valence = 1; valence <= MAX_VALENCE; ++valence)
+    {
+      m_valence[valence] = 2.0f / std::sqrt(float(valence));
+    }
+  }
+
+  // position is the vertex's place in the cache, or the cache size if it is
+  // not in it. A vertex with no triangles left scores nothing.
+  float operator()(size_t position, size_t valence) const
+  {
+    if (valence == 0)
+    {
+      return 0.0f;
+    }
+    const float cache = (position < m_cache.size()) ? m_cache[position] : 0.0f;
+    return cache + m_valence[std::min(valence, MAX_VALENCE)];
+  }
+
+private:
+  std::vector<float> m_cache;
+  float m_valence[MAX_VALENCE + 1];
+};
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Simulates a FIFO cache of cacheSize vertices over the index buffer
+inline VertexCacheStatistics
+analyzeVertexCache(
+  const std::vector<uint32_t>& indices,
+  size_t vertexCount,
+  size_t cacheSize = VERTEX_CACHE_SIZE)
+{
+  VertexCacheStatistics statistics;
+  if (indices.size() < 3 || cacheSize == 0)
+  {
+    return statistics;
+  }
+
+  // A vertex is cached until cacheSize more have been loaded after it
+  std::vector<size_t> loadedAt(vertexCount, 0);
+  std::vector<char> used(vertexCount, 0);
+  size_t usedCount = 0;
+  for (uint32_t index : indices)
+  {
+    if (index >= vertexCount)
+    {
+      continue;
+    }
+    if (!used[index] || statistics.transformed - loadedAt[index] > cacheSize)
+    {
+      loadedAt[index] = statistics.transformed++;
+    }
+    usedCount += used[index] ? 0 : 1;
+    used[index] = 1;
+  }
+
+  statistics.acmr = float(statistics.transformed) / (indices.size() / 3);
+  statistics.atvr = float(statistics.transformed) / usedCount;
+  return statistics;
+}
+
+inline VertexCacheStatistics
+analyzeVertexCache(
+  const ObjUnifiedMesh& mesh, size_t cacheSize = VERTEX_CACHE_SIZE)
+{
+  return analyzeVertexCache(mesh.indices, mesh.vertices.size(), cacheSize);
+}
+
+//------------------------------------------------------------------------------
+// Reorders the triangles of mesh for an LRU cache of cacheSize vertices.
+// Fails, leaving the mesh untouched, if an index refers to a vertex that does
+// not exist.
+inline bool
+optimizeVertexCache(
+  ObjUnifiedMesh& mesh, size_t cacheSize = VERTEX_CACHE_SIZE)
+{
+  const std::vector<uint32_t>& indices = mesh.indices;
+  const size_t triangles               = indices.size() / 3;
+  const size_t vertexCount             = mesh.vertices.size();
+  if (indices.size() % 3 != 0)
+  {
+    LOG_ERROR("Index count is not a multiple of three: %zu", indices.size());
+    return false;
+  }
+  for (uint32_t index : indices)
+  {
+    if (index >= vertexCount)
+    {
+      LOG_ERROR("An index refers to a vertex that does not exist");
+      return false;
+    }
+  }
+  cacheSize = std::max<size_t>(cacheSize, 4);
+
+  // The triangles of each vertex. The first liveCount of them are the ones
+  // still to be emitted.
+  std::vector<uint32_t> corners;
+  std::vector<size_t> starts;
+  sortByKey(
+    indices.size(),
+    vertexCount,
+    1,
+    indices.size(),
+    [&](size_t c) { return indices[c]; },
+    corners,
+    starts);
+  std::vector<uint32_t> liveCount(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    liveCount[v] = uint32_t(starts[v + 1] - starts[v]);
+  }
+
+  const detail::VertexScores vertexScore(cacheSize);
+  std::vector<uint32_t> cachePosition(vertexCount, uint32_t(cacheSize));
+  std::vector<float> scores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    scores[v] = vertexScore(cacheSize, liveCount[v]);
+  }
+  auto triangleScore = [&](size_t t) {
+    return scores[indices[3 * t]] + scores[indices[3 * t + 1]]
+           + scores[indices[3 * t + 2]];
+  };
+
+  // Start from the best triangle overall
+  constexpr size_t NONE = ~size_t(0);
+  size_t best           = NONE;
+  float bestScore       = -1.0f;
+  for (size_t t = 0; t < triangles; ++t)
+  {
+    const float score = triangleScore(t);
+    if (score > bestScore)
+    {
+      best      = t;
+      bestScore = score;
+    }
+  }
+
+  std::vector<uint32_t> reordered;
+  reordered.reserve(indices.size());
+  std::vector<char> emitted(triangles, 0);
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> nextCache;
+  cache.reserve(cacheSize + 3);
+  nextCache.reserve(cacheSize + 3);
+  size_t cursor = 0;
+  while (reordered.size() < indices.size())
+  {
+    // Out of candidates: take the next triangle in the original order
+    if (best == NONE)
+    {
+      while (emitted[cursor])
+      {
+        ++cursor;
+      }
+      best = cursor;
+    }
+
+    emitted[best] = 1;
+    nextCache.clear();
+    for (size_t k = 0; k < 3; ++k)
+    {
+      const uint32_t v = indices[3 * best + k];
+      reordered.push_back(v);
+
+      // Drop the triangle from the vertex's live triangles
+      uint32_t* live = corners.data() + starts[v];
+      uint32_t* last = live + --liveCount[v];
+      while (*live / 3 != best)
+      {
+        ++live;
+      }
+      std::swap(*live, *last);
+
+      if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+      {
+        nextCache.push_back(v);
+      }
+    }
+    for (uint32_t v : cache)
+    {
+      if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+      {
+        nextCache.push_back(v);
+      }
+    }
+
+    // Rescore the vertices that moved, including those pushed out, and pick
+    // the best triangle around the cache
+    for (size_t position = 0; position < nextCache.size(); ++position)
+    {
+      const uint32_t v = nextCache[position];
+      cachePosition[v] = uint32_t(std::min(position, cacheSize));
+      scores[v]        = vertexScore(cachePosition[v], liveCount[v]);
+    }
+    best      = NONE;
+    bestScore = -1.0f;
+    for (size_t position = 0; position < nextCache.size(); ++position)
+    {
+      const uint32_t v = nextCache[position];
+      for (size_t i = starts[v]; i < starts[v] + liveCount[v]; ++i)
+      {
+        const size_t t    = corners[i] / 3;
+        const float score = triangleScore(t);
+        if (score > bestScore)
+        {
+          best      = t;
+          bestScore = score;
+        }
+      }
+    }
+    nextCache.resize(std::min(nextCache.size(), cacheSize));
+    std::swap(cache, nextCache);
+  }
+
+  mesh.indices = std::move(reordered);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Renumbers the vertices of mesh in the order the index buffer first uses
+// them, moving their tangents with them. Vertices no triangle uses keep their
+// order after all the others.
+inline bool
+optimizeVertexFetch(ObjUnifiedMesh& mesh)
+{
+  const size_t vertexCount = mesh.vertices.size();
+  const bool hasTangents   = !mesh.tangents.empty();
+  if (hasTangents && mesh.tangents.size() != vertexCount)
+  {
+    LOG_ERROR(
+      "Tangent count %zu does not match vertex count %zu",
+      mesh.tangents.size(),
+      vertexCount);
+    return false;
+  }
+
+  constexpr uint32_t UNUSED = ~uint32_t(0);
+  std::vector<uint32_t> remap(vertexCount, UNUSED);
+  uint32_t next = 0;
+  for (uint32_t index : mesh.indices)
+  {
+    if (index >= vertexCount)
+    {
+      LOG_ERROR("An index refers to a vertex that does not exist");
+      return false;
+    }
+    if (remap[index] == UNUSED)
+    {
+      remap[index] = next++;
+    }
+  }
+  for (uint32_t& slot : remap)
+  {
+    if (slot == UNUSED)
+    {
+      slot = next++;
+    }
+  }
+
+  std::vector<UnifiedVertex> vertices(vertexCount);
+  std::vector<UnifiedTangent> tangents(hasTangents ? vertexCount : 0);
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    vertices[remap[v]] = mesh.vertices[v];
+    if (hasTangents)
+    {
+      tangents[remap[v]] = mesh.tangents[v];
+    }
+  }
+  for (uint32_t& index : mesh.indices)
+  {
+    index = remap[index];
+  }
+  mesh.vertices = std::move(vertices);
+  mesh.tangents = std::move(tangents);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
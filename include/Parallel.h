@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Minimal fork/join helpers shared by the parallel parse and mesh stages
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+// Zero means "one thread per hardware core"
+inline unsigned
+resolveThreadCount(unsigned requested)
+{
+  if (requested != 0)
+  {
+    return requested;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//------------------------------------------------------------------------------
+// Number of ranges to split count items into: one per thread, but none
+// smaller than minPerRange, and at least one
+inline size_t
+rangeCount(size_t count, unsigned threadCount, size_t minPerRange)
+{
+  const size_t ranges = count / std::max<size_t>(minPerRange, 1);
+  return std::max<size_t>(
+    1, std::min<size_t>(resolveThreadCount(threadCount), ranges));
+}
+
+//------------------------------------------------------------------------------
+// Calls func(i) for every i in [0, count) using up to threadCount threads.
+// Indices are dealt out in contiguous blocks, one block per thread, and the
+// calling thread works on the first block itself.
+template <typename Func>
+void
+parallelFor(size_t count, unsigned threadCount, Func&& func)
+{
+  const size_t threads
+    = std::min<size_t>(resolveThreadCount(threadCount), count);
+  if (threads <= 1)
+  {
+    for (size_t i = 0; i < count; ++i)
+    {
+      func(i);
+    }
+    return;
+  }
+
+  auto runBlock = [&](size_t block) {
+    const size_t first = count * block / threads;
+    const size_t last  = count * (block + 1) / threads;
+    for (size_t i = first; i < last; ++i)
+    {
+      func(i);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (size_t block = 1; block < threads; ++block)
+  {
+    workers.emplace_back(runBlock, block);
+  }
+  runBlock(0);
+
+  for (auto& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+// Stable counting sort of the items [0, count) by keyOf(item), which must be
+// below keyCount, using up to threadCount threads. Afterwards the items with
+// key k are items[starts[k]] to items[starts[k + 1] - 1], in increasing order.
+// Each range of items counts and scatters its items to blocks of keys first,
+// so that every block can then be sorted by one thread. count must fit in 32
+// bits.
+template <typename KeyOf>
+void
+sortByKey(
+  size_t count,
+  size_t keyCount,
+  unsigned threadCount,
+  size_t minPerRange,
+  KeyOf&& keyOf,
+  std::vector<uint32_t>& items,
+  std::vector<size_t>& starts)
+{
+  const size_t ranges = rangeCount(count, threadCount, minPerRange);
+  const size_t blocks
+    = (ranges > 1) ? std::max<size_t>(1, std::min(4 * ranges, keyCount)) : 1;
+  auto rangeBegin = [&](size_t range) { return count * range / ranges; };
+  auto blockOf    = [&](size_t key) {
+    return size_t(uint64_t(key) * blocks / keyCount);
+  };
+  auto blockBegin = [&](size_t block) {
+    return (keyCount * block + blocks - 1) / blocks;
+  };
+
+  // Items of each block from each range, block-major
+  std::vector<size_t> offsets(blocks * ranges + 1, 0);
+  parallelFor(ranges, unsigned(ranges), [&](size_t range) {
+    std::vector<size_t> counts(blocks, 0);
+    for (size_t i = rangeBegin(range); i < rangeBegin(range + 1); ++i)
+    {
+      ++counts[blockOf(keyOf(i))];
+    }
+    for (size_t block = 0; block < blocks; ++block)
+    {
+      offsets[block * ranges + range + 1] = counts[block];
+    }
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<uint32_t> scattered(count);
+  parallelFor(ranges, unsigned(ranges), [&](size_t range) {
+    std::vector<size_t> cursor(blocks);
+    for (size_t block = 0; block < blocks; ++block)
+    {
+      cursor[block] = offsets[block * ranges + range];
+    }
+    for (size_t i = rangeBegin(range); i < rangeBegin(range + 1); ++i)
+    {
+      scattered[cursor[blockOf(keyOf(i))]++] = uint32_t(i);
+    }
+  });
+
+  items.resize(count);
+  starts.assign(keyCount + 1, count);
+  parallelFor(blocks, unsigned(ranges), [&](size_t block) {
+    const size_t firstKey = blockBegin(block);
+    const size_t lastKey  = blockBegin(block + 1);
+    const size_t begin    = offsets[block * ranges];
+    const size_t end      = offsets[(block + 1) * ranges];
+
+    std::fill(starts.begin() + firstKey, starts.begin() + lastKey, 0);
+    for (size_t i = begin; i < end; ++i)
+    {
+      ++starts[keyOf(scattered[i])];
+    }
+    for (size_t key = firstKey, next = begin; key < lastKey; ++key)
+    {
+      const size_t keyItems = starts[key];
+      starts[key]           = next;
+      next += keyItems;
+    }
+    std::vector<size_t> cursor(
+      starts.begin() + firstKey, starts.begin() + lastKey);
+    for (size_t i = begin; i < end; ++i)
+    {
+      const uint32_t item = scattered[i];
+      items[cursor[keyOf(item) - firstKey]++] = item;
+    }
+  });
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "ObjParser.h"
+
+#include <cmath>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Polygon triangulation
+//
+// triangulate() splits every face of a parsed aggregate into triangles and
+// returns their corners, three per triangle, in one contiguous array. A face
+// of n corners becomes n - 2 triangles, written in face order with the winding
+// of the face, so the triangles of a face can be found from the face arities
+// alone. Faces of fewer than three corners are dropped.
+//
+// Each face is fanned from its first corner if it is planar and convex, and
+// ear clipped in the plane it projects onto best otherwise. Corners are copied
+// unchanged, so the triangles index the same element arrays as the faces did.
+//
+// Face ranges are triangulated on separate threads. Every range counts its
+// triangles first, so each can then write straight to its place in the output.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+struct TriangulateOptions
+{
+  // Zero uses every hardware core
+  unsigned threadCount = 1;
+
+  // Faces are never split into ranges smaller than this
+  size_t minFacesPerThread = 1 << 14;
+
+  // A face whose corners lie further than this from its plane, as a fraction
+  // of its size, is ear clipped even if it is convex
+  float planarTolerance = 1e-3f;
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+// The corners of face i, for the nested and the flat face layouts
+inline size_t
+faceCount(const ObjAggregate& data)
+{
+  return data.faces.size();
+}
+
+template <typename Data>
+size_t
+faceCount(const Data& data)
+{
+  return data.faceCount();
+}
+
+inline std::pair<const FaceTriplet*, const FaceTriplet*>
+faceRange(const ObjAggregate& data, size_t face)
+{
+  const Face& corners = data.faces[face];
+  return {corners.data(), corners.data() + corners.size()};
+}
+
+template <typename Data>
+auto
+faceRange(const Data& data, size_t face)
+{
+  return std::make_pair(data.faceBegin(face), data.faceEnd(face));
+}
+
+// Writable corners, for the stages that patch faces
+inline std::pair<FaceTriplet*, FaceTriplet*>
+faceRange(ObjAggregate& data, size_t face)
+{
+  Face& corners = data.faces[face];
+  return {corners.data(), corners.data() + corners.size()};
+}
+
+template <typename Data>
+auto
+faceRange(Data& data, size_t face)
+{
+  auto* corners = data.faceCorners.data();
+  return std::make_pair(
+    corners + data.faceOffsets[face], corners + data.faceOffsets[face + 1]);
+}
+
+template <typename Data>
+using FaceCorner
+  = std::decay_t<decltype(*faceRange(std::declval<const Data&>(), 0).first)>;
+
+//------------------------------------------------------------------------------
+// The zero-based index of the position a corner refers to. Relative
+// (negative) indices can no longer be resolved once the parse is over, so
+// they have none.
+template <typename Data, typename Corner>
+bool
+cornerPositionIndex(const Data& data, const Corner& corner, size_t& index)
+{
+  if constexpr (std::is_same_v<Corner, ResolvedCorner>)
+  {
+    index = corner.vertexIndex;
+  }
+  else
+  {
+    if (corner.vertexIndex <= 0)
+    {
+      return false;
+    }
+    index = size_t(corner.vertexIndex) - 1;
+  }
+  return index < data.positions.size();
+}
+
+template <typename Data, typename Corner>
+bool
+cornerPosition(const Data& data, const Corner& corner, VertexPosition& v)
+{
+  size_t index = 0;
+  if (!cornerPositionIndex(data, corner, index))
+  {
+    return false;
+  }
+  v = data.positions[index];
+  return true;
+}
+
+//------------------------------------------------------------------------------
+struct Point2
+{
+  double x;
+  double y;
+};
+
+inline double
+cross(const Point2& a, const Point2& b, const Point2& c)
+{
+  return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+}
+
+//------------------------------------------------------------------------------
+// Per thread buffers reused from face to face
+struct TriangulateScratch
+{
+  std::vector<VertexPosition> positions;
+  std::vector<Point2> points;
+  std::vector<size_t> remaining;
+};
+
+//------------------------------------------------------------------------------
+// Whether p is inside triangle abc, boundary included, when abc turns the way
+// of sign
+inline bool
+insideTriangle(
+  const Point2& p,
+  const Point2& a,
+  const Point2& b,
+  const Point2& c,
+  double sign)
+{
+  return cross(a, b, p) * sign >= 0.0 && cross(b, c, p) * sign >= 0.0
+         && cross(c, a, p) * sign >= 0.0;
+}
+
+//------------------------------------------------------------------------------
+template <typename Corner>
+Corner*
+fanFace(const Corner* first, const Corner* last, Corner* out)
+{
+  for (const Corner* c = first + 1; c + 1 != last; ++c)
+  {
+    *out++ = first[0];
+    *out++ = c[0];
+    *out++ = c[1];
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+// Clips the ear with the smallest-indexed tip until a triangle is left. If
+// rounding leaves no ear (a self-intersecting or degenerate face), the first
+// remaining corner is clipped anyway so that n - 2 triangles always come out.
+template <typename Corner>
+Corner*
+clipEars(
+  const Corner* first,
+  TriangulateScratch& scratch,
+  double sign,
+  Corner* out)
+{
+  const std::vector<Point2>& p   = scratch.points;
+  std::vector<size_t>& remaining = scratch.remaining;
+  remaining.resize(p.size());
+  std::iota(remaining.begin(), remaining.end(), size_t(0));
+
+  while (remaining.size() > 3)
+  {
+    const size_t n = remaining.size();
+    size_t tip     = 0;
+    for (size_t k = 0; k < n; ++k)
+    {
+      const size_t a = remaining[(k + n - 1) % n];
+      const size_t b = remaining[k];
+      const size_t c = remaining[(k + 1) % n];
+      if (cross(p[a], p[b], p[c]) * sign <= 0.0)
+      {
+        continue;
+      }
+      bool ear = true;
+      for (size_t j = 0; j < n && ear; ++j)
+      {
+        const size_t other = remaining[j];
+        ear = other == a || other == b || other == c
+              || !insideTriangle(p[other], p[a], p[b], p[c], sign);
+      }
+      if (ear)
+      {
+        tip = k;
+        break;
+      }
+    }
+
+    *out++ = first[remaining[(tip + n - 1) % n]];
+    *out++ = first[remaining[tip]];
+    *out++ = first[remaining[(tip + 1) % n]];
+    remaining.erase(remaining.begin() + tip);
+  }
+
+  *out++ = first[remaining[0]];
+  *out++ = first[remaining[1]];
+  *out++ = first[remaining[2]];
+  return out;
+}
+
+//------------------------------------------------------------------------------
+// Writes the triangles of one face with three or more corners to out and
+// returns the end of what was written
+template <typename Data, typename Corner>
+Corner*
+triangulateFace(
+  const Data& data,
+  const Corner* first,
+  const Corner* last,
+  const TriangulateOptions& options,
+  TriangulateScratch& scratch,
+  Corner* out)
+{
+  const size_t n = last - first;
+  if (n == 3)
+  {
+    return std::copy(first, last, out);
+  }
+
+  std::vector<VertexPosition>& v = scratch.positions;
+  v.resize(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    if (!cornerPosition(data, first[i], v[i]))
+    {
+      return fanFace(first, last, out);
+    }
+  }
+
+  // Newell's normal, whose length is twice the area of the face, and the
+  // centre of the face
+  double nx = 0.0, ny = 0.0, nz = 0.0;
+  double cx = 0.0, cy = 0.0, cz = 0.0;
+  for (size_t i = 0, prev = n - 1; i < n; prev = i++)
+  {
+    const VertexPosition& a = v[prev];
+    const VertexPosition& b = v[i];
+    nx += double(a.y - b.y) * (a.z + b.z);
+    ny += double(a.z - b.z) * (a.x + b.x);
+    nz += double(a.x - b.x) * (a.y + b.y);
+    cx += a.x;
+    cy += a.y;
+    cz += a.z;
+  }
+  const double lengthSq = nx * nx + ny * ny + nz * nz;
+  if (lengthSq == 0.0)
+  {
+    return fanFace(first, last, out);
+  }
+  cx /= n;
+  cy /= n;
+  cz /= n;
+
+  // Planar if no corner is further from the plane through the centre than
+  // the tolerance times the largest distance from the centre. Convex if every
+  // corner turns the way of the normal. Both are compared unnormalised.
+  double sizeSq     = 0.0;
+  double distanceSq = 0.0;
+  bool convex       = true;
+  for (size_t i = 0, prev = n - 1; i < n; prev = i++)
+  {
+    const VertexPosition& a = v[prev];
+    const VertexPosition& b = v[i];
+    const VertexPosition& c = v[(i + 1 < n) ? i + 1 : 0];
+    const double dx         = b.x - cx;
+    const double dy         = b.y - cy;
+    const double dz         = b.z - cz;
+    const double along      = dx * nx + dy * ny + dz * nz;
+    sizeSq                  = std::max(sizeSq, dx * dx + dy * dy + dz * dz);
+    distanceSq              = std::max(distanceSq, along * along);
+
+    const double ux   = double(b.x) - a.x;
+    const double uy   = double(b.y) - a.y;
+    const double uz   = double(b.z) - a.z;
+    const double wx   = double(c.x) - b.x;
+    const double wy   = double(c.y) - b.y;
+    const double wz   = double(c.z) - b.z;
+    const double turn = (uy * wz - uz * wy) * nx + (uz * wx - ux * wz) * ny
+                        + (ux * wy - uy * wx) * nz;
+    convex            = convex && turn >= 0.0;
+  }
+  const double tolerance = options.planarTolerance;
+  if (convex && distanceSq <= tolerance * tolerance * sizeSq * lengthSq)
+  {
+    return fanFace(first, last, out);
+  }
+
+  // Drop the axis the normal is closest to. The face then turns the way of
+  // that normal component in the remaining two.
+  const double ax    = std::abs(nx), ay = std::abs(ny), az = std::abs(nz);
+  const int drop     = (az >= ax && az >= ay) ? 2 : (ax >= ay) ? 0 : 1;
+  const double along = (drop == 2) ? nz : (drop == 0) ? nx : ny;
+  const double sign  = (along > 0.0) ? 1.0 : -1.0;
+
+  std::vector<Point2>& p = scratch.points;
+  p.resize(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    p[i] = (drop == 2)   ? Point2{v[i].x, v[i].y}
+           : (drop == 0) ? Point2{v[i].y, v[i].z}
+                         : Point2{v[i].z, v[i].x};
+  }
+  return clipEars(first, scratch, sign, out);
+}
+
+//------------------------------------------------------------------------------
+inline size_t
+triangleCount(size_t arity)
+{
+  return (arity >= 3) ? arity - 2 : 0;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// Works on ObjAggregate, ObjFlatAggregate, ObjSoaAggregate,
+// ObjResolvedAggregate and ObjSelectedAggregate. The corners returned are of
+// the type the aggregate stores faces with.
+template <typename Data>
+std::vector<detail::FaceCorner<Data>>
+triangulate(const Data& data, const TriangulateOptions& options = {})
+{
+  using Corner = detail::FaceCorner<Data>;
+
+  const size_t faces = detail::faceCount(data);
+  const size_t ranges
+    = rangeCount(faces, options.threadCount, options.minFacesPerThread);
+  auto rangeBegin = [&](size_t range) { return faces * range / ranges; };
+
+  // Triangles before each range
+  std::vector<size_t> offsets(ranges + 1, 0);
+  parallelFor(ranges, unsigned(ranges), [&](size_t range) {
+    size_t count = 0;
+    for (size_t face = rangeBegin(range); face < rangeBegin(range + 1); ++face)
+    {
+      const auto corners = detail::faceRange(data, face);
+      count += detail::triangleCount(corners.second - corners.first);
+    }
+    offsets[range + 1] = count;
+  });
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  std::vector<Corner> triangles(3 * offsets.back());
+  parallelFor(ranges, unsigned(ranges), [&](size_t range) {
+    detail::TriangulateScratch scratch;
+    Corner* out = triangles.data() + 3 * offsets[range];
+    for (size_t face = rangeBegin(range); face < rangeBegin(range + 1); ++face)
+    {
+      const auto corners = detail::faceRange(data, face);
+      if (corners.second - corners.first >= 3)
+      {
+        out = detail::triangulateFace(
+          data, corners.first, corners.second, options, scratch, out);
+      }
+    }
+  });
+  return triangles;
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -0,0 +1,413 @@
+#pragma once
+
+#include "ObjParser.h"
+#include "Triangulate.h"
+
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Unified vertex and index buffers
+//
+// OBJ faces index positions, texture coordinates and normals separately, but a
+// GPU fetches every attribute of a vertex through one index. buildUnifiedMesh()
+// triangulates the faces of an aggregate and gives each distinct (v, vt, vn)
+// combination one interleaved vertex, with a 32-bit index per triangle corner.
+// Vertices are numbered in the order their combination first appears, so the
+// result is the same for any thread count.
+//
+// Combinations are matched in open-addressing hash tables. The corners are
+// first distributed over shards by hash, so that each shard can be matched on
+// its own thread. The first corner of each combination is then numbered with
+// a prefix sum over the corners, and every other corner takes its number.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+// Attributes a corner has no index for are zero
+struct UnifiedVertex
+{
+  float position[3];
+  float normal[3];
+  float texCoord[2];
+};
+
+//------------------------------------------------------------------------------
+// The bitangent is sign * cross(normal, tangent)
+struct UnifiedTangent
+{
+  float tangent[3];
+  float sign;
+};
+
+//------------------------------------------------------------------------------
+struct ObjUnifiedMesh
+{
+  std::vector<UnifiedVertex> vertices;
+  std::vector<uint32_t> indices;           // three per triangle
+  std::vector<UnifiedTangent> tangents;    // one per vertex, if generated
+};
+
+//------------------------------------------------------------------------------
+struct UnifyOptions
+{
+  // Zero uses every hardware core
+  unsigned threadCount = 1;
+
+  // Corners are never split into ranges smaller than this
+  size_t minCornersPerThread = 1 << 16;
+
+  // Used by buildUnifiedMesh(), whose threadCount overrides the one here
+  TriangulateOptions triangulate;
+};
+
+//------------------------------------------------------------------------------
+namespace detail
+{
+//------------------------------------------------------------------------------
+// The zero-based element indices of a corner, ABSENT for missing ones
+struct CornerKey
+{
+  uint32_t vertex;
+  uint32_t uv;
+  uint32_t normal;
+
+  friend bool operator==(const CornerKey& lhs, const CornerKey& rhs)
+  {
+    return lhs.vertex == rhs.vertex && lhs.uv == rhs.uv
+           && lhs.normal == rhs.normal;
+  }
+};
+
+//------------------------------------------------------------------------------
+// A FaceTriplet index, where zero means none. Relative indices can no longer
+// be resolved once the parse is over. The range is checked before the index
+// is made zero-based, as one less than INT_MIN overflows.
+inline bool
+keyIndex(int index, size_t count, uint32_t& key)
+{
+  if (index == 0)
+  {
+    key = ResolvedCorner::ABSENT;
+    return true;
+  }
+  if (index < 0 || size_t(index) > count)
+  {
+    return false;
+  }
+  key = uint32_t(index - 1);
+  return true;
+}
+
+// A ResolvedCorner index
+inline bool
+keyIndex(uint32_t index, size_t count, uint32_t& key)
+{
+  key = index;
+  return index == ResolvedCorner::ABSENT || index < count;
+}
+
+//------------------------------------------------------------------------------
+// False if the corner refers to an element that does not exist
+template <typename Data, typename Corner>
+bool
+cornerKey(const Data& data, const Corner& corner, CornerKey& key)
+{
+  return keyIndex(corner.vertexIndex, data.positions.size(), key.vertex)
+         && key.vertex != ResolvedCorner::ABSENT
+         && keyIndex(corner.uvIndex, data.texCoords.size(), key.uv)
+         && keyIndex(corner.normalIndex, data.normals.size(), key.normal);
+}
+
+//------------------------------------------------------------------------------
+// splitmix64's finaliser over the packed key. The top bits pick the shard and
+// the bottom ones the slot within it.
+inline uint64_t
+hashKey(const CornerKey& key)
+{
+  uint64_t h = (uint64_t(key.uv) << 32 | key.vertex)
+               ^ (uint64_t(key.normal) * 0x9e3779b97f4a7c15ull);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return h ^ (h >> 31);
+}
+
+//------------------------------------------------------------------------------
+template <typename Data>
+UnifiedVertex
+unifiedVertex(const Data& data, const CornerKey& key)
+{
+  UnifiedVertex vertex   = {};
+  const VertexPosition p = data.positions[key.vertex];
+  vertex.position[0]     = p.x;
+  vertex.position[1]     = p.y;
+  vertex.position[2]     = p.z;
+  if (key.normal != ResolvedCorner::ABSENT)
+  {
+    const VertexNormal n = data.normals[key.normal];
+    vertex.normal[0]     = n.i;
+    vertex.normal[1]     = n.j;
+    vertex.normal[2]     = n.k;
+  }
+  if (key.uv != ResolvedCorner::ABSENT)
+  {
+    const VertexTextureCoordinate uv = data.texCoords[key.uv];
+    vertex.texCoord[0]               = uv.u;
+    vertex.texCoord[1]               = uv.v;
+  }
+  return vertex;
+}
+
+//------------------------------------------------------------------------------
+struct CornerSlot
+{
+  static constexpr uint32_t EMPTY = ResolvedCorner::ABSENT;
+
+  CornerKey key;
+  uint32_t corner = EMPTY;
+};
+
+//------------------------------------------------------------------------------
+// Linear probing table of the first corner of each key, kept at most half full
+class CornerTable
+{
+public:
+  // Triangle meshes typically have about six corners per distinct vertex
+  explicit CornerTable(size_t corners)
+  {
+    size_t capacity = 64;
+    while (capacity < corners / 3)
+    {
+      capacity *= 2;
+    }
+    m_slots.resize(capacity);
+  }
+
+  // The first corner with key, which becomes corner if there was none
+  uint32_t insert(const CornerKey& key, uint32_t corner)
+  {
+    const size_t mask = m_slots.size() - 1;
+    for (size_t slot = hashKey(key) & mask;; slot = (slot + 1) & mask)
+    {
+      CornerSlot& entry = m_slots[slot];
+      if (entry.corner == CornerSlot::EMPTY)
+      {
+        entry.key    = key;
+        entry.corner = corner;
+        if (2 * ++m_size > m_slots.size())
+        {
+          grow();
+        }
+        return corner;
+      }
+      if (entry.key == key)
+      {
+        return entry.corner;
+      }
+    }
+  }
+
+private:
+  void grow()
+  {
+    std::vector<CornerSlot> slots(2 * m_slots.size());
+    const size_t mask = slots.size() - 1;
+    for (const CornerSlot& entry : m_slots)
+    {
+      if (entry.corner != CornerSlot::EMPTY)
+      {
+        size_t slot = hashKey(entry.key) & mask;
+        while (slots[slot].corner != CornerSlot::EMPTY)
+        {
+          slot = (slot + 1) & mask;
+        }
+        slots[slot] = entry;
+      }
+    }
+    m_slots.swap(slots);
+  }
+
+  std::vector<CornerSlot> m_slots;
+  size_t m_size = 0;
+};
+
+//------------------------------------------------------------------------------
+// Sets first[c] to the lowest corner with the same key as corner c, for the
+// corners of one shard in ascending order
+template <typename CornerAt>
+void
+matchShard(
+  const std::vector<CornerKey>& keys,
+  size_t count,
+  CornerAt cornerAt,
+  std::vector<uint32_t>& first)
+{
+  CornerTable table(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    const uint32_t corner = cornerAt(i);
+    first[corner]         = table.insert(keys[corner], corner);
+  }
+}
+
+//------------------------------------------------------------------------------
+}    // namespace detail
+
+//------------------------------------------------------------------------------
+// One unified vertex per distinct combination in corners, and the index of
+// its vertex for every corner. Works with the corner types of ObjAggregate,
+// ObjFlatAggregate, ObjSoaAggregate and ObjResolvedAggregate. Fails if a
+// corner refers to an element data does not have, or uses a relative index
+// (parse with parseAsResolvedAggregate() to keep those).
+template <typename Data, typename Corner>
+std::optional<ObjUnifiedMesh>
+unifyVertices(
+  const Data& data,
+  const std::vector<Corner>& corners,
+  const UnifyOptions& options = {})
+{
+  const size_t count = corners.size();
+  if (count >= ResolvedCorner::ABSENT)
+  {
+    LOG_ERROR("Too many corners for 32-bit indices: %zu", count);
+    return std::nullopt;
+  }
+
+  const size_t ranges
+    = rangeCount(count, options.threadCount, options.minCornersPerThread);
+  const unsigned threads = unsigned(ranges);
+  auto rangeBegin = [&](size_t range) { return count * range / ranges; };
+
+  // A few shards per thread, so that uneven shards still balance
+  int shardBits = 0;
+  while (ranges > 1 && (size_t(1) << shardBits) < 4 * ranges)
+  {
+    ++shardBits;
+  }
+  const size_t shards = size_t(1) << shardBits;
+  auto shardOf        = [&](const detail::CornerKey& key) {
+    return shardBits ? size_t(detail::hashKey(key) >> (64 - shardBits)) : 0;
+  };
+
+  // Keys of every corner, and how many of each range go to each shard
+  std::vector<detail::CornerKey> keys(count);
+  std::vector<size_t> shardCounts(ranges * shards, 0);
+  std::vector<size_t> badCorner(ranges, count);
+  parallelFor(ranges, threads, [&](size_t range) {
+    size_t* rangeCounts = shardCounts.data() + range * shards;
+    for (size_t c = rangeBegin(range); c < rangeBegin(range + 1); ++c)
+    {
+      if (!detail::cornerKey(data, corners[c], keys[c]))
+      {
+        badCorner[range] = c;
+        return;
+      }
+      ++rangeCounts[shardOf(keys[c])];
+    }
+  });
+  for (size_t bad : badCorner)
+  {
+    if (bad != count)
+    {
+      LOG_ERROR("Corner %zu refers to an element that does not exist", bad);
+      return std::nullopt;
+    }
+  }
+
+  // Match the corners of each shard, which a single shard can do in place
+  std::vector<uint32_t> first(count);
+  if (shards == 1)
+  {
+    detail::matchShard(
+      keys, count, [](size_t i) { return uint32_t(i); }, first);
+  }
+  else
+  {
+    // Shard-major offsets, so that each shard lists its corners in order
+    std::vector<size_t> offsets(ranges * shards + 1, 0);
+    for (size_t shard = 0, i = 0; shard < shards; ++shard)
+    {
+      for (size_t range = 0; range < ranges; ++range, ++i)
+      {
+        offsets[i + 1] = offsets[i] + shardCounts[range * shards + shard];
+      }
+    }
+
+    std::vector<uint32_t> shardCorners(count);
+    parallelFor(ranges, threads, [&](size_t range) {
+      std::vector<size_t> cursor(shards);
+      for (size_t shard = 0; shard < shards; ++shard)
+      {
+        cursor[shard] = offsets[shard * ranges + range];
+      }
+      for (size_t c = rangeBegin(range); c < rangeBegin(range + 1); ++c)
+      {
+        shardCorners[cursor[shardOf(keys[c])]++] = uint32_t(c);
+      }
+    });
+
+    parallelFor(shards, threads, [&](size_t shard) {
+      const uint32_t* begin = shardCorners.data() + offsets[shard * ranges];
+      const size_t size
+        = offsets[(shard + 1) * ranges] - offsets[shard * ranges];
+      detail::matchShard(
+        keys, size, [begin](size_t i) { return begin[i]; }, first);
+    });
+  }
+
+  // Number the first corner of each combination in corner order and build
+  // its vertex, then point every other corner at that
+  std::vector<size_t> vertexOffsets(ranges + 1, 0);
+  parallelFor(ranges, threads, [&](size_t range) {
+    size_t vertices = 0;
+    for (size_t c = rangeBegin(range); c < rangeBegin(range + 1); ++c)
+    {
+      vertices += (first[c] == c);
+    }
+    vertexOffsets[range + 1] = vertices;
+  });
+  std::partial_sum(
+    vertexOffsets.begin(), vertexOffsets.end(), vertexOffsets.begin());
+
+  ObjUnifiedMesh mesh;
+  mesh.vertices.resize(vertexOffsets.back());
+  mesh.indices.resize(count);
+  parallelFor(ranges, threads, [&](size_t range) {
+    uint32_t vertex = uint32_t(vertexOffsets[range]);
+    for (size_t c = rangeBegin(range); c < rangeBegin(range + 1); ++c)
+    {
+      if (first[c] == c)
+      {
+        mesh.vertices[vertex] = detail::unifiedVertex(data, keys[c]);
+        mesh.indices[c]       = vertex++;
+      }
+    }
+  });
+  parallelFor(ranges, threads, [&](size_t range) {
+    for (size_t c = rangeBegin(range); c < rangeBegin(range + 1); ++c)
+    {
+      if (first[c] != c)
+      {
+        mesh.indices[c] = mesh.indices[first[c]];
+      }
+    }
+  });
+  return mesh;
+}
+
+//------------------------------------------------------------------------------
+// Triangulates the faces of data (see Triangulate.h) and unifies the corners
+// of the triangles
+template <typename Data>
+std::optional<ObjUnifiedMesh>
+buildUnifiedMesh(const Data& data, const UnifyOptions& options = {})
+{
+  TriangulateOptions triangulateOptions = options.triangulate;
+  triangulateOptions.threadCount        = options.threadCount;
+  return unifyVertices(data, triangulate(data, triangulateOptions), options);
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
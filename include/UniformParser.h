@@ -0,0 +1,593 @@
+#pragma once
+
+#include "ObjParser.h"
+
+#include <array>
+
+//------------------------------------------------------------------------------
+// Uniform file fast path
+//
+// Most exported meshes are uniform: every v has three coordinates and every
+// face has the same number of corners, all in the same form (v, v/vt, v//vn
+// or v/vt/vn). For such files the face form and arity are sampled from the
+// first few KB of faces, and every line is then parsed by code specialised
+// for exactly that layout: faces are read into fixed-size records by an
+// unrolled loop with no per-corner form detection, and no rules, attributes
+// or Face vectors are involved until the record is stored.
+//
+// The fast path only ever accepts lines the grammar accepts, with the same
+// values. A line it does not accept (a comment, a directive, a w coordinate,
+// a face of another shape, blanks where it expects none, ...) is handed to the
+// wrapped grammar from that point, and the fast path resumes on the following
+// line. If it then fails straight away again, the grammar is given twice as
+// many lines each time, so a file that is not uniform after all costs little
+// more than parsing it with the grammar alone.
+//
+// UniformParser<Parser> stands in for a grammar type like ObjScanner does.
+// It is selected with ParseOptions::uniform.
+//------------------------------------------------------------------------------
+namespace ObjParser
+{
+//------------------------------------------------------------------------------
+namespace uniform
+{
+//------------------------------------------------------------------------------
+enum class FaceForm
+{
+  Unknown,    // no face sampled yet
+  Mixed,      // faces differ, or have an arity without a specialisation
+  V,
+  VT,
+  VN,
+  VTN,
+};
+
+struct FaceLayout
+{
+  FaceForm form  = FaceForm::Unknown;
+  unsigned arity = 0;
+};
+
+//------------------------------------------------------------------------------
+// Faces in the first SAMPLE_SIZE bytes from first decide the layout: the
+// first face sets it and every other face must match. Lines are not checked
+// any further; the fast path does that as it goes.
+inline FaceLayout
+sampleFaceLayout(const char* first, const char* last)
+{
+  static const size_t SAMPLE_SIZE = 4096;
+
+  const char* sampleEnd = first + std::min<size_t>(last - first, SAMPLE_SIZE);
+  FaceLayout layout;
+  for (const char* line = first; line < sampleEnd;)
+  {
+    const char* eol = std::find(line, last, '\n');
+    if (line + 1 < eol && line[0] == 'f' && isBlank(line[1]))
+    {
+      FaceLayout face;
+      for (const char* c = line + 1; c != eol;)
+      {
+        while (c != eol && (isBlank(*c) || *c == '\r'))
+        {
+          ++c;
+        }
+        if (c == eol)
+        {
+          break;
+        }
+        const char* token = c;
+        while (c != eol && !isBlank(*c) && *c != '\r')
+        {
+          ++c;
+        }
+        const char* slash = std::find(token, c, '/');
+        FaceForm form     = FaceForm::VTN;
+        if (slash == c)
+        {
+          form = FaceForm::V;
+        }
+        else if (slash + 1 != c && slash[1] == '/')
+        {
+          form = FaceForm::VN;
+        }
+        else if (std::find(slash + 1, c, '/') == c)
+        {
+          form = FaceForm::VT;
+        }
+        face.form = (face.arity == 0 || face.form == form) ? form
+                                                           : FaceForm::Mixed;
+        ++face.arity;
+      }
+
+      if (layout.form == FaceForm::Unknown)
+      {
+        layout = face;
+      }
+      if (
+        face.form == FaceForm::Mixed || face.form != layout.form
+        || face.arity != layout.arity || (face.arity != 3 && face.arity != 4))
+      {
+        return {FaceForm::Mixed, 0};
+      }
+    }
+    line = (eol == last) ? last : eol + 1;
+  }
+  return layout;
+}
+
+//------------------------------------------------------------------------------
+// Storing elements in each output type. Storing a face fails if its indices
+// cannot be resolved, which leaves the line to the grammar.
+inline void
+store(ObjVariantVec& data, const VertexPosition& v)
+{
+  data.emplace_back(v);
+}
+
+inline void
+store(ObjVariantVec& data, const VertexNormal& n)
+{
+  data.emplace_back(n);
+}
+
+inline void
+store(ObjVariantVec& data, const VertexTextureCoordinate& uv)
+{
+  data.emplace_back(uv);
+}
+
+template <size_t ARITY>
+bool
+store(ObjVariantVec& data, const std::array<FaceTriplet, ARITY>& face)
+{
+  data.emplace_back(Face(face.begin(), face.end()));
+  return true;
+}
+
+template <typename Data>
+void
+store(Data& data, const VertexPosition& v)
+{
+  if constexpr (std::is_same_v<Data, ObjSoaAggregate>)
+  {
+    AppendToArrays()(data.positions, v);
+  }
+  else
+  {
+    data.positions.push_back(v);
+  }
+}
+
+template <typename Data>
+void
+store(Data& data, const VertexNormal& n)
+{
+  if constexpr (std::is_same_v<Data, ObjSoaAggregate>)
+  {
+    AppendToArrays()(data.normals, n);
+  }
+  else
+  {
+    data.normals.push_back(n);
+  }
+}
+
+template <typename Data>
+void
+store(Data& data, const VertexTextureCoordinate& uv)
+{
+  if constexpr (std::is_same_v<Data, ObjSoaAggregate>)
+  {
+    AppendToArrays()(data.texCoords, uv);
+  }
+  else
+  {
+    data.texCoords.push_back(uv);
+  }
+}
+
+template <typename Data, size_t ARITY>
+bool
+store(Data& data, const std::array<FaceTriplet, ARITY>& face)
+{
+  if constexpr (std::is_same_v<Data, ObjAggregate>)
+  {
+    data.faces.emplace_back(face.begin(), face.end());
+  }
+  else
+  {
+    data.faceCorners.insert(data.faceCorners.end(), face.begin(), face.end());
+    data.faceOffsets.push_back(data.faceCorners.size());
+  }
+  return true;
+}
+
+template <size_t ARITY>
+bool
+store(ObjResolvedAggregate& data, const std::array<FaceTriplet, ARITY>& face)
+{
+  std::array<ResolvedCorner, ARITY> resolved;
+  for (size_t i = 0; i < ARITY; ++i)
+  {
+    if (!resolveCorner(data, face[i], resolved[i]))
+    {
+      return false;
+    }
+  }
+  data.faceCorners.insert(
+    data.faceCorners.end(), resolved.begin(), resolved.end());
+  data.faceOffsets.push_back(data.faceCorners.size());
+  return true;
+}
+
+// Lines of element types that are not selected are cheap enough to parse on
+// this path, so they are parsed and dropped rather than skipped
+template <Attributes MASK>
+void
+store(ObjSelectedAggregate<MASK>& data, const VertexPosition& v)
+{
+  storeSelected(data, v);
+}
+
+template <Attributes MASK>
+void
+store(ObjSelectedAggregate<MASK>& data, const VertexNormal& n)
+{
+  storeSelected(data, n);
+}
+
+template <Attributes MASK>
+void
+store(ObjSelectedAggregate<MASK>& data, const VertexTextureCoordinate& uv)
+{
+  storeSelected(data, uv);
+}
+
+template <Attributes MASK, size_t ARITY>
+bool
+store(
+  ObjSelectedAggregate<MASK>& data, const std::array<FaceTriplet, ARITY>& face)
+{
+  storeSelectedFace(data, face);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Like the scanner, the functions below only advance c when they succeed.
+// Unlike it, they accept just the common spelling of each element, failing
+// on anything else rather than trying alternatives.
+inline bool
+lineEnd(const char*& c, const char* last)
+{
+  const char* it = c;
+  while (it != last && isBlank(*it))
+  {
+    ++it;
+  }
+  if (it != last)
+  {
+    if (*it == '\n')
+    {
+      ++it;
+    }
+    else if (*it == '\r' && it + 1 != last && it[1] == '\n')
+    {
+      it += 2;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+number(const char*& c, const char* last, float& value)
+{
+  const char* it = c;
+  while (it != last && isBlank(*it))
+  {
+    ++it;
+  }
+  if (!parseFloat(it, last, value))
+  {
+    return false;
+  }
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// At most 9 digits, so there is never an overflow to check for
+inline bool
+index(const char*& c, const char* last, int& value)
+{
+  const char* it      = c;
+  const bool negative = (it != last && *it == '-');
+  it += negative ? 1 : 0;
+
+  const char* digits = it;
+  int magnitude      = 0;
+  for (; it != last && detail::isDigit(*it) && it - digits < 9; ++it)
+  {
+    magnitude = magnitude * 10 + (*it - '0');
+  }
+  if (it == digits || (it != last && detail::isDigit(*it)))
+  {
+    return false;
+  }
+  value = negative ? -magnitude : magnitude;
+  c     = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline bool
+slash(const char*& c, const char* last)
+{
+  if (c == last || *c != '/')
+  {
+    return false;
+  }
+  ++c;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// One corner in exactly the given form, which must end the token
+template <FaceForm FORM>
+bool
+corner(const char*& c, const char* last, FaceTriplet& corner)
+{
+  const char* it = c;
+  bool ok        = index(it, last, corner.vertexIndex);
+  if constexpr (FORM == FaceForm::VT || FORM == FaceForm::VTN)
+  {
+    ok = ok && slash(it, last) && index(it, last, corner.uvIndex);
+  }
+  if constexpr (FORM == FaceForm::VN)
+  {
+    ok = ok && slash(it, last);
+  }
+  if constexpr (FORM == FaceForm::VN || FORM == FaceForm::VTN)
+  {
+    ok = ok && slash(it, last) && index(it, last, corner.normalIndex);
+  }
+  // The grammar would carry on past a '/' or blanks and a '/'
+  if (!ok || (it != last && !isBlank(*it) && *it != '\r' && *it != '\n'))
+  {
+    return false;
+  }
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Data>
+bool
+position(const char*& c, const char* last, Data& data)
+{
+  const char* it = c;
+  VertexPosition v;
+  if (
+    !number(it, last, v.x) || !number(it, last, v.y) || !number(it, last, v.z)
+    || !lineEnd(it, last))
+  {
+    return false;
+  }
+  store(data, v);
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Data>
+bool
+normal(const char*& c, const char* last, Data& data)
+{
+  const char* it = c;
+  VertexNormal n;
+  if (
+    !number(it, last, n.i) || !number(it, last, n.j) || !number(it, last, n.k)
+    || !lineEnd(it, last))
+  {
+    return false;
+  }
+  store(data, n);
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// One to three coordinates, as in the grammar
+template <typename Data>
+bool
+texCoord(const char*& c, const char* last, Data& data)
+{
+  const char* it = c;
+  VertexTextureCoordinate uv;
+  if (!number(it, last, uv.u))
+  {
+    return false;
+  }
+  if (number(it, last, uv.v))
+  {
+    number(it, last, uv.w);
+  }
+  if (!lineEnd(it, last))
+  {
+    return false;
+  }
+  store(data, uv);
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template <FaceForm FORM, unsigned ARITY, typename Data>
+bool
+face(const char*& c, const char* last, Data& data)
+{
+  const char* it = c;
+  std::array<FaceTriplet, ARITY> record;
+  for (unsigned i = 0; i < ARITY; ++i)
+  {
+    while (it != last && isBlank(*it))
+    {
+      ++it;
+    }
+    if (!corner<FORM>(it, last, record[i]))
+    {
+      return false;
+    }
+  }
+  if (!lineEnd(it, last) || !store(data, record))
+  {
+    return false;
+  }
+  c = it;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Parses lines from first for as long as they fit the layout, leaving first
+// at the start of the first line that does not
+template <FaceForm FORM, unsigned ARITY, typename Data>
+void
+parseLines(const char*& first, const char* last, Data& data)
+{
+  const char* c = first;
+  while (last - c >= 2)
+  {
+    const char* line = c;
+    bool ok          = false;
+    if (c[0] == 'v')
+    {
+      if (isBlank(c[1]))
+      {
+        ok = position(++c, last, data);
+      }
+      else if (last - c >= 3 && isBlank(c[2]))
+      {
+        ok = (c[1] == 'n')   ? normal(c += 2, last, data)
+             : (c[1] == 't') ? texCoord(c += 2, last, data)
+                             : false;
+      }
+    }
+    else if constexpr (ARITY != 0)
+    {
+      ok = c[0] == 'f' && isBlank(c[1]) && face<FORM, ARITY>(++c, last, data);
+    }
+
+    if (!ok)
+    {
+      c = line;
+      break;
+    }
+  }
+  first = c;
+}
+
+//------------------------------------------------------------------------------
+// parseLines() for a layout only known at run time
+template <unsigned ARITY, typename Data>
+void
+parseLines(FaceForm form, const char*& first, const char* last, Data& data)
+{
+  switch (form)
+  {
+  case FaceForm::V: parseLines<FaceForm::V, ARITY>(first, last, data); break;
+  case FaceForm::VT: parseLines<FaceForm::VT, ARITY>(first, last, data); break;
+  case FaceForm::VN: parseLines<FaceForm::VN, ARITY>(first, last, data); break;
+  case FaceForm::VTN:
+    parseLines<FaceForm::VTN, ARITY>(first, last, data);
+    break;
+  default: parseLines<FaceForm::Mixed, 0>(first, last, data); break;
+  }
+}
+
+template <typename Data>
+void
+parseLines(
+  const FaceLayout& layout, const char*& first, const char* last, Data& data)
+{
+  switch (layout.arity)
+  {
+  case 3: parseLines<3>(layout.form, first, last, data); break;
+  case 4: parseLines<4>(layout.form, first, last, data); break;
+  default: parseLines<FaceForm::Mixed, 0>(first, last, data); break;
+  }
+}
+
+//------------------------------------------------------------------------------
+}    // namespace uniform
+
+//------------------------------------------------------------------------------
+// Stateless handle selecting the fast path in front of Parser
+template <typename Parser>
+struct UniformParser
+{
+};
+
+//------------------------------------------------------------------------------
+// Overload of the Qi tryParseObj, with the same contract. Failures come from
+// the wrapped parser, so they are reported exactly as without the fast path.
+template <typename Parser, typename Data>
+const char*
+tryParseObj(
+  const UniformParser<Parser>&,
+  const char*& first,
+  const char* last,
+  Data& data,
+  const LineIndex* index = nullptr)
+{
+  try
+  {
+    uniform::FaceLayout layout = uniform::sampleFaceLayout(first, last);
+    size_t fallbackLines       = 1;
+    for (;;)
+    {
+      const char* start = first;
+      uniform::parseLines(layout, first, last, data);
+      if (first == last)
+      {
+        return nullptr;
+      }
+
+      // Files commonly hold all their vertices first, so faces may only be
+      // sampled once the first one is reached
+      if (layout.form == uniform::FaceForm::Unknown && *first == 'f')
+      {
+        layout = uniform::sampleFaceLayout(first, last);
+        layout.form
+          = (layout.arity == 0) ? uniform::FaceForm::Mixed : layout.form;
+        continue;
+      }
+
+      fallbackLines = (first == start) ? fallbackLines * 2 : 1;
+      const char* fallbackEnd = first;
+      for (size_t i = 0; i < fallbackLines && fallbackEnd != last; ++i)
+      {
+        fallbackEnd = std::find(fallbackEnd, last, '\n');
+        fallbackEnd += (fallbackEnd != last) ? 1 : 0;
+      }
+      const char* failure
+        = tryParseObj<Parser>(first, fallbackEnd, data, index);
+      if (failure)
+      {
+        return failure;
+      }
+      first = fallbackEnd;
+    }
+  }
+  catch (...)
+  {
+    return "misc exception";
+  }
+}
+
+//------------------------------------------------------------------------------
+}    // namespace ObjParser
@@ -1,9 +1,26 @@
 #include "ObjParser.h"
+#include "ObjParserCallbacks.h"
+#include "ObjCache.h"
+#include "ObjParserX3.h"
+#include "ObjScanner.h"
+#include "Triangulate.h"
+#include "UnifiedMesh.h"
+#include "GenerateNormals.h"
+#include "GenerateTangents.h"
+#include "OptimizeMesh.h"
 
 #include <boost/variant.hpp>
 #include <sstream>
+#include <cstring>
+#include <array>
 #include <chrono>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <cmath>
+#include <random>
 
 #include "log.h"
 #include "fmt/format.h"
@@ -173,10 +190,1775 @@ printTinyObj(
   }
 }
 
+//------------------------------------------------------------------------------
+// Benchmarks
+//------------------------------------------------------------------------------
+static const char* BENCHMARK_FILE = "benchmark_grid.obj";
+static const int BENCHMARK_RUNS   = 5;
+
+//------------------------------------------------------------------------------
+template <typename Func>
+double
+bestTimeMs(Func&& func, int runs = BENCHMARK_RUNS)
+{
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < runs; ++i)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    std::chrono::duration<double, std::milli> elapsed
+      = std::chrono::high_resolution_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+//------------------------------------------------------------------------------
+double
+megabytesPerSecond(size_t bytes, double ms)
+{
+  return (bytes / (1024.0 * 1024.0)) / (ms / 1000.0);
+}
+
+//------------------------------------------------------------------------------
+size_t
+fileSize(const std::string& filename)
+{
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  return in.is_open() ? static_cast<size_t>(in.tellg()) : 0;
+}
+
+//------------------------------------------------------------------------------
+// Writes a gridSize x gridSize triangulated grid using the v/vt/vn face form
+void
+writeGridObj(const std::string& filename, int gridSize)
+{
+  std::ofstream out(filename, std::ios::binary);
+  const int rowLength = gridSize + 1;
+
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      out << fmt::format(
+        "v {:.6f} {:.6f} {:.6f}\n",
+        x / float(gridSize),
+        y / float(gridSize),
+        0.05f * ((x * 7 + y * 13) % 17) / 17.0f);
+    }
+  }
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      out << fmt::format(
+        "vt {:.6f} {:.6f}\n", x / float(gridSize), y / float(gridSize));
+    }
+  }
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      out << "vn 0.000000 0.000000 1.000000\n";
+    }
+  }
+
+  for (int y = 0; y < gridSize; ++y)
+  {
+    for (int x = 0; x < gridSize; ++x)
+    {
+      const int i0 = y * rowLength + x + 1;
+      const int i1 = i0 + 1;
+      const int i2 = i0 + rowLength;
+      const int i3 = i2 + 1;
+      out << fmt::format(
+        "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n", i0, i1, i3);
+      out << fmt::format(
+        "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n", i0, i3, i2);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkFileAccess(const std::string& filename)
+{
+  const size_t bytes = fileSize(filename);
+
+  ObjParser::LoadOptions streamOptions;
+  streamOptions.memoryMap = false;
+  ObjParser::LoadOptions mappedOptions;
+  mappedOptions.memoryMap = true;
+
+  bool ok       = true;
+  double stream = bestTimeMs([&] {
+    ok &= ObjParser::loadAsAggregate(filename, streamOptions).has_value();
+  });
+  double mapped = bestTimeMs([&] {
+    ok &= ObjParser::loadAsAggregate(filename, mappedOptions).has_value();
+  });
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("FILE ACCESS: %s (%zu bytes)", filename.c_str(), bytes);
+  LOG_INFO(
+    "  istream_iterator: %10.3fms %8.2f MB/s",
+    stream,
+    megabytesPerSecond(bytes, stream));
+  LOG_INFO(
+    "  memory mapped:    %10.3fms %8.2f MB/s",
+    mapped,
+    megabytesPerSecond(bytes, mapped));
+  LOG_INFO("  speedup: %.2fx", stream / mapped);
+  LOG_INFO_IF(!ok, "  PARSING FAILED");
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkParallel(const std::string& filename)
+{
+  const size_t bytes        = fileSize(filename);
+  const unsigned maxThreads = ObjParser::resolveThreadCount(0);
+  double singleThreadedTime = 0.0;
+
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("PARALLEL: %s (%zu bytes)", filename.c_str(), bytes);
+  for (unsigned threads : threadCounts)
+  {
+    ObjParser::LoadOptions options;
+    options.threadCount = threads;
+
+    bool ok   = true;
+    double ms = bestTimeMs([&] {
+      ok &= ObjParser::loadAsAggregate(filename, options).has_value();
+    });
+    if (threads == 1)
+    {
+      singleThreadedTime = ms;
+    }
+
+    LOG_INFO(
+      "  %3u threads: %10.3fms %8.2f MB/s  speedup %.2fx%s",
+      threads,
+      ms,
+      megabytesPerSecond(bytes, ms),
+      singleThreadedTime / ms,
+      ok ? "" : "  PARSING FAILED");
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkCallbacks(const std::string& filename)
+{
+  const size_t bytes = fileSize(filename);
+
+  size_t elements = 0;
+  ObjParser::ObjCallbacks callbacks;
+  callbacks.position = [&](auto&) { ++elements; };
+  callbacks.normal   = [&](auto&) { ++elements; };
+  callbacks.texCoord = [&](auto&) { ++elements; };
+  callbacks.face     = [&](auto&) { ++elements; };
+
+  bool ok          = true;
+  double streaming = bestTimeMs([&] {
+    ok &= ObjParser::loadWithCallbacks(filename, callbacks);
+  });
+  double aggregate = bestTimeMs([&] {
+    ok &= ObjParser::loadAsAggregate(filename).has_value();
+  });
+
+  tinyobj::callback_t tinyCallbacks;
+  tinyCallbacks.vertex_cb = [](void* user, float, float, float, float) {
+    ++*static_cast<size_t*>(user);
+  };
+  tinyCallbacks.index_cb = [](void* user, tinyobj::index_t*, int) {
+    ++*static_cast<size_t*>(user);
+  };
+  size_t tinyElements = 0;
+  double tinyobj      = bestTimeMs([&] {
+    std::ifstream in(filename, std::ios::binary);
+    std::string err;
+    ok &= tinyobj::LoadObjWithCallback(
+      in, tinyCallbacks, &tinyElements, nullptr, &err);
+  });
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("CALLBACKS: %s (%zu bytes)", filename.c_str(), bytes);
+  LOG_INFO(
+    "  loadWithCallbacks:   %10.3fms %8.2f MB/s",
+    streaming,
+    megabytesPerSecond(bytes, streaming));
+  LOG_INFO(
+    "  loadAsAggregate:     %10.3fms %8.2f MB/s",
+    aggregate,
+    megabytesPerSecond(bytes, aggregate));
+  LOG_INFO(
+    "  LoadObjWithCallback: %10.3fms %8.2f MB/s",
+    tinyobj,
+    megabytesPerSecond(bytes, tinyobj));
+  LOG_INFO_IF(!ok, "  PARSING FAILED");
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Heap bytes used by / reserved for the face arrays, excluding allocator
+// bookkeeping
+struct FaceStorage
+{
+  size_t faces       = 0;
+  size_t usedBytes   = 0;
+  size_t bytes       = 0;
+  size_t allocations = 0;
+};
+
+//------------------------------------------------------------------------------
+FaceStorage
+measureFaceStorage(const ObjParser::ObjAggregate& data)
+{
+  FaceStorage storage;
+  storage.faces       = data.faces.size();
+  storage.usedBytes   = data.faces.size() * sizeof(ObjParser::Face);
+  storage.bytes       = data.faces.capacity() * sizeof(ObjParser::Face);
+  storage.allocations = 1;
+  for (auto& face : data.faces)
+  {
+    storage.usedBytes += face.size() * sizeof(ObjParser::FaceTriplet);
+    storage.bytes += face.capacity() * sizeof(ObjParser::FaceTriplet);
+    storage.allocations += (face.capacity() != 0) ? 1 : 0;
+  }
+  return storage;
+}
+
+//------------------------------------------------------------------------------
+FaceStorage
+measureFaceStorage(const ObjParser::ObjFlatAggregate& data)
+{
+  FaceStorage storage;
+  storage.faces     = data.faceCount();
+  storage.usedBytes = data.faceCorners.size() * sizeof(ObjParser::FaceTriplet)
+                      + data.faceOffsets.size() * sizeof(size_t);
+  storage.bytes = data.faceCorners.capacity() * sizeof(ObjParser::FaceTriplet)
+                  + data.faceOffsets.capacity() * sizeof(size_t);
+  storage.allocations = 2;
+  return storage;
+}
+
+//------------------------------------------------------------------------------
+template <typename LoadFunc>
+void
+benchmarkFaceLayout(
+  const char* name, const std::string& filename, LoadFunc load)
+{
+  const size_t bytes = fileSize(filename);
+
+  bool ok   = true;
+  double ms = bestTimeMs([&] { ok &= load(filename).has_value(); });
+
+  FaceStorage storage;
+  if (auto data = load(filename))
+  {
+    storage = measureFaceStorage(*data);
+  }
+
+  LOG_INFO(
+    "  %-16s %10.3fms %8.2f MB/s  bytes/face %5.1f used %5.1f reserved"
+    "  %zu allocations%s",
+    name,
+    ms,
+    megabytesPerSecond(bytes, ms),
+    storage.faces ? double(storage.usedBytes) / storage.faces : 0.0,
+    storage.faces ? double(storage.bytes) / storage.faces : 0.0,
+    storage.allocations,
+    ok ? "" : "  PARSING FAILED");
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkFaceStorage(const std::string& filename)
+{
+  LOG_INFO("-------------------------");
+  LOG_INFO(
+    "FACE STORAGE: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+  benchmarkFaceLayout("ObjAggregate", filename, [](auto& file) {
+    return ObjParser::loadAsAggregate(file);
+  });
+  benchmarkFaceLayout("ObjFlatAggregate", filename, [](auto& file) {
+    return ObjParser::loadAsFlatAggregate(file);
+  });
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+size_t
+arrayBytes(const std::vector<T>& array, bool reserved)
+{
+  return (reserved ? array.capacity() : array.size()) * sizeof(T);
+}
+
+//------------------------------------------------------------------------------
+size_t
+arrayBytes(const ObjParser::ObjAggregate& data, bool reserved)
+{
+  size_t bytes = arrayBytes(data.positions, reserved)
+                 + arrayBytes(data.normals, reserved)
+                 + arrayBytes(data.texCoords, reserved)
+                 + arrayBytes(data.faces, reserved);
+  for (auto& face : data.faces)
+  {
+    bytes += arrayBytes(face, reserved);
+  }
+  return bytes;
+}
+
+//------------------------------------------------------------------------------
+size_t
+arrayBytes(const ObjParser::ObjFlatAggregate& data, bool reserved)
+{
+  return arrayBytes(data.positions, reserved)
+         + arrayBytes(data.normals, reserved)
+         + arrayBytes(data.texCoords, reserved)
+         + arrayBytes(data.faceCorners, reserved)
+         + arrayBytes(data.faceOffsets, reserved);
+}
+
+//------------------------------------------------------------------------------
+template <typename LoadFunc>
+void
+benchmarkPresizeLayout(
+  const char* name, const std::string& filename, LoadFunc load)
+{
+  const size_t bytes = fileSize(filename);
+  for (bool presize : {false, true})
+  {
+    ObjParser::LoadOptions options;
+    options.presize = presize;
+
+    bool ok   = true;
+    double ms = bestTimeMs([&] { ok &= load(filename, options).has_value(); });
+
+    size_t used     = 0;
+    size_t reserved = 0;
+    if (auto data = load(filename, options))
+    {
+      used     = arrayBytes(*data, false);
+      reserved = arrayBytes(*data, true);
+    }
+
+    LOG_INFO(
+      "  %-16s presize %-3s %10.3fms %8.2f MB/s  %6.2f MB used %6.2f MB "
+      "reserved%s",
+      name,
+      presize ? "on" : "off",
+      ms,
+      megabytesPerSecond(bytes, ms),
+      used / (1024.0 * 1024.0),
+      reserved / (1024.0 * 1024.0),
+      ok ? "" : "  PARSING FAILED");
+  }
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkPresize(const std::string& filename)
+{
+  LOG_INFO("-------------------------");
+  LOG_INFO("PRESIZE: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+
+  const size_t bytes = fileSize(filename);
+  ObjParser::MappedFile file(filename);
+  ObjParser::ObjCounts counts;
+  double ms = bestTimeMs(
+    [&] { counts = ObjParser::countElements(file.begin(), file.end()); });
+  LOG_INFO(
+    "  countElements pre-pass %10.3fms %8.2f MB/s  %zu faces, %zu corners",
+    ms,
+    megabytesPerSecond(bytes, ms),
+    counts.faces,
+    counts.faceCorners);
+
+  benchmarkPresizeLayout("ObjAggregate", filename, [](auto& file, auto& opt) {
+    return ObjParser::loadAsAggregate(file, opt);
+  });
+  benchmarkPresizeLayout(
+    "ObjFlatAggregate", filename, [](auto& file, auto& opt) {
+      return ObjParser::loadAsFlatAggregate(file, opt);
+    });
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Runs parse(first, last, value) over every number in the buffer, returning
+// the sum so the work cannot be optimised away
+template <typename ParseFunc>
+double
+sumFloats(const std::string& numbers, ParseFunc parse)
+{
+  const char* first = numbers.data();
+  const char* last  = first + numbers.size();
+  double sum        = 0.0;
+  while (first != last)
+  {
+    float value = 0.0f;
+    if (!parse(first, last, value))
+    {
+      return -1.0;
+    }
+    sum += value;
+    ++first;    // separator
+  }
+  return sum;
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkFloats(const std::string& filename)
+{
+  namespace qi = boost::spirit::qi;
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("FLOATS: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+
+  // Only the numbers from the v, vn and vt lines, one space after each
+  std::string numbers;
+  size_t count = 0;
+  {
+    std::ifstream in(filename);
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (line.size() < 2 || line[0] != 'v')
+      {
+        continue;
+      }
+      std::istringstream fields(line);
+      std::string field;
+      fields >> field;
+      while (fields >> field)
+      {
+        numbers += field;
+        numbers += ' ';
+        ++count;
+      }
+    }
+  }
+
+  auto report = [&](const char* name, auto parse) {
+    double sum = 0.0;
+    double ms  = bestTimeMs([&] { sum = sumFloats(numbers, parse); });
+    LOG_INFO(
+      "  %-18s %10.3fms %8.2f MB/s %8.2f ns/float  (sum %.6g)",
+      name,
+      ms,
+      megabytesPerSecond(numbers.size(), ms),
+      ms * 1e6 / std::max<size_t>(1, count),
+      sum);
+  };
+
+  LOG_INFO("  %zu numbers, %zu bytes", count, numbers.size());
+  report("parseFloat", [](const char*& first, const char* last, float& v) {
+    return ObjParser::parseFloat(first, last, v);
+  });
+  report("qi fastFloat", [](const char*& first, const char* last, float& v) {
+    return qi::parse(first, last, ObjParser::fastFloat, v);
+  });
+  report("qi::float_", [](const char*& first, const char* last, float& v) {
+    return qi::parse(first, last, qi::float_, v);
+  });
+  report("qi::double_", [](const char*& first, const char* last, float& v) {
+    double d = 0.0;
+    bool ok  = qi::parse(first, last, qi::double_, d);
+    v        = static_cast<float>(d);
+    return ok;
+  });
+  report("strtof", [](const char*& first, const char*, float& v) {
+    char* end = nullptr;
+    v         = std::strtof(first, &end);
+    bool ok   = (end != first);
+    first     = end;
+    return ok;
+  });
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkCache(const std::string& filename)
+{
+  LOG_INFO("-------------------------");
+  LOG_INFO("CACHE: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+
+  const size_t bytes = fileSize(filename);
+  ObjParser::CacheOptions options;
+  options.cacheDirectory = "benchmark_cache";
+
+  bool ok   = true;
+  double ms = bestTimeMs(
+    [&] { ok &= ObjParser::loadAsFlatAggregate(filename).has_value(); });
+  LOG_INFO(
+    "  text parse:         %10.3fms %8.2f MB/s%s",
+    ms,
+    megabytesPerSecond(bytes, ms),
+    ok ? "" : "  PARSING FAILED");
+
+  // Every cold run starts from an empty cache directory
+  ms = bestTimeMs([&] {
+    std::filesystem::remove_all(options.cacheDirectory);
+    ok &= ObjParser::loadCached(filename, options).has_value();
+  });
+  LOG_INFO(
+    "  cold (parse+write): %10.3fms %8.2f MB/s%s",
+    ms,
+    megabytesPerSecond(bytes, ms),
+    ok ? "" : "  PARSING FAILED");
+
+  bool hit = true;
+  ms       = bestTimeMs([&] {
+    auto data = ObjParser::loadCached(filename, options);
+    hit &= data && data->cacheHit;
+  });
+  LOG_INFO(
+    "  warm (hash+map):    %10.3fms %8.2f MB/s%s",
+    ms,
+    megabytesPerSecond(bytes, ms),
+    hit ? "" : "  CACHE MISSED");
+
+  // Warm loads are bounded below by reading the source once to hash it
+  ObjParser::MappedFile file(filename);
+  uint64_t hash = 0;
+  ms            = bestTimeMs(
+    [&] { hash = ObjParser::cache::hashBytes(file.begin(), file.size()); });
+  LOG_INFO(
+    "  source hash only:   %10.3fms %8.2f MB/s  (%016llx)",
+    ms,
+    megabytesPerSecond(bytes, ms),
+    static_cast<unsigned long long>(hash));
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Many parses of a short snippet, where fixed per-call costs dominate
+void
+benchmarkSmallInputs()
+{
+  namespace qi = boost::spirit::qi;
+
+  using It     = std::string::const_iterator;
+  using Data   = ObjParser::ObjAggregate;
+  using Parser = ObjParser::ObjParserSemanticActions<Data, It>;
+  using Skip   = ObjParser::SkipParser<It>;
+
+  static const std::string SNIPPET = "v 0.1 0.2 0.3\nv 0.4 0.5 0.6\n"
+                                     "v 0.7 0.8 0.9\nvn 0 0 1\nvt 0.5 0.5\n"
+                                     "f 1/1/1 2/1/1 3/1/1\n";
+  static const int PARSES = 10000;
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("SMALL INPUTS: %d parses of %zu bytes", PARSES, SNIPPET.size());
+
+  bool ok      = true;
+  double fresh = bestTimeMs([&] {
+    for (int i = 0; i < PARSES; ++i)
+    {
+      const Parser parser;
+      const Skip skipper;
+      Data data;
+      It first = SNIPPET.begin();
+      ok &= qi::phrase_parse(first, SNIPPET.end(), parser, skipper, data);
+    }
+  });
+  double reused = bestTimeMs([&] {
+    for (int i = 0; i < PARSES; ++i)
+    {
+      ok &= ObjParser::parseAsAggregate(SNIPPET.begin(), SNIPPET.end())
+              .has_value();
+    }
+  });
+  double build = bestTimeMs([&] {
+    for (int i = 0; i < PARSES; ++i)
+    {
+      const Parser parser;
+    }
+  });
+
+  LOG_INFO(
+    "  grammar per call:   %10.3fms %8.2f us/parse%s",
+    fresh,
+    fresh * 1000.0 / PARSES,
+    ok ? "" : "  PARSING FAILED");
+  LOG_INFO(
+    "  thread_local reuse: %10.3fms %8.2f us/parse",
+    reused,
+    reused * 1000.0 / PARSES);
+  LOG_INFO(
+    "  grammar build only: %10.3fms %8.2f us/build",
+    build,
+    build * 1000.0 / PARSES);
+  LOG_INFO("  speedup: %.2fx", fresh / reused);
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Cost of a failed parse, with the bad line near the start and near the end
+void
+benchmarkErrors(const std::string& filename)
+{
+  LOG_INFO("-------------------------");
+  LOG_INFO("ERRORS: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+
+  std::string contents;
+  {
+    std::ifstream in(filename, std::ios::binary);
+    contents.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  const size_t secondLine = contents.find('\n') + 1;
+
+  for (size_t position : {secondLine, contents.size()})
+  {
+    std::string input = contents;
+    input.insert(position, "abc 1 2 3\n");
+
+    ObjParser::ParseError error;
+    ObjParser::ParseOptions options;
+    options.error = &error;
+
+    bool failed = true;
+    double ms   = bestTimeMs([&] {
+      failed &= !ObjParser::parseAsFlatAggregate(
+                   input.data(), input.data() + input.size(), options)
+                   .has_value();
+    });
+    LOG_INFO(
+      "  bad line %-8zu %10.3fms  offset %zu%s",
+      error.line,
+      ms,
+      error.offset,
+      failed ? "" : "  UNEXPECTED SUCCESS");
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Parse rate of files holding a single kind of element, so that the cost of
+// each alternative in the grammar can be seen on its own
+void
+benchmarkElements()
+{
+  static const int LINES = 200000;
+
+  struct ElementFile
+  {
+    const char* name;
+    const char* format;
+  };
+  static const ElementFile FILES[] = {
+    {"v", "v {0}.125 {1}.25 {2}.5\n"},
+    {"vn", "vn 0.{0} 0.{1} 0.{2}\n"},
+    {"vt", "vt 0.{0} 0.{1}\n"},
+    {"f v", "f {0} {1} {2}\n"},
+    {"f v/vt", "f {0}/{0} {1}/{1} {2}/{2}\n"},
+    {"f v//vn", "f {0}//{0} {1}//{1} {2}//{2}\n"},
+    {"f v/vt/vn", "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n"},
+  };
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("ELEMENTS: %d lines of each kind", LINES);
+  for (const auto& file : FILES)
+  {
+    std::string input;
+    for (int i = 1; i <= LINES; ++i)
+    {
+      input += fmt::format(file.format, i, i + 1, i + 2);
+    }
+
+    bool ok   = true;
+    double ms = bestTimeMs([&] {
+      ok &= ObjParser::parseAsFlatAggregate(
+              input.data(), input.data() + input.size(), {})
+              .has_value();
+    });
+    LOG_INFO(
+      "  %-10s %10.3fms %8.1f MB/s %6.1f ns/line%s",
+      file.name,
+      ms,
+      megabytesPerSecond(input.size(), ms),
+      ms * 1e6 / LINES,
+      ok ? "" : "  PARSING FAILED");
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+template <typename QiParser, typename X3Parser, typename Data>
+void
+benchmarkGrammarPair(const char* type, const ObjParser::MappedFile& file)
+{
+  using ObjParser::parseBufferImpl;
+
+  const ObjParser::ParseOptions options;
+  bool ok   = true;
+  double qi = bestTimeMs([&] {
+    ok &= parseBufferImpl<QiParser, Data>(file.begin(), file.end(), options)
+            .has_value();
+  });
+  double x3 = bestTimeMs([&] {
+    ok &= parseBufferImpl<X3Parser, Data>(file.begin(), file.end(), options)
+            .has_value();
+  });
+  LOG_INFO(
+    "  %-16s qi %10.3fms %8.2f MB/s   x3 %10.3fms %8.2f MB/s%s",
+    type,
+    qi,
+    megabytesPerSecond(file.size(), qi),
+    x3,
+    megabytesPerSecond(file.size(), x3),
+    ok ? "" : "  PARSING FAILED");
+}
+
+//------------------------------------------------------------------------------
+// The Qi and X3 grammars on the same mapped buffer, single threaded
+void
+benchmarkX3(const std::string& filename)
+{
+  using namespace ObjParser;
+  using It = const char*;
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("X3: %s (%zu bytes)", filename.c_str(), fileSize(filename));
+
+  MappedFile file(filename);
+  benchmarkGrammarPair<
+    ObjParserVariant<ObjVariantVec, It>,
+    X3Grammar<ObjVariantVec, It>,
+    ObjVariantVec>("ObjVariantVec", file);
+  benchmarkGrammarPair<
+    ObjParserSemanticActions<ObjAggregate, It>,
+    X3Grammar<ObjAggregate, It>,
+    ObjAggregate>("ObjAggregate", file);
+  benchmarkGrammarPair<
+    ObjParserFlatActions<ObjFlatAggregate, It>,
+    X3Grammar<ObjFlatAggregate, It>,
+    ObjFlatAggregate>("ObjFlatAggregate", file);
+  benchmarkGrammarPair<
+    ObjParserSoaActions<ObjSoaAggregate, It>,
+    X3Grammar<ObjSoaAggregate, It>,
+    ObjSoaAggregate>("ObjSoaAggregate", file);
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// The Spirit and scanner backends against tinyobjloader, all single threaded
+void
+benchmarkScanner(const std::string& filename)
+{
+  using namespace ObjParser;
+
+  const size_t bytes = fileSize(filename);
+
+  bool ok       = true;
+  double spirit = bestTimeMs([&] {
+    ok &= loadAsAggregate<SpiritBackend>(filename).has_value();
+  });
+  double scanner = bestTimeMs([&] {
+    ok &= loadAsAggregate<ScannerBackend>(filename).has_value();
+  });
+  double tinyobj = bestTimeMs([&] {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    ok &= loadWithTinyObj(filename, attrib, shapes, materials);
+  });
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("SCANNER: %s (%zu bytes)", filename.c_str(), bytes);
+  LOG_INFO(
+    "  SpiritBackend:  %10.3fms %8.2f MB/s",
+    spirit,
+    megabytesPerSecond(bytes, spirit));
+  LOG_INFO(
+    "  ScannerBackend: %10.3fms %8.2f MB/s",
+    scanner,
+    megabytesPerSecond(bytes, scanner));
+  LOG_INFO(
+    "  tinyobjloader:  %10.3fms %8.2f MB/s",
+    tinyobj,
+    megabytesPerSecond(bytes, tinyobj));
+  LOG_INFO("  speedup over Spirit: %.2fx", spirit / scanner);
+  LOG_INFO_IF(!ok, "  PARSING FAILED");
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Line index throughput of each compiled-in kernel, then the scanner with and
+// without the index
+void
+benchmarkLineIndex(const std::string& filename)
+{
+  using namespace ObjParser;
+
+  MappedFile file(filename);
+  const size_t bytes = file.size();
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("LINE INDEX: %s (%zu bytes)", filename.c_str(), bytes);
+
+  static const std::pair<SimdLevel, const char*> LEVELS[] = {
+    {SimdLevel::Scalar, "scalar"},
+    {SimdLevel::Sse2, "sse2"},
+    {SimdLevel::Avx2, "avx2"},
+  };
+  size_t lines = 0;
+  for (const auto& level : LEVELS)
+  {
+    if (level.first > BEST_SIMD_LEVEL)
+    {
+      LOG_INFO("  %-8s not compiled in", level.second);
+      continue;
+    }
+    double ms = bestTimeMs([&] {
+      lines = buildLineIndex(file.begin(), file.end(), level.first).size();
+    });
+    LOG_INFO(
+      "  %-8s %10.3fms %8.2f GB/s",
+      level.second,
+      ms,
+      megabytesPerSecond(bytes, ms) / 1024.0);
+  }
+  LOG_INFO("  %zu lines", lines);
+
+  bool ok = true;
+  ParseOptions options;
+  options.presize = true;
+  double plain    = bestTimeMs([&] {
+    ok &= parseAsAggregate<ScannerBackend>(file.begin(), file.end(), options)
+            .has_value();
+  });
+  options.lineIndex = true;
+  double indexed    = bestTimeMs([&] {
+    ok &= parseAsAggregate<ScannerBackend>(file.begin(), file.end(), options)
+            .has_value();
+  });
+  LOG_INFO(
+    "  scanner, presized:         %10.3fms %8.2f MB/s",
+    plain,
+    megabytesPerSecond(bytes, plain));
+  LOG_INFO(
+    "  scanner, presized, index:  %10.3fms %8.2f MB/s%s",
+    indexed,
+    megabytesPerSecond(bytes, indexed),
+    ok ? "" : "  PARSING FAILED");
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Runs parse(first, last, corner) over face corners separated by single
+// blanks or line ends, returning a checksum of the indices
+template <typename ParseFunc>
+long long
+sumCorners(const std::string& corners, ParseFunc parse)
+{
+  const char* first = corners.data();
+  const char* last  = first + corners.size();
+  long long sum     = 0;
+  while (first != last)
+  {
+    ObjParser::FaceTriplet corner;
+    if (!parse(first, last, corner))
+    {
+      return -1;
+    }
+    sum += corner.vertexIndex + corner.uvIndex + corner.normalIndex;
+    ++first;    // separator
+  }
+  return sum;
+}
+
+//------------------------------------------------------------------------------
+// Face corners on their own through the int_ rule the grammars used to have,
+// the scalar corner parser and its SSE2 fast path; then whole face lines
+// through the Qi grammar and the scanner
+void
+benchmarkFaces()
+{
+  namespace qi = boost::spirit::qi;
+  using ObjParser::FaceTriplet;
+
+  static const int LINES = 200000;
+
+  struct FaceForm
+  {
+    const char* name;
+    const char* format;
+  };
+  static const FaceForm FORMS[] = {
+    {"v", "{0} {1} {2}\n"},
+    {"v/vt", "{0}/{0} {1}/{1} {2}/{2}\n"},
+    {"v//vn", "{0}//{0} {1}//{1} {2}//{2}\n"},
+    {"v/vt/vn", "{0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n"},
+  };
+
+  using boost::phoenix::bind;
+  using qi::_1;
+  using qi::_val;
+  using qi::int_;
+  auto _vertex = bind(&FaceTriplet::vertexIndex, _val);
+  auto _uv     = bind(&FaceTriplet::uvIndex, _val);
+  auto _normal = bind(&FaceTriplet::normalIndex, _val);
+
+  qi::rule<const char*, FaceTriplet(), qi::blank_type> intRule;
+  // clang-format off
+  intRule = int_[_vertex = _1] >> -('/' >> (
+      (int_[_uv = _1] >> -('/' >> int_[_normal = _1]))
+      | ('/' >> int_[_normal = _1])
+    ));
+  // clang-format on
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("FACES: %d lines of each form", LINES);
+  for (const auto& form : FORMS)
+  {
+    std::string corners;
+    std::string lines;
+    for (int i = 1; i <= LINES; ++i)
+    {
+      std::string line = fmt::format(form.format, i, i + 1, i + 2);
+      corners += line;
+      lines += "f " + line;
+    }
+
+    auto report = [&](const char* name, auto parse) {
+      long long sum = 0;
+      double ms = bestTimeMs([&] { sum = sumCorners(corners, parse); });
+      LOG_INFO(
+        "  %-8s %-14s %9.3fms %8.1f MB/s %6.1f ns/corner%s",
+        form.name,
+        name,
+        ms,
+        megabytesPerSecond(corners.size(), ms),
+        ms * 1e6 / (3 * LINES),
+        sum < 0 ? "  PARSING FAILED" : "");
+    };
+    report("qi int_ rule", [&](const char*& first, const char* last, auto& c) {
+      return qi::phrase_parse(
+        first, last, intRule, qi::blank, qi::skip_flag::dont_postskip, c);
+    });
+    report("scalar", [](const char*& first, const char* last, auto& c) {
+      return ObjParser::detail::parseFaceCornerScalar(first, last, c);
+    });
+    report("fast path", [](const char*& first, const char* last, auto& c) {
+      return ObjParser::parseFaceCorner(first, last, c);
+    });
+
+    auto reportLines = [&](const char* name, auto parse) {
+      bool ok   = true;
+      double ms = bestTimeMs([&] { ok &= parse(); });
+      LOG_INFO(
+        "  %-8s %-14s %9.3fms %8.1f MB/s %6.1f ns/line%s",
+        form.name,
+        name,
+        ms,
+        megabytesPerSecond(lines.size(), ms),
+        ms * 1e6 / LINES,
+        ok ? "" : "  PARSING FAILED");
+    };
+    const char* first = lines.data();
+    const char* last  = first + lines.size();
+    reportLines("qi lines", [&] {
+      return ObjParser::parseAsFlatAggregate(first, last, {}).has_value();
+    });
+    reportLines("scanner lines", [&] {
+      return ObjParser::parseAsAggregate<ObjParser::ScannerBackend>(
+               first, last, {})
+        .has_value();
+    });
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Each backend and layout with and without the uniform file fast path
+void
+benchmarkUniform(const std::string& filename)
+{
+  using namespace ObjParser;
+
+  MappedFile file(filename);
+  const size_t bytes = file.size();
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("UNIFORM: %s (%zu bytes)", filename.c_str(), bytes);
+
+  auto report = [&](const char* name, auto parse) {
+    for (bool uniform : {false, true})
+    {
+      ParseOptions options;
+      options.presize = true;
+      options.uniform = uniform;
+
+      bool ok   = true;
+      double ms = bestTimeMs([&] { ok &= parse(options); });
+      LOG_INFO(
+        "  %-18s %-8s %10.3fms %8.2f MB/s%s",
+        name,
+        uniform ? "uniform" : "general",
+        ms,
+        megabytesPerSecond(bytes, ms),
+        ok ? "" : "  PARSING FAILED");
+    }
+  };
+
+  report("SpiritBackend", [&](const ParseOptions& options) {
+    return parseAsAggregate(file.begin(), file.end(), options).has_value();
+  });
+  report("ScannerBackend", [&](const ParseOptions& options) {
+    return parseAsAggregate<ScannerBackend>(file.begin(), file.end(), options)
+      .has_value();
+  });
+  report("ObjFlatAggregate", [&](const ParseOptions& options) {
+    return parseAsFlatAggregate(file.begin(), file.end(), options).has_value();
+  });
+  report("ObjSoaAggregate", [&](const ParseOptions& options) {
+    return parseAsSoaAggregate(file.begin(), file.end(), options).has_value();
+  });
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+template <ObjParser::Attributes MASK>
+size_t
+arrayBytes(const ObjParser::ObjSelectedAggregate<MASK>& data, bool reserved)
+{
+  return arrayBytes(data.positions, reserved)
+         + arrayBytes(data.normals, reserved)
+         + arrayBytes(data.texCoords, reserved)
+         + arrayBytes(data.faceCorners, reserved)
+         + arrayBytes(data.faceOffsets, reserved);
+}
+
+//------------------------------------------------------------------------------
+// Parse time and output size when only some attributes are kept
+void
+benchmarkAttributes(const std::string& filename)
+{
+  using namespace ObjParser;
+  using A = Attributes;
+
+  MappedFile file(filename);
+  const size_t bytes = file.size();
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("ATTRIBUTES: %s (%zu bytes)", filename.c_str(), bytes);
+
+  auto report = [&](const char* backend, const char* mask, auto parse) {
+    size_t outputBytes = 0;
+    double ms          = bestTimeMs([&] {
+      auto data = parse();
+      outputBytes = data ? arrayBytes(*data, false) : 0;
+    });
+    LOG_INFO(
+      "  %-14s %-24s %10.3fms %8.2f MB/s %8.2f MB output",
+      backend,
+      mask,
+      ms,
+      megabytesPerSecond(bytes, ms),
+      outputBytes / (1024.0 * 1024.0));
+  };
+
+  auto run = [&](const char* name, auto backend) {
+    using Backend = decltype(backend);
+    report(name, "All", [&] {
+      return parseAsAggregate<Backend>(file.begin(), file.end());
+    });
+    report(name, "Positions|Faces", [&] {
+      return parseAsAggregate<Backend, A::Positions | A::Faces>(
+        file.begin(), file.end());
+    });
+    report(name, "Pos|Normals|Faces|FaceN", [&] {
+      return parseAsAggregate<
+        Backend,
+        A::Positions | A::Normals | A::Faces | A::FaceNormals>(
+        file.begin(), file.end());
+    });
+  };
+  run("SpiritBackend", SpiritBackend());
+  run("ScannerBackend", ScannerBackend());
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Resolving face indices while parsing, against parsing the flat layout and
+// then resolving them in a separate pass as consumers have had to
+void
+benchmarkResolved(const std::string& filename)
+{
+  using namespace ObjParser;
+
+  MappedFile file(filename);
+  const size_t bytes = file.size();
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("RESOLVED: %s (%zu bytes)", filename.c_str(), bytes);
+
+  // To zero-based with -1 for absent. After the parse the element counts at
+  // each face are lost, so this only handles absolute indices, as in the grid.
+  auto fixUp = [](ObjFlatAggregate& data) {
+    for (FaceTriplet& corner : data.faceCorners)
+    {
+      corner.vertexIndex -= 1;
+      corner.uvIndex -= 1;
+      corner.normalIndex -= 1;
+    }
+  };
+
+  for (unsigned threads : {1u, 0u})
+  {
+    ParseOptions options;
+    options.threadCount = threads;
+
+    bool ok   = true;
+    double ms = bestTimeMs([&] {
+      auto data = parseAsFlatAggregate(file.begin(), file.end(), options);
+      ok        = data.has_value();
+    });
+    LOG_INFO(
+      "  threads=%u flat              %10.3fms %8.2f MB/s%s",
+      threads,
+      ms,
+      megabytesPerSecond(bytes, ms),
+      ok ? "" : "  PARSING FAILED");
+
+    ms = bestTimeMs([&] {
+      auto data = parseAsFlatAggregate(file.begin(), file.end(), options);
+      ok        = data.has_value();
+      if (ok)
+      {
+        fixUp(*data);
+      }
+    });
+    LOG_INFO(
+      "  threads=%u flat + fix-up     %10.3fms %8.2f MB/s%s",
+      threads,
+      ms,
+      megabytesPerSecond(bytes, ms),
+      ok ? "" : "  PARSING FAILED");
+
+    ms = bestTimeMs([&] {
+      auto data = parseAsResolvedAggregate(file.begin(), file.end(), options);
+      ok        = data.has_value();
+    });
+    LOG_INFO(
+      "  threads=%u resolved          %10.3fms %8.2f MB/s%s",
+      threads,
+      ms,
+      megabytesPerSecond(bytes, ms),
+      ok ? "" : "  PARSING FAILED");
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// A flat grid of quads with every tenth cell split into two triangles
+ObjParser::ObjAggregate
+makeQuadMesh(int gridSize)
+{
+  ObjParser::ObjAggregate data;
+  const int rowLength = gridSize + 1;
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      data.positions.push_back({float(x), float(y), 0.0f});
+    }
+  }
+  for (int y = 0; y < gridSize; ++y)
+  {
+    for (int x = 0; x < gridSize; ++x)
+    {
+      const int i0 = y * rowLength + x + 1;
+      const int i1 = i0 + 1;
+      const int i2 = i0 + rowLength;
+      const int i3 = i2 + 1;
+      if ((x + y * gridSize) % 10 == 0)
+      {
+        data.faces.push_back({{i0}, {i1}, {i3}});
+        data.faces.push_back({{i0}, {i3}, {i2}});
+      }
+      else
+      {
+        data.faces.push_back({{i0}, {i1}, {i3}, {i2}});
+      }
+    }
+  }
+  return data;
+}
+
+//------------------------------------------------------------------------------
+// Polygons of 5 to 12 corners, half of them concave stars, and half of the
+// rest bent slightly out of their plane
+ObjParser::ObjAggregate
+makePolygonMesh(int faceCount)
+{
+  std::mt19937 rng(21);
+  ObjParser::ObjAggregate data;
+  for (int face = 0; face < faceCount; ++face)
+  {
+    const int arity     = 5 + rng() % 8;
+    const unsigned kind = rng() % 4;
+    const float cx      = float(face % 1000) * 3.0f;
+    const float cy      = float(face / 1000) * 3.0f;
+
+    ObjParser::Face corners;
+    for (int i = 0; i < arity; ++i)
+    {
+      const float angle  = 6.2831853f * i / arity;
+      const float radius = (kind < 2 && i % 2) ? 0.4f : 1.0f;
+      const float z      = (kind == 2 && i % 2) ? 0.1f : 0.0f;
+      data.positions.push_back(
+        {cx + radius * std::cos(angle), cy + radius * std::sin(angle), z});
+      corners.push_back({int(data.positions.size())});
+    }
+    data.faces.push_back(std::move(corners));
+  }
+  return data;
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkTriangulate()
+{
+  const unsigned maxThreads = ObjParser::resolveThreadCount(0);
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("TRIANGULATE");
+  auto run = [&](const char* name, const ObjParser::ObjAggregate& data) {
+    double singleThreadedTime = 0.0;
+    for (unsigned threads : threadCounts)
+    {
+      ObjParser::TriangulateOptions options;
+      options.threadCount = threads;
+
+      size_t triangles = 0;
+      double ms        = bestTimeMs([&] {
+        triangles = ObjParser::triangulate(data, options).size() / 3;
+      });
+      if (threads == 1)
+      {
+        singleThreadedTime = ms;
+      }
+      LOG_INFO(
+        "  %-6s %8zu faces %3u threads: %10.3fms %8.2f Mtri/s  speedup %.2fx",
+        name,
+        data.faces.size(),
+        threads,
+        ms,
+        triangles / (ms * 1000.0),
+        singleThreadedTime / ms);
+    }
+  };
+  run("quads", makeQuadMesh(1000));
+  run("ngons", makePolygonMesh(200000));
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Unifying triangle corners with a std::map, as consumers did before
+ObjParser::ObjUnifiedMesh
+unifyWithMap(
+  const ObjParser::ObjAggregate& data,
+  const std::vector<ObjParser::FaceTriplet>& corners)
+{
+  ObjParser::ObjUnifiedMesh mesh;
+  std::map<std::tuple<int, int, int>, uint32_t> numbers;
+  for (const auto& c : corners)
+  {
+    const auto key = std::make_tuple(c.vertexIndex, c.uvIndex, c.normalIndex);
+    auto inserted  = numbers.emplace(key, uint32_t(mesh.vertices.size()));
+    if (inserted.second)
+    {
+      ObjParser::UnifiedVertex vertex = {};
+      const auto& p                   = data.positions[c.vertexIndex - 1];
+      vertex.position[0]              = p.x;
+      vertex.position[1]              = p.y;
+      vertex.position[2]              = p.z;
+      if (c.normalIndex)
+      {
+        const auto& n    = data.normals[c.normalIndex - 1];
+        vertex.normal[0] = n.i;
+        vertex.normal[1] = n.j;
+        vertex.normal[2] = n.k;
+      }
+      if (c.uvIndex)
+      {
+        const auto& uv     = data.texCoords[c.uvIndex - 1];
+        vertex.texCoord[0] = uv.u;
+        vertex.texCoord[1] = uv.v;
+      }
+      mesh.vertices.push_back(vertex);
+    }
+    mesh.indices.push_back(inserted.first->second);
+  }
+  return mesh;
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkUnify(const std::string& filename)
+{
+  auto data = ObjParser::loadAsAggregate(filename);
+  if (!data)
+  {
+    LOG_ERROR("Could not load %s", filename.c_str());
+    return;
+  }
+  const auto corners = ObjParser::triangulate(*data);
+
+  LOG_INFO("-------------------------");
+  LOG_INFO(
+    "UNIFY: %s (%zu triangle corners)", filename.c_str(), corners.size());
+
+  size_t vertices = 0;
+  double ms       = bestTimeMs(
+    [&] { vertices = unifyWithMap(*data, corners).vertices.size(); });
+  LOG_INFO(
+    "  std::map       %10.3fms %8.2f Mcorners/s %9zu vertices",
+    ms,
+    corners.size() / (ms * 1000.0),
+    vertices);
+
+  const unsigned maxThreads = ObjParser::resolveThreadCount(0);
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+  for (unsigned threads : threadCounts)
+  {
+    ObjParser::UnifyOptions options;
+    options.threadCount = threads;
+
+    bool ok = true;
+    ms      = bestTimeMs([&] {
+      auto mesh = ObjParser::unifyVertices(*data, corners, options);
+      ok        = mesh.has_value();
+      vertices  = ok ? mesh->vertices.size() : 0;
+    });
+    LOG_INFO(
+      "  %3u threads    %10.3fms %8.2f Mcorners/s %9zu vertices%s",
+      threads,
+      ms,
+      corners.size() / (ms * 1000.0),
+      vertices,
+      ok ? "" : "  UNIFY FAILED");
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// A rolling grid of gridSize * gridSize * 2 triangles without normals
+ObjParser::ObjFlatAggregate
+makeTerrainMesh(int gridSize)
+{
+  ObjParser::ObjFlatAggregate data;
+  const int rowLength = gridSize + 1;
+  data.positions.reserve(size_t(rowLength) * rowLength);
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      const float z = std::sin(x * 0.05f) * std::cos(y * 0.07f);
+      data.positions.push_back({float(x), float(y), z});
+    }
+  }
+  const size_t triangles = size_t(gridSize) * gridSize * 2;
+  data.faceCorners.reserve(3 * triangles);
+  data.faceOffsets.reserve(triangles + 1);
+  for (int y = 0; y < gridSize; ++y)
+  {
+    for (int x = 0; x < gridSize; ++x)
+    {
+      const int i0 = y * rowLength + x + 1;
+      const int i1 = i0 + 1;
+      const int i2 = i0 + rowLength;
+      const int i3 = i2 + 1;
+      for (int index : {i0, i1, i3, i0, i3, i2})
+      {
+        data.faceCorners.push_back({index});
+        if (data.faceCorners.size() % 3 == 0)
+        {
+          data.faceOffsets.push_back(data.faceCorners.size());
+        }
+      }
+    }
+  }
+  return data;
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkGenerateNormals()
+{
+  const unsigned maxThreads = ObjParser::resolveThreadCount(0);
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  // 2237 * 2237 * 2 is just over ten million faces
+  auto data          = makeTerrainMesh(2237);
+  const size_t faces = data.faceCount();
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("NORMALS: %zu faces", faces);
+  auto run = [&](const char* name, float creaseAngle) {
+    double singleThreadedTime = 0.0;
+    for (unsigned threads : threadCounts)
+    {
+      // Replacing makes every run start from the same faces
+      ObjParser::NormalOptions options;
+      options.threadCount     = threads;
+      options.creaseAngle     = creaseAngle;
+      options.replaceExisting = true;
+
+      bool ok   = true;
+      double ms = bestTimeMs(
+        [&] { ok = ObjParser::generateNormals(data, options); });
+      if (threads == 1)
+      {
+        singleThreadedTime = ms;
+      }
+      LOG_INFO(
+        "  %-7s %3u threads: %10.3fms %8.2f Mfaces/s %9zu normals  "
+        "speedup %.2fx%s",
+        name,
+        threads,
+        ms,
+        faces / (ms * 1000.0),
+        data.normals.size(),
+        singleThreadedTime / ms,
+        ok ? "" : "  FAILED");
+    }
+  };
+  run("smooth", 180.0f);
+  run("creased", 2.0f);
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// The terrain of makeTerrainMesh() as a unified mesh with normals and a
+// texture stretched over it
+ObjParser::ObjUnifiedMesh
+makeTexturedTerrain(int gridSize)
+{
+  ObjParser::ObjUnifiedMesh mesh;
+  const int rowLength = gridSize + 1;
+  for (int y = 0; y <= gridSize; ++y)
+  {
+    for (int x = 0; x <= gridSize; ++x)
+    {
+      const float z  = std::sin(x * 0.05f) * std::cos(y * 0.07f);
+      const float dx = 0.05f * std::cos(x * 0.05f) * std::cos(y * 0.07f);
+      const float dy = -0.07f * std::sin(x * 0.05f) * std::sin(y * 0.07f);
+      mesh.vertices.push_back(
+        {{float(x), float(y), z},
+         {-dx, -dy, 1.0f},
+         {float(x) / gridSize, float(y) / gridSize}});
+    }
+  }
+  for (int y = 0; y < gridSize; ++y)
+  {
+    for (int x = 0; x < gridSize; ++x)
+    {
+      const uint32_t i0 = y * rowLength + x;
+      const uint32_t i1 = i0 + 1;
+      const uint32_t i2 = i0 + rowLength;
+      const uint32_t i3 = i2 + 1;
+      for (uint32_t index : {i0, i1, i3, i0, i3, i2})
+      {
+        mesh.indices.push_back(index);
+      }
+    }
+  }
+  return mesh;
+}
+
+//------------------------------------------------------------------------------
+void
+benchmarkGenerateTangents()
+{
+  const unsigned maxThreads = ObjParser::resolveThreadCount(0);
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < maxThreads; threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(maxThreads);
+
+  const auto mesh        = makeTexturedTerrain(1000);
+  const size_t triangles = mesh.indices.size() / 3;
+
+  LOG_INFO("-------------------------");
+  LOG_INFO("TANGENTS: %zu triangles", triangles);
+  const std::pair<const char*, ObjParser::SimdLevel> levels[] = {
+    {"scalar", ObjParser::SimdLevel::Scalar},
+    {"sse2", ObjParser::SimdLevel::Sse2},
+    {"avx2", ObjParser::SimdLevel::Avx2}};
+  for (const auto& level : levels)
+  {
+    for (unsigned threads : threadCounts)
+    {
+      ObjParser::TangentOptions options;
+      options.threadCount = threads;
+      options.simdLevel   = level.second;
+
+      // Each run starts from the mesh without tangents
+      bool ok   = true;
+      double ms = bestTimeMs([&] {
+        auto copy = mesh;
+        ok        = ObjParser::generateTangents(copy, options);
+      });
+      LOG_INFO(
+        "  %-6s %3u threads: %10.3fms %8.2f Mtri/s%s",
+        level.first,
+        threads,
+        ms,
+        triangles / (ms * 1000.0),
+        ok ? "" : "  FAILED");
+    }
+  }
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// ACMR and ATVR of the mesh as loaded, and of the same triangles shuffled the
+// way an unhelpful exporter might write them, before and after the passes
+void
+benchmarkOptimize(const std::string& filename)
+{
+  auto data = ObjParser::loadAsAggregate(filename);
+  if (!data)
+  {
+    LOG_ERROR("Could not load %s", filename.c_str());
+    return;
+  }
+  auto loaded = ObjParser::buildUnifiedMesh(*data);
+  if (!loaded)
+  {
+    LOG_ERROR("Could not unify %s", filename.c_str());
+    return;
+  }
+
+  ObjParser::ObjUnifiedMesh shuffled = *loaded;
+  std::vector<std::array<uint32_t, 3>> triangles(shuffled.indices.size() / 3);
+  std::memcpy(
+    triangles.data(),
+    shuffled.indices.data(),
+    shuffled.indices.size() * sizeof(uint32_t));
+  std::shuffle(triangles.begin(), triangles.end(), std::mt19937(25));
+  std::memcpy(
+    shuffled.indices.data(),
+    triangles.data(),
+    shuffled.indices.size() * sizeof(uint32_t));
+
+  LOG_INFO("-------------------------");
+  LOG_INFO(
+    "OPTIMIZE: %s (%zu triangles, %zu vertices, %zu-entry cache)",
+    filename.c_str(),
+    triangles.size(),
+    loaded->vertices.size(),
+    ObjParser::VERTEX_CACHE_SIZE);
+  auto run = [&](const char* name, const ObjParser::ObjUnifiedMesh& mesh) {
+    const auto before = ObjParser::analyzeVertexCache(mesh);
+
+    // Both timings include copying the mesh they start from
+    bool ok = true;
+    ObjParser::ObjUnifiedMesh reordered;
+    const double cacheMs = bestTimeMs([&] {
+      reordered = mesh;
+      ok        = ObjParser::optimizeVertexCache(reordered);
+    });
+    ObjParser::ObjUnifiedMesh optimized;
+    const double fetchMs = bestTimeMs([&] {
+      optimized = reordered;
+      ok        = ok && ObjParser::optimizeVertexFetch(optimized);
+    });
+    const auto after = ObjParser::analyzeVertexCache(optimized);
+    LOG_INFO(
+      "  %-8s ACMR %.3f -> %.3f  ATVR %.3f -> %.3f  cache %8.3fms  "
+      "fetch %7.3fms%s",
+      name,
+      before.acmr,
+      after.acmr,
+      before.atvr,
+      after.atvr,
+      cacheMs,
+      fetchMs,
+      ok ? "" : "  FAILED");
+  };
+  run("loaded", *loaded);
+  run("shuffled", shuffled);
+  LOG_INFO("-------------------------");
+}
+
+//------------------------------------------------------------------------------
+// Usage: ObjParserMain <benchmark|all> [file.obj]
+// Without a file a generated grid mesh is used.
+int
+runBenchmarks(const std::string& name, std::string filename)
+{
+  if (filename.empty())
+  {
+    filename = BENCHMARK_FILE;
+    writeGridObj(filename, 256);
+  }
+
+  const bool all = (name == "all");
+  bool found     = false;
+  if (all || name == "mapped")
+  {
+    benchmarkFileAccess(filename);
+    found = true;
+  }
+  if (all || name == "parallel")
+  {
+    benchmarkParallel(filename);
+    found = true;
+  }
+  if (all || name == "callbacks")
+  {
+    benchmarkCallbacks(filename);
+    found = true;
+  }
+  if (all || name == "faces")
+  {
+    benchmarkFaceStorage(filename);
+    found = true;
+  }
+  if (all || name == "presize")
+  {
+    benchmarkPresize(filename);
+    found = true;
+  }
+  if (all || name == "floats")
+  {
+    benchmarkFloats(filename);
+    found = true;
+  }
+  if (all || name == "cache")
+  {
+    benchmarkCache(filename);
+    found = true;
+  }
+  if (all || name == "small")
+  {
+    benchmarkSmallInputs();
+    found = true;
+  }
+  if (all || name == "errors")
+  {
+    benchmarkErrors(filename);
+    found = true;
+  }
+  if (all || name == "elements")
+  {
+    benchmarkElements();
+    found = true;
+  }
+  if (all || name == "x3")
+  {
+    benchmarkX3(filename);
+    found = true;
+  }
+  if (all || name == "scanner")
+  {
+    benchmarkScanner(filename);
+    found = true;
+  }
+  if (all || name == "lineindex")
+  {
+    benchmarkLineIndex(filename);
+    found = true;
+  }
+  if (all || name == "corners")
+  {
+    benchmarkFaces();
+    found = true;
+  }
+  if (all || name == "uniform")
+  {
+    benchmarkUniform(filename);
+    found = true;
+  }
+  if (all || name == "attributes")
+  {
+    benchmarkAttributes(filename);
+    found = true;
+  }
+  if (all || name == "resolved")
+  {
+    benchmarkResolved(filename);
+    found = true;
+  }
+  if (all || name == "triangulate")
+  {
+    benchmarkTriangulate();
+    found = true;
+  }
+  if (all || name == "unify")
+  {
+    benchmarkUnify(filename);
+    found = true;
+  }
+  if (all || name == "normals")
+  {
+    benchmarkGenerateNormals();
+    found = true;
+  }
+  if (all || name == "tangents")
+  {
+    benchmarkGenerateTangents();
+    found = true;
+  }
+  if (all || name == "optimize")
+  {
+    benchmarkOptimize(filename);
+    found = true;
+  }
+
+  if (!found)
+  {
+    LOG_ERROR("Unknown benchmark: %s", name.c_str());
+    return -1;
+  }
+  return 0;
+}
+
 //------------------------------------------------------------------------------
 int
-main()
+main(int argc, char** argv)
 {
+  if (argc > 1)
+  {
+    return runBenchmarks(argv[1], (argc > 2) ? argv[2] : "");
+  }
+
   static const char* TEST_FILE   = "assets/test.obj";
   static const char* DRAGON_FILE = "assets/dragon_vrip_res3.obj";
   UNREFERENCED_PARAMETER(DRAGON_FILE);
@@ -33,6 +33,41 @@ performTestVariant(const std::string& input, const std::vector<T>& expected)
   }
 }
 
+//------------------------------------------------------------------------------
+void
+checkExpectedAggregate(
+  const ObjParser::ObjAggregate& actual,
+  const ObjParser::ObjAggregate& expected)
+{
+  ASSERT_EQ(expected.positions.size(), actual.positions.size());
+  int i = 0;
+  for (auto& elem : actual.positions)
+  {
+    EXPECT_EQ(expected.positions[i++], elem);
+  }
+
+  ASSERT_EQ(expected.normals.size(), actual.normals.size());
+  i = 0;
+  for (auto& elem : actual.normals)
+  {
+    EXPECT_EQ(expected.normals[i++], elem);
+  }
+
+  ASSERT_EQ(expected.texCoords.size(), actual.texCoords.size());
+  i = 0;
+  for (auto& elem : actual.texCoords)
+  {
+    EXPECT_EQ(expected.texCoords[i++], elem);
+  }
+
+  ASSERT_EQ(expected.faces.size(), actual.faces.size());
+  i = 0;
+  for (auto& elem : actual.faces)
+  {
+    EXPECT_EQ(expected.faces[i++], elem);
+  }
+}
+
 //------------------------------------------------------------------------------
 void
 performTestAggregate(
@@ -41,33 +76,99 @@ performTestAggregate(
   auto data = ObjParser::parseAsAggregate(input.begin(), input.end());
   ASSERT_TRUE(data.has_value()) << "Failed to parse";
 
-  ASSERT_EQ(expected.positions.size(), data->positions.size());
-  int i = 0;
-  for (auto& actual : data->positions)
+  checkExpectedAggregate(*data, expected);
+}
+
+//------------------------------------------------------------------------------
+void
+checkExpectedFlatAggregate(
+  const ObjParser::ObjFlatAggregate& actual,
+  const ObjParser::ObjAggregate& expected)
+{
+  EXPECT_EQ(expected.positions, actual.positions);
+  EXPECT_EQ(expected.normals, actual.normals);
+  EXPECT_EQ(expected.texCoords, actual.texCoords);
+
+  ASSERT_EQ(expected.faces.size(), actual.faceCount());
+  ASSERT_EQ(actual.faceCorners.size(), actual.faceOffsets.back());
+  for (size_t i = 0; i < actual.faceCount(); ++i)
   {
-    EXPECT_EQ(expected.positions[i++], actual);
+    ObjParser::Face face(actual.faceBegin(i), actual.faceEnd(i));
+    EXPECT_EQ(expected.faces[i], face);
   }
+}
 
-  ASSERT_EQ(expected.normals.size(), data->normals.size());
-  i = 0;
-  for (auto& actual : data->normals)
+//------------------------------------------------------------------------------
+void
+checkExpectedSoaAggregate(
+  const ObjParser::ObjSoaAggregate& actual,
+  const ObjParser::ObjAggregate& expected)
+{
+  ASSERT_EQ(expected.positions.size(), actual.positions.size());
+  ASSERT_EQ(actual.positions.size(), actual.positions.y.size());
+  ASSERT_EQ(actual.positions.size(), actual.positions.z.size());
+  for (size_t i = 0; i < actual.positions.size(); ++i)
   {
-    EXPECT_EQ(expected.normals[i++], actual);
+    EXPECT_EQ(expected.positions[i], actual.positions[i]);
   }
 
-  ASSERT_EQ(expected.texCoords.size(), data->texCoords.size());
-  i = 0;
-  for (auto& actual : data->texCoords)
+  ASSERT_EQ(expected.normals.size(), actual.normals.size());
+  for (size_t i = 0; i < actual.normals.size(); ++i)
   {
-    EXPECT_EQ(expected.texCoords[i++], actual);
+    EXPECT_EQ(expected.normals[i], actual.normals[i]);
   }
 
-  ASSERT_EQ(expected.faces.size(), data->faces.size());
-  i = 0;
-  for (auto& actual : data->faces)
+  ASSERT_EQ(expected.texCoords.size(), actual.texCoords.size());
+  for (size_t i = 0; i < actual.texCoords.size(); ++i)
+  {
+    EXPECT_EQ(expected.texCoords[i], actual.texCoords[i]);
+  }
+
+  ASSERT_EQ(expected.faces.size(), actual.faceCount());
+  for (size_t i = 0; i < actual.faceCount(); ++i)
+  {
+    ObjParser::Face face(actual.faceBegin(i), actual.faceEnd(i));
+    EXPECT_EQ(expected.faces[i], face);
+  }
+}
+
+//------------------------------------------------------------------------------
+void
+writeTestFile(const std::string& filename, const std::string& contents)
+{
+  std::ofstream out(filename, std::ios::binary);
+  out << contents;
+}
+
+//------------------------------------------------------------------------------
+// parseFloat must agree with strtof bit for bit and consume the same text
+::testing::AssertionResult
+parseFloatMatchesStrtof(const std::string& text)
+{
+  const char* first = text.c_str();
+  float actual      = 0.0f;
+  const bool parsed
+    = ObjParser::parseFloat(first, text.c_str() + text.size(), actual);
+
+  char* expectedEnd    = nullptr;
+  const float expected = std::strtof(text.c_str(), &expectedEnd);
+  if (!parsed || first != expectedEnd)
+  {
+    return ::testing::AssertionFailure()
+           << "\"" << text << "\": consumed " << (first - text.c_str())
+           << " chars, strtof consumed " << (expectedEnd - text.c_str());
+  }
+
+  uint32_t actualBits, expectedBits;
+  std::memcpy(&actualBits, &actual, sizeof(actualBits));
+  std::memcpy(&expectedBits, &expected, sizeof(expectedBits));
+  if (actualBits != expectedBits)
   {
-    EXPECT_EQ(expected.faces[i++], actual);
+    return ::testing::AssertionFailure()
+           << "\"" << text << "\": " << std::hexfloat << actual
+           << ", strtof gives " << expected;
   }
+  return ::testing::AssertionSuccess();
 }
 //------------------------------------------------------------------------------
 
@@ -1,10 +1,27 @@
 #include "ObjParser.h"
+#include "ObjParserCallbacks.h"
+#include "ObjCache.h"
+#include "ObjParserX3.h"
+#include "ObjScanner.h"
+#include "Triangulate.h"
+#include "UnifiedMesh.h"
+#include "GenerateNormals.h"
+#include "GenerateTangents.h"
+#include "OptimizeMesh.h"
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 #include "TestFixture.h"
 
+#include <algorithm>
+#include <array>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+
 namespace
 {
 //------------------------------------------------------------------------------
@@ -202,6 +219,2932 @@ abc  0.03264300152659416 0.056147500872612 -0.04995829984545708
   ASSERT_FALSE(data.has_value()) << "Parsing should fail";
 }
 
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, LoadMappedMatchesStream)
+{
+  static const std::string FILE_NAME = "test_load_mapped.obj";
+  writeTestFile(FILE_NAME, R"obj(
+mtllib	test.mtl
+v  0.03264300152659416 0.056147500872612 -0.04995829984545708
+v  0.03080499917268753 0.0559782013297081 -0.04991229996085167 1.5
+vn -0.4538693428039551 0.3681831955909729 0.8114454746246338
+vt 0.089608 0.023837
+usemtl $Material_0
+f  1//1 2//1 1//1
+f  1/1/1 2/1/1 1/1/1
+)obj");
+
+  ObjParser::LoadOptions streamOptions;
+  streamOptions.memoryMap = false;
+
+  auto mapped = ObjParser::loadAsAggregate(FILE_NAME);
+  auto stream = ObjParser::loadAsAggregate(FILE_NAME, streamOptions);
+  ASSERT_TRUE(mapped.has_value()) << "Failed to parse mapped file";
+  ASSERT_TRUE(stream.has_value()) << "Failed to parse streamed file";
+  EXPECT_EQ(2u, mapped->positions.size());
+  EXPECT_EQ(2u, mapped->faces.size());
+  checkExpectedAggregate(*mapped, *stream);
+
+  auto mappedVariant = ObjParser::loadAsVariant(FILE_NAME);
+  auto streamVariant = ObjParser::loadAsVariant(FILE_NAME, streamOptions);
+  ASSERT_TRUE(mappedVariant.has_value()) << "Failed to parse mapped file";
+  ASSERT_TRUE(streamVariant.has_value()) << "Failed to parse streamed file";
+  EXPECT_EQ(*streamVariant, *mappedVariant);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, LoadMappedEmptyAndMissingFile)
+{
+  static const std::string FILE_NAME = "test_load_empty.obj";
+  writeTestFile(FILE_NAME, "");
+
+  auto empty = ObjParser::loadAsAggregate(FILE_NAME);
+  ASSERT_TRUE(empty.has_value()) << "Empty file should parse";
+  EXPECT_TRUE(empty->positions.empty());
+
+  auto missing = ObjParser::loadAsAggregate("does_not_exist.obj");
+  EXPECT_FALSE(missing.has_value()) << "Missing file should fail";
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParallelMatchesSerial)
+{
+  std::string input = "mtllib test.mtl\n";
+  for (int i = 1; i <= 200; ++i)
+  {
+    input += "v " + std::to_string(i * 0.25) + " 0.5 -1.25\n";
+    input += "# comment " + std::to_string(i) + "\n";
+    input += "vn 0 " + std::to_string(i * 0.5) + " 1\n";
+    input += "vt " + std::to_string(i * 0.125) + " 0.5\n";
+    input += "f " + std::to_string(i) + "/" + std::to_string(i) + "/1 2//2 3 "
+             + std::to_string(-i) + "\n";
+  }
+
+  auto serial = ObjParser::parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(serial.has_value()) << "Failed to parse";
+
+  for (unsigned threads : {1u, 2u, 3u, 7u, 16u})
+  {
+    ObjParser::ParseOptions options;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+
+    auto parallel = ObjParser::parseAsAggregate(
+      input.data(), input.data() + input.size(), options);
+    ASSERT_TRUE(parallel.has_value()) << "Failed to parse";
+    checkExpectedAggregate(*parallel, *serial);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParallelInvalidDataFails)
+{
+  std::string input;
+  for (int i = 0; i < 100; ++i)
+  {
+    input += "v 1 2 3\n";
+  }
+  input += "abc 1 2 3\n";
+
+  ObjParser::ParseOptions options;
+  options.threadCount  = 4;
+  options.minChunkSize = 1;
+
+  auto data = ObjParser::parseAsAggregate(
+    input.data(), input.data() + input.size(), options);
+  ASSERT_FALSE(data.has_value()) << "Parsing should fail";
+}
+
+//------------------------------------------------------------------------------
+static const std::string CALLBACK_INPUT = R"obj(
+mtllib	test.mtl
+# Vertices here
+v  0.03264300152659416 0.056147500872612 -0.04995829984545708
+v  0.03080499917268753 0.0559782013297081 -0.04991229996085167 1.5
+vn -0.4538693428039551 0.3681831955909729 0.8114454746246338
+vt 0.089608 0.023837
+vt -0.07313 0.023837
+v  0.03251679986715317 0.05801349878311157 -0.050050999969244
+usemtl $Material_0
+f  1//1 2//2 3//3
+f  11/11/11 12/12/12 2/2/2
+f  5 1 6
+)obj";
+
+//------------------------------------------------------------------------------
+ObjParser::ObjCallbacks
+makeCollectingCallbacks(ObjParser::ObjAggregate& agg)
+{
+  ObjParser::ObjCallbacks callbacks;
+  callbacks.position = [&](auto& v) { agg.positions.push_back(v); };
+  callbacks.normal   = [&](auto& n) { agg.normals.push_back(n); };
+  callbacks.texCoord = [&](auto& uv) { agg.texCoords.push_back(uv); };
+  callbacks.face     = [&](auto& f) { agg.faces.push_back(f); };
+  return callbacks;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CallbacksMatchAggregate)
+{
+  auto expected = ObjParser::parseAsAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  ObjParser::ObjAggregate actual;
+  auto callbacks = makeCollectingCallbacks(actual);
+  ASSERT_TRUE(ObjParser::parseWithCallbacks(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end(), callbacks));
+  checkExpectedAggregate(actual, *expected);
+}
+
+//------------------------------------------------------------------------------
+// A string stream buffer that records the largest read asked of it
+struct ReadSizeBuffer : std::stringbuf
+{
+  explicit ReadSizeBuffer(const std::string& s) : std::stringbuf(s) {}
+
+  std::streamsize xsgetn(char* s, std::streamsize count) override
+  {
+    largestRead = std::max(largestRead, size_t(count));
+    return std::stringbuf::xsgetn(s, count);
+  }
+
+  size_t largestRead = 0;
+};
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CallbacksFromStreamWithSmallBlocks)
+{
+  auto expected = ObjParser::parseAsAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  // Block sizes smaller than a line force the buffer to grow
+  for (size_t blockSize : {1, 7, 64, 4096})
+  {
+    std::istringstream in(CALLBACK_INPUT);
+    ObjParser::ObjAggregate actual;
+    auto callbacks = makeCollectingCallbacks(actual);
+    ASSERT_TRUE(ObjParser::parseWithCallbacks(in, callbacks, blockSize));
+    checkExpectedAggregate(actual, *expected);
+  }
+
+  // Lines ended by a lone '\r' are cut at too, so the buffer never grows
+  // past a block when every line fits in one (the longest is 66 bytes)
+  std::string crOnly = CALLBACK_INPUT;
+  std::replace(crOnly.begin(), crOnly.end(), '\n', '\r');
+  for (size_t blockSize : {1, 7, 64, 128, 4096})
+  {
+    ReadSizeBuffer buffer(crOnly);
+    std::istream in(&buffer);
+    ObjParser::ObjAggregate actual;
+    auto callbacks = makeCollectingCallbacks(actual);
+    ASSERT_TRUE(ObjParser::parseWithCallbacks(in, callbacks, blockSize));
+    checkExpectedAggregate(actual, *expected);
+    if (blockSize >= 128)
+    {
+      EXPECT_LE(buffer.largestRead, blockSize);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, BatchCallbacks)
+{
+  std::string input;
+  for (int i = 0; i < 10; ++i)
+  {
+    input += "v " + std::to_string(i) + " 0 0\n";
+  }
+
+  std::vector<size_t> batchSizes;
+  ObjParser::ObjBatchCallbacks callbacks;
+  callbacks.batchSize = 4;
+  callbacks.positions = [&](auto& batch) {
+    batchSizes.push_back(batch.size());
+  };
+
+  std::istringstream in(input);
+  ASSERT_TRUE(ObjParser::parseWithCallbacks(in, callbacks, 16));
+  EXPECT_EQ(std::vector<size_t>({4, 4, 2}), batchSizes);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CallbacksInvalidDataFails)
+{
+  std::istringstream in("v 1 2 3\nabc 1 2 3\n");
+
+  size_t count = 0;
+  ObjParser::ObjCallbacks callbacks;
+  callbacks.position = [&](auto&) { ++count; };
+  ASSERT_FALSE(ObjParser::parseWithCallbacks(in, callbacks));
+  EXPECT_EQ(1u, count);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, FlatAggregateMatchesAggregate)
+{
+  auto expected = ObjParser::parseAsAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  auto flat = ObjParser::parseAsFlatAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(flat.has_value()) << "Failed to parse";
+  checkExpectedFlatAggregate(*flat, *expected);
+
+  EXPECT_EQ(3u, flat->faceCount());
+  EXPECT_EQ(3u, flat->faceArity(2));
+  EXPECT_EQ(ObjParser::FaceTriplet({5, 0, 0}), *flat->faceBegin(2));
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, FlatAggregateParallelMatchesSerial)
+{
+  std::string input;
+  for (int i = 1; i <= 100; ++i)
+  {
+    input += "v " + std::to_string(i) + " 0 0\n";
+    input += "f " + std::to_string(i) + " 2 3\n";
+    if (i % 3 == 0)
+    {
+      input += "f 1/1 2/2 3/3 " + std::to_string(i) + "/1\n";
+    }
+  }
+
+  auto serial = ObjParser::parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(serial.has_value()) << "Failed to parse";
+
+  for (unsigned threads : {1u, 2u, 5u})
+  {
+    ObjParser::ParseOptions options;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+
+    auto flat = ObjParser::parseAsFlatAggregate(
+      input.data(), input.data() + input.size(), options);
+    ASSERT_TRUE(flat.has_value()) << "Failed to parse";
+    checkExpectedFlatAggregate(*flat, *serial);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, SoaAggregateMatchesAggregate)
+{
+  auto expected = ObjParser::parseAsAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  auto soa = ObjParser::parseAsSoaAggregate(
+    CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(soa.has_value()) << "Failed to parse";
+  checkExpectedSoaAggregate(*soa, *expected);
+
+  // The second vertex has a w, so every vertex gets one
+  ASSERT_TRUE(soa->positions.hasW());
+  EXPECT_EQ(std::vector<float>({1.0f, 1.5f, 1.0f}), soa->positions.w);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, SoaAggregateOmitsDefaultW)
+{
+  static const std::string INPUT = R"obj(
+v 1 2 3
+v 4 5 6 1.0
+)obj";
+
+  auto soa = ObjParser::parseAsSoaAggregate(INPUT.begin(), INPUT.end());
+  ASSERT_TRUE(soa.has_value()) << "Failed to parse";
+  EXPECT_EQ(std::vector<float>({1.0f, 4.0f}), soa->positions.x);
+  EXPECT_EQ(std::vector<float>({3.0f, 6.0f}), soa->positions.z);
+  EXPECT_FALSE(soa->positions.hasW());
+
+  static const std::string FIRST_HAS_W = "v 1 2 3 0.5\nv 4 5 6\n";
+  soa = ObjParser::parseAsSoaAggregate(FIRST_HAS_W.begin(), FIRST_HAS_W.end());
+  ASSERT_TRUE(soa.has_value()) << "Failed to parse";
+  EXPECT_EQ(std::vector<float>({0.5f, 1.0f}), soa->positions.w);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, SoaAggregateParallelMatchesSerial)
+{
+  std::string input;
+  for (int i = 1; i <= 100; ++i)
+  {
+    input += "v " + std::to_string(i) + " 0 0";
+    input += (i == 90) ? " 0.5\n" : "\n";
+    input += "vn 0 0 " + std::to_string(i) + "\n";
+    input += "vt " + std::to_string(i) + "\n";
+    input += "f " + std::to_string(i) + " 2 3\n";
+  }
+
+  auto serial = ObjParser::parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(serial.has_value()) << "Failed to parse";
+
+  for (unsigned threads : {1u, 2u, 5u})
+  {
+    ObjParser::ParseOptions options;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+
+    auto soa = ObjParser::parseAsSoaAggregate(
+      input.data(), input.data() + input.size(), options);
+    ASSERT_TRUE(soa.has_value()) << "Failed to parse";
+    checkExpectedSoaAggregate(*soa, *serial);
+    EXPECT_TRUE(soa->positions.hasW());
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CountElements)
+{
+  static const std::string INPUT = "  v 1 2 3\nvn 0 0 1\r\nvt 0.5\n"
+                                   "f 1/1/1 2/2/2 3/3/3 # comment\n"
+                                   "#v 1 2 3\nusemtl vmat\nf\t1 2 3 4";
+
+  auto counts = ObjParser::countElements(
+    INPUT.data(), INPUT.data() + INPUT.size());
+  EXPECT_EQ(1u, counts.positions);
+  EXPECT_EQ(1u, counts.normals);
+  EXPECT_EQ(1u, counts.texCoords);
+  EXPECT_EQ(2u, counts.faces);
+  EXPECT_EQ(7u, counts.faceCorners);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, PresizeReservesExactCapacity)
+{
+  const char* begin = CALLBACK_INPUT.data();
+  const char* end   = begin + CALLBACK_INPUT.size();
+
+  auto expected = ObjParser::parseAsAggregate(begin, end);
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  for (unsigned threads : {1u, 3u})
+  {
+    ObjParser::ParseOptions options;
+    options.presize      = true;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+
+    auto agg = ObjParser::parseAsAggregate(begin, end, options);
+    ASSERT_TRUE(agg.has_value()) << "Failed to parse";
+    checkExpectedAggregate(*agg, *expected);
+
+    auto flat = ObjParser::parseAsFlatAggregate(begin, end, options);
+    ASSERT_TRUE(flat.has_value()) << "Failed to parse";
+    checkExpectedFlatAggregate(*flat, *expected);
+    EXPECT_EQ(flat->positions.size(), flat->positions.capacity());
+    EXPECT_EQ(flat->faceCorners.size(), flat->faceCorners.capacity());
+    EXPECT_EQ(flat->faceOffsets.size(), flat->faceOffsets.capacity());
+
+    auto soa = ObjParser::parseAsSoaAggregate(begin, end, options);
+    ASSERT_TRUE(soa.has_value()) << "Failed to parse";
+    checkExpectedSoaAggregate(*soa, *expected);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatSyntax)
+{
+  for (const char* text :
+       {"0", "-0", "+1", "1.", ".5", "-.5", "1e", "1e+", "2E-3", "1.5e3x",
+        "00012.50", "nan", "-inf", "Infinity", "3.4028235e38", "3.4028236e38",
+        "1e-46", "1.4e-45", "1.17549435e-38", "1e400", "1e-400",
+        "123456789012345678901234567890", "0.000000000000000000000000001"})
+  {
+    EXPECT_TRUE(parseFloatMatchesStrtof(text));
+  }
+
+  for (const std::string text : {"", "-", ".", "-.", "e5", "x", "n"})
+  {
+    const char* first = text.c_str();
+    float value       = 0.0f;
+    EXPECT_FALSE(
+      ObjParser::parseFloat(first, text.c_str() + text.size(), value))
+      << text;
+    EXPECT_EQ(text.c_str(), first);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatRoundTripsEveryStride)
+{
+  // Every 4099th bit pattern, covering all exponents, printed with the 9
+  // significant digits needed to round trip and with typical OBJ precision
+  char buffer[64];
+  for (uint64_t bits = 0; bits < 0x7f800000u; bits += 4099)
+  {
+    const uint32_t pattern = static_cast<uint32_t>(bits);
+    float f;
+    std::memcpy(&f, &pattern, sizeof(f));
+
+    std::snprintf(buffer, sizeof(buffer), "%.9g", f);
+    ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+    std::snprintf(buffer, sizeof(buffer), "%.6f", f);
+    ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatShortDecimals)
+{
+  char buffer[64];
+  for (int mantissa = 0; mantissa < 10000; ++mantissa)
+  {
+    for (int exponent = -50; exponent <= 40; exponent += 3)
+    {
+      std::snprintf(buffer, sizeof(buffer), "%de%d", mantissa, exponent);
+      ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatIgnoresLocale)
+{
+  // Under a locale with a decimal comma the slow path must still read '.'.
+  // Nothing to check where no such locale is installed.
+  const std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  bool found                 = false;
+  for (const char* name : {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "de_DE"})
+  {
+    found = found || std::setlocale(LC_NUMERIC, name) != nullptr;
+  }
+  if (!found)
+  {
+    return;
+  }
+
+  // Too small for a float, and too many digits for the fast path
+  const std::pair<std::string, float> cases[] = {
+    {"1.5e-50", 0.0f}, {"1.50000000000000000000001", 1.5f}};
+  for (const auto& [text, expected] : cases)
+  {
+    const char* first = text.c_str();
+    const char* last  = first + text.size();
+    float value       = -1.0f;
+    EXPECT_TRUE(ObjParser::parseFloat(first, last, value)) << text;
+    EXPECT_EQ(last, first);
+    EXPECT_EQ(expected, value) << text;
+  }
+  std::setlocale(LC_NUMERIC, previous.c_str());
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatHalfwayCases)
+{
+  // Odd integers in [2^24, 2^25) sit exactly between two floats and must
+  // round to even; nudging them either way must not. An exponent-form
+  // midpoint printed with %.60g takes up to 67 bytes.
+  char buffer[128];
+  for (uint32_t i = (1u << 24) + 1; i < (1u << 24) + 20001; i += 2)
+  {
+    for (const char* format : {"%u", "%u.0000001", "%u.9999999"})
+    {
+      std::snprintf(buffer, sizeof(buffer), format, i);
+      ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+    }
+    std::snprintf(buffer, sizeof(buffer), "%u.999999", i - 1);
+    ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+  }
+
+  // The exact midpoints of adjacent floats, and values straight next to them
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-1000.0f, 1000.0f);
+  for (int i = 0; i < 20000; ++i)
+  {
+    const float low  = dist(rng);
+    const float high = std::nextafter(low, 2000.0f);
+    const double mid = (double(low) + double(high)) / 2.0;
+    for (double d : {mid, std::nextafter(mid, 0.0), std::nextafter(mid, 1e9)})
+    {
+      std::snprintf(buffer, sizeof(buffer), "%.60g", d);
+      ASSERT_TRUE(parseFloatMatchesStrtof(buffer));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseFloatRandomStrings)
+{
+  std::mt19937 rng(42);
+  auto pick = [&](int low, int high) {
+    return std::uniform_int_distribution<int>(low, high)(rng);
+  };
+
+  for (int i = 0; i < 200000; ++i)
+  {
+    std::string text;
+    switch (pick(0, 2))
+    {
+    case 0: text += '-'; break;
+    case 1: text += '+'; break;
+    default: break;
+    }
+
+    const int digits = pick(1, 25);
+    const int dot    = pick(-1, digits);
+    for (int d = 0; d < digits; ++d)
+    {
+      if (d == dot)
+      {
+        text += '.';
+      }
+      text += static_cast<char>('0' + pick(0, 9));
+    }
+
+    if (pick(0, 1))
+    {
+      text += (pick(0, 1) ? 'e' : 'E');
+      text += std::to_string(pick(-50, 45));
+    }
+    ASSERT_TRUE(parseFloatMatchesStrtof(text));
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CachedLoadHitsOnSecondLoad)
+{
+  namespace fs = std::filesystem;
+
+  static const std::string FILE_NAME = "test_cached.obj";
+  writeTestFile(FILE_NAME, CALLBACK_INPUT);
+
+  ObjParser::CacheOptions options;
+  options.cacheDirectory = "test_cache";
+  fs::remove_all(options.cacheDirectory);
+
+  auto expected = ObjParser::loadAsAggregate(FILE_NAME);
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  auto cold = ObjParser::loadCached(FILE_NAME, options);
+  ASSERT_TRUE(cold.has_value()) << "Failed to parse";
+  EXPECT_FALSE(cold->cacheHit);
+  checkExpectedAggregate(cold->toAggregate(), *expected);
+
+  auto warm = ObjParser::loadCached(FILE_NAME, options);
+  ASSERT_TRUE(warm.has_value()) << "Failed to load cache";
+  EXPECT_TRUE(warm->cacheHit);
+  checkExpectedAggregate(warm->toAggregate(), *expected);
+  ASSERT_EQ(expected->faces.size(), warm->faceCount());
+  EXPECT_EQ(3u, warm->faceArity(0));
+
+  // Default location is next to the source
+  fs::remove(FILE_NAME + ".objcache");
+  EXPECT_FALSE(ObjParser::loadCached(FILE_NAME)->cacheHit);
+  EXPECT_TRUE(fs::exists(FILE_NAME + ".objcache"));
+  EXPECT_TRUE(ObjParser::loadCached(FILE_NAME)->cacheHit);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, CachedLoadDetectsStaleAndDamagedCache)
+{
+  namespace fs = std::filesystem;
+
+  static const std::string FILE_NAME = "test_cached_stale.obj";
+  writeTestFile(FILE_NAME, "v 1 2 3\nv 4 5 6\nf 1 2 1\n");
+  fs::remove(FILE_NAME + ".objcache");
+  ASSERT_TRUE(ObjParser::loadCached(FILE_NAME).has_value());
+
+  // Same size and possibly the same modification time: only the content hash
+  // can tell the two apart
+  writeTestFile(FILE_NAME, "v 1 2 3\nv 4 5 7\nf 1 2 1\n");
+  auto changed = ObjParser::loadCached(FILE_NAME);
+  ASSERT_TRUE(changed.has_value()) << "Failed to parse";
+  EXPECT_FALSE(changed->cacheHit);
+  ASSERT_EQ(2u, changed->positions.size());
+  EXPECT_EQ(7.0f, changed->positions[1].z);
+
+  // A truncated cache file is rejected and rewritten
+  const std::string cacheFile = FILE_NAME + ".objcache";
+  fs::resize_file(cacheFile, fs::file_size(cacheFile) - 8);
+  auto truncated = ObjParser::loadCached(FILE_NAME);
+  ASSERT_TRUE(truncated.has_value()) << "Failed to parse";
+  EXPECT_FALSE(truncated->cacheHit);
+  EXPECT_TRUE(ObjParser::loadCached(FILE_NAME)->cacheHit);
+
+  // Parse failures are not cached
+  writeTestFile(FILE_NAME, "abc 1 2 3\n");
+  EXPECT_FALSE(ObjParser::loadCached(FILE_NAME).has_value());
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GrammarsAreReusedPerThread)
+{
+  using It     = std::string::const_iterator;
+  using Data   = ObjParser::ObjAggregate;
+  using Parser = ObjParser::ObjParserSemanticActions<Data, It>;
+
+  // Grammars overload unary &, hence std::addressof
+  auto grammar = [] {
+    return std::addressof(ObjParser::threadLocalGrammar<Parser>());
+  };
+
+  const Parser* mainGrammar = grammar();
+  EXPECT_EQ(mainGrammar, grammar());
+
+  const Parser* workerGrammar = nullptr;
+  std::thread worker([&] { workerGrammar = grammar(); });
+  worker.join();
+  EXPECT_NE(mainGrammar, workerGrammar);
+
+  // A reused grammar gives the same result every time, also after a failure
+  auto expected
+    = ObjParser::parseAsAggregate(CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+  ASSERT_TRUE(expected.has_value()) << "Failed to parse";
+
+  static const std::string INVALID = "v 1 2 3\nabc\n";
+  EXPECT_FALSE(ObjParser::parseAsAggregate(INVALID.begin(), INVALID.end()));
+
+  for (int i = 0; i < 3; ++i)
+  {
+    auto agg = ObjParser::parseAsAggregate(
+      CALLBACK_INPUT.begin(), CALLBACK_INPUT.end());
+    ASSERT_TRUE(agg.has_value()) << "Failed to parse";
+    checkExpectedAggregate(*agg, *expected);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseErrorReportsPosition)
+{
+  using Kind = ObjParser::ElementKind;
+  struct Case
+  {
+    const char* input;
+    size_t offset;
+    size_t line;
+    size_t column;
+    Kind expected;
+    const char* snippet;
+  };
+  static const Case CASES[] = {
+    {"v 1 2 3\nvn 0 0 x\n", 8, 2, 1, Kind::Normal, "vn 0 0 x"},
+    {"v 1 2 3 abc\r\n", 0, 1, 1, Kind::Position, "v 1 2 3 abc"},
+    {"v 1 2 3\nf 1 2 x\n", 8, 2, 1, Kind::Face, "f 1 2 x"},
+    {"vn 0 0\n1\n", 0, 1, 1, Kind::Normal, "vn 0 0"},
+    {"# comment\n\n  vt\n", 13, 3, 3, Kind::TexCoord, "vt"},
+    {"f 1 2 3\nf a b c", 8, 2, 1, Kind::Face, "f a b c"},
+    {"v 1 2 3\nv\n", 8, 2, 1, Kind::Position, "v"},
+    {"vp 0.5\n", 0, 1, 1, Kind::Any, "vp 0.5"},
+  };
+
+  for (const Case& c : CASES)
+  {
+    const std::string input = c.input;
+    ObjParser::ParseError error;
+    EXPECT_FALSE(
+      ObjParser::parseAsAggregate(input.begin(), input.end(), &error))
+      << input;
+    EXPECT_STREQ("unparsed", error.message);
+    EXPECT_EQ(c.line, error.line) << input;
+    EXPECT_EQ(c.column, error.column) << input;
+    EXPECT_EQ(c.expected, error.expected) << input;
+    EXPECT_STREQ(c.snippet, error.snippet) << input;
+    EXPECT_EQ(c.offset, error.offset) << input;
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseErrorSnippetIsBounded)
+{
+  std::string input = "v 1 2 3\n" + std::string(1 << 20, 'x');
+
+  ObjParser::ParseError error;
+  EXPECT_FALSE(ObjParser::parseAsFlatAggregate(
+    input.data(), input.data() + input.size(), {}));
+  EXPECT_FALSE(
+    ObjParser::parseAsFlatAggregate(input.begin(), input.end(), &error));
+  EXPECT_EQ(ObjParser::ParseError::MAX_SNIPPET, std::strlen(error.snippet));
+  EXPECT_EQ(8u, error.offset);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ParseErrorFromEveryEntryPoint)
+{
+  std::string input;
+  for (int i = 0; i < 100; ++i)
+  {
+    input += "v 1 2 3\n";
+  }
+  input += "vn 1 2\n";
+  const size_t expectedOffset = 100 * 8;
+
+  auto check = [&](const ObjParser::ParseError& error) {
+    EXPECT_EQ(101u, error.line);
+    EXPECT_EQ(1u, error.column);
+    EXPECT_EQ(expectedOffset, error.offset);
+    EXPECT_EQ(ObjParser::ElementKind::Normal, error.expected);
+    EXPECT_STREQ("vn 1 2", error.snippet);
+  };
+
+  // Line numbers count from the start of the buffer, not of the chunk
+  for (unsigned threads : {1u, 4u})
+  {
+    ObjParser::ParseError error;
+    ObjParser::ParseOptions options;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+    options.error        = &error;
+    EXPECT_FALSE(ObjParser::parseAsSoaAggregate(
+      input.data(), input.data() + input.size(), options));
+    check(error);
+  }
+
+  // ...and of the stream, not of the block
+  for (size_t blockSize : {1, 64, 4096})
+  {
+    ObjParser::ParseError error;
+    std::istringstream in(input);
+    ObjParser::ObjCallbacks callbacks;
+    EXPECT_FALSE(
+      ObjParser::parseWithCallbacks(in, callbacks, blockSize, &error));
+    check(error);
+  }
+
+  static const std::string FILE_NAME = "test_parse_error.obj";
+  writeTestFile(FILE_NAME, input);
+  for (bool memoryMap : {false, true})
+  {
+    ObjParser::ParseError error;
+    ObjParser::LoadOptions options;
+    options.memoryMap = memoryMap;
+    options.error     = &error;
+    EXPECT_FALSE(ObjParser::loadAsVariant(FILE_NAME, options));
+    check(error);
+
+    EXPECT_FALSE(ObjParser::loadAsAggregate("no_such_file.obj", options));
+    EXPECT_STREQ("File open failed", error.message);
+    EXPECT_EQ(0u, error.line);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, LenientParseSkipsBadLines)
+{
+  static const std::string INPUT = "v 1 2 3\n"
+                                   "o cube\n"
+                                   "vp 0.5 0.5\n"
+                                   "g side\n"
+                                   "s 1\n"
+                                   "v 4 5 6\n"
+                                   "l 1 2\n"
+                                   "p 1\n"
+                                   "vn 1 2\n"
+                                   "f 1 2 1\n"
+                                   "curv 0 1 2\n"
+                                   "v 7 8 9\n"
+                                   "f 1 2 3\n";
+
+  ObjParser::ObjAggregate expected;
+  expected.positions = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+  expected.faces     = {{{1, 0, 0}, {2, 0, 0}, {1, 0, 0}},
+                    {{1, 0, 0}, {2, 0, 0}, {3, 0, 0}}};
+
+  auto checkDiagnostics = [](const ObjParser::ParseDiagnostics& diagnostics) {
+    EXPECT_EQ(8u, diagnostics.skippedLines());
+    EXPECT_EQ(1u, diagnostics.parameterVertices);
+    EXPECT_EQ(1u, diagnostics.objects);
+    EXPECT_EQ(1u, diagnostics.groups);
+    EXPECT_EQ(1u, diagnostics.smoothingGroups);
+    EXPECT_EQ(1u, diagnostics.polylines);
+    EXPECT_EQ(1u, diagnostics.points);
+    EXPECT_EQ(1u, diagnostics.malformed);
+    EXPECT_EQ(1u, diagnostics.unknown);
+    EXPECT_EQ(2u, diagnostics.firstSkipped.line);
+    EXPECT_EQ(8u, diagnostics.firstSkipped.offset);
+    EXPECT_STREQ("o cube", diagnostics.firstSkipped.snippet);
+  };
+
+  // Strict mode still fails on the first bad line
+  ObjParser::ParseError error;
+  EXPECT_FALSE(ObjParser::parseAsAggregate(INPUT.begin(), INPUT.end(), &error));
+  EXPECT_EQ(2u, error.line);
+
+  for (unsigned threads : {1u, 4u})
+  {
+    ObjParser::ParseDiagnostics diagnostics;
+    ObjParser::ParseOptions options;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+    options.lenient      = true;
+    options.diagnostics  = &diagnostics;
+    auto data            = ObjParser::parseAsFlatAggregate(
+      INPUT.data(), INPUT.data() + INPUT.size(), options);
+    ASSERT_TRUE(data.has_value()) << "Failed to parse";
+    checkExpectedFlatAggregate(*data, expected);
+    checkDiagnostics(diagnostics);
+  }
+
+  static const std::string FILE_NAME = "test_lenient.obj";
+  writeTestFile(FILE_NAME, INPUT);
+  for (bool memoryMap : {false, true})
+  {
+    ObjParser::ParseDiagnostics diagnostics;
+    ObjParser::LoadOptions options;
+    options.memoryMap   = memoryMap;
+    options.lenient     = true;
+    options.diagnostics = &diagnostics;
+    auto data           = ObjParser::loadAsAggregate(FILE_NAME, options);
+    ASSERT_TRUE(data.has_value()) << "Failed to parse";
+    checkExpectedAggregate(*data, expected);
+    checkDiagnostics(diagnostics);
+  }
+
+  // The counts survive a cache round trip, and a strict load ignores the
+  // partial mesh cached by a lenient one
+  std::filesystem::remove(FILE_NAME + ".objcache");
+  for (bool cacheHit : {false, true})
+  {
+    ObjParser::ParseDiagnostics diagnostics;
+    ObjParser::CacheOptions options;
+    options.lenient     = true;
+    options.diagnostics = &diagnostics;
+    auto data           = ObjParser::loadCached(FILE_NAME, options);
+    ASSERT_TRUE(data.has_value()) << "Failed to parse";
+    EXPECT_EQ(cacheHit, data->cacheHit);
+    checkExpectedAggregate(data->toAggregate(), expected);
+    checkDiagnostics(diagnostics);
+  }
+  EXPECT_FALSE(ObjParser::loadCached(FILE_NAME).has_value());
+
+  // Skipping resumes after a lone '\r' as well, and takes "\r\n" as one end
+  for (const char* lineEnd : {"\r", "\r\n"})
+  {
+    std::string input;
+    for (char c : INPUT)
+    {
+      input += (c == '\n') ? std::string(lineEnd) : std::string(1, c);
+    }
+    for (unsigned threads : {1u, 4u})
+    {
+      ObjParser::ParseDiagnostics diagnostics;
+      ObjParser::ParseOptions options;
+      options.threadCount  = threads;
+      options.minChunkSize = 1;
+      options.lenient      = true;
+      options.diagnostics  = &diagnostics;
+      auto data            = ObjParser::parseAsFlatAggregate(
+        input.data(), input.data() + input.size(), options);
+      ASSERT_TRUE(data.has_value()) << "Failed to parse";
+      checkExpectedFlatAggregate(*data, expected);
+      EXPECT_EQ(8u, diagnostics.skippedLines());
+    }
+
+    writeTestFile(FILE_NAME, input);
+    ObjParser::ParseDiagnostics diagnostics;
+    ObjParser::LoadOptions options;
+    options.lenient     = true;
+    options.diagnostics = &diagnostics;
+    auto data           = ObjParser::loadAsAggregate(FILE_NAME, options);
+    ASSERT_TRUE(data.has_value()) << "Failed to parse";
+    checkExpectedAggregate(*data, expected);
+    EXPECT_EQ(8u, diagnostics.skippedLines());
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, KeywordsAndCornersAreStrict)
+{
+  static const std::string MIXED_CORNERS = "f 1 2/3 4//5 6/7/8 -1/-2\n";
+  const std::vector<ObjParser::Face> expected = {
+    {{1, 0, 0}, {2, 3, 0}, {4, 0, 5}, {6, 7, 8}, {-1, -2, 0}},
+  };
+  performTestVariant(MIXED_CORNERS, expected);
+
+  // Keywords must not be split, and every '/' must be followed by an index
+  for (const std::string input :
+       {"v n 1 2 3\n",
+        "v t 1 2\n",
+        "f 1 2 3/\n",
+        "f 1 2 3/4/\n",
+        "f 1 2 3//\n",
+        "f\n"})
+  {
+    EXPECT_FALSE(ObjParser::parseAsVariant(input.begin(), input.end()))
+      << input;
+    EXPECT_FALSE(ObjParser::parseAsFlatAggregate(
+      input.data(), input.data() + input.size(), {}))
+      << input;
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ElementsEndAtLineEnds)
+{
+  static const std::string INPUT = "v 1 2 3 # trailing comment\r\n"
+                                   " \t \n"
+                                   "\t# indented comment\n"
+                                   "mtllib scene.mtl\n"
+                                   "v 4 5 6\r"
+                                   "usemtl steel\n"
+                                   "f 1 2 1";
+  ObjParser::ObjAggregate expected;
+  expected.positions = {{1, 2, 3}, {4, 5, 6}};
+  expected.faces     = {{{1, 0, 0}, {2, 0, 0}, {1, 0, 0}}};
+  performTestAggregate(INPUT, expected);
+
+  // An element can no longer borrow numbers from the next line
+  for (const std::string input : {"v 1 2\n3\n", "f 1 2\n3\n", "vt\n1\n"})
+  {
+    EXPECT_FALSE(ObjParser::parseAsAggregate(input.begin(), input.end()))
+      << input;
+  }
+
+  // ...so a lenient parse drops a bad line whole
+  static const std::string BAD_FACE = "v 1 2 3\nf 1 2 x\nf 1 1 1\n";
+  ObjParser::ParseDiagnostics diagnostics;
+  ObjParser::ParseOptions options;
+  options.lenient     = true;
+  options.diagnostics = &diagnostics;
+  auto data           = ObjParser::parseAsFlatAggregate(
+    BAD_FACE.data(), BAD_FACE.data() + BAD_FACE.size(), options);
+  ASSERT_TRUE(data.has_value()) << "Failed to parse";
+  EXPECT_EQ(1u, data->faceCount());
+  EXPECT_EQ(1u, diagnostics.malformed);
+  EXPECT_STREQ("f 1 2 x", diagnostics.firstSkipped.snippet);
+}
+
+//------------------------------------------------------------------------------
+// Random OBJ text covering every form of every supported line. With badLines
+// about one line in ten is one the grammar rejects.
+std::string
+randomObj(std::mt19937& rng, size_t lineCount, bool badLines)
+{
+  static const char* FLOATS[]
+    = {"0", "1", "-2", "0.5", "-.25", "3.", "1e3", "-1.5E-2", "+7", "inf"};
+  static const char* ENDINGS[] = {"\n", "\r\n", " \n", "\t# note\n"};
+  static const char* IGNORED[]
+    = {"", "# comment", "mtllib scene.mtl", "usemtl steel", " \t"};
+  static const char* BAD[]
+    = {"vp 1 2", "o cube", "g side", "s 1", "v 1 2", "f 1/", "f", "vn 1 x"};
+
+  auto pick = [&](auto& array) {
+    return array[rng() % (sizeof(array) / sizeof(array[0]))];
+  };
+  auto index = [&] { return std::to_string(int(rng() % 50) - 10); };
+
+  std::string out;
+  for (size_t line = 0; line < lineCount; ++line)
+  {
+    const unsigned kind = rng() % (badLines ? 6 : 5);
+    if (kind == 0)
+    {
+      out += "v";
+      for (unsigned i = 3 + rng() % 2; i > 0; --i)
+      {
+        out = out + " " + pick(FLOATS);
+      }
+    }
+    else if (kind == 1)
+    {
+      out = out + "vn " + pick(FLOATS) + " " + pick(FLOATS) + " "
+            + pick(FLOATS);
+    }
+    else if (kind == 2)
+    {
+      out += "vt";
+      for (unsigned i = 1 + rng() % 3; i > 0; --i)
+      {
+        out = out + " " + pick(FLOATS);
+      }
+    }
+    else if (kind == 3)
+    {
+      out += "f";
+      for (unsigned i = 3 + rng() % 3; i > 0; --i)
+      {
+        const unsigned form = rng() % 4;
+        out += " " + index();
+        out += (form == 1 || form == 3) ? "/" + index() : "";
+        out += (form == 2) ? "//" + index() : "";
+        out += (form == 3) ? "/" + index() : "";
+      }
+    }
+    else if (kind == 4)
+    {
+      out += pick(IGNORED);
+    }
+    else
+    {
+      out += pick(BAD);
+    }
+    out += pick(ENDINGS);
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, X3GrammarMatchesQi)
+{
+  using namespace ObjParser;
+  using It = const char*;
+
+  auto compare = [](const std::string& input, bool lenient) {
+    SCOPED_TRACE(input);
+    const char* begin = input.data();
+    const char* end   = begin + input.size();
+
+    ParseError qiError, x3Error;
+    ParseDiagnostics qiSkipped, x3Skipped;
+    ParseOptions qiOptions, x3Options;
+    qiOptions.lenient = x3Options.lenient = lenient;
+    qiOptions.error                       = &qiError;
+    qiOptions.diagnostics                 = &qiSkipped;
+    x3Options.error                       = &x3Error;
+    x3Options.diagnostics                 = &x3Skipped;
+
+    auto expected = parseBufferImpl<ObjParserSemanticActions<ObjAggregate, It>,
+                                    ObjAggregate>(begin, end, qiOptions);
+    auto aggregate = parseBufferImpl<X3Grammar<ObjAggregate, It>, ObjAggregate>(
+      begin, end, x3Options);
+    ASSERT_EQ(expected.has_value(), aggregate.has_value()) << input;
+    EXPECT_EQ(qiError.offset, x3Error.offset) << input;
+    EXPECT_EQ(qiSkipped.skippedLines(), x3Skipped.skippedLines()) << input;
+    EXPECT_EQ(qiSkipped.firstSkipped.offset, x3Skipped.firstSkipped.offset);
+
+    auto variant = parseBufferImpl<X3Grammar<ObjVariantVec, It>, ObjVariantVec>(
+      begin, end, x3Options);
+    auto flat = parseBufferImpl<X3Grammar<ObjFlatAggregate, It>,
+                                ObjFlatAggregate>(begin, end, x3Options);
+    auto soa
+      = parseBufferImpl<X3Grammar<ObjSoaAggregate, It>, ObjSoaAggregate>(
+        begin, end, x3Options);
+    ASSERT_EQ(expected.has_value(), variant.has_value()) << input;
+    ASSERT_EQ(expected.has_value(), flat.has_value()) << input;
+    ASSERT_EQ(expected.has_value(), soa.has_value()) << input;
+    if (expected)
+    {
+      EXPECT_EQ(
+        (parseBufferImpl<ObjParserVariant<ObjVariantVec, It>, ObjVariantVec>(
+          begin, end, qiOptions)),
+        variant);
+      checkExpectedAggregate(*aggregate, *expected);
+      checkExpectedFlatAggregate(*flat, *expected);
+      checkExpectedSoaAggregate(*soa, *expected);
+    }
+  };
+
+  compare(CALLBACK_INPUT, false);
+  for (const std::string input :
+       {"", "\n", "v 1 2 3", "v 1 2 3 abc\n", "vn 0 0\n1\n", "f 1 2 3/\n"})
+  {
+    compare(input, false);
+    compare(input, true);
+  }
+
+  std::mt19937 rng(14);
+  for (int i = 0; i < 200; ++i)
+  {
+    compare(randomObj(rng, 50, false), false);
+    const std::string withBadLines = randomObj(rng, 50, true);
+    compare(withBadLines, false);
+    compare(withBadLines, true);
+  }
+}
+
+//------------------------------------------------------------------------------
+// A few random single character edits, from characters that matter to the
+// grammar (no 'a', so that no NaN can turn up and fail an equality check)
+std::string
+mutateObj(std::mt19937& rng, std::string text)
+{
+  static const char CHARS[] = "vntf/#-+.e0123456789 \t\r\nmi";
+  for (unsigned edits = 1 + rng() % 3; edits > 0 && !text.empty(); --edits)
+  {
+    const size_t at = rng() % text.size();
+    const char c    = CHARS[rng() % (sizeof(CHARS) - 1)];
+    switch (rng() % 3)
+    {
+    case 0: text[at] = c; break;
+    case 1: text.insert(text.begin() + at, c); break;
+    default: text.erase(at, 1); break;
+    }
+  }
+  return text;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ScannerMatchesSpirit)
+{
+  using namespace ObjParser;
+  using It = const char*;
+
+  auto compare = [](const std::string& input, bool lenient) {
+    SCOPED_TRACE(input);
+    const char* begin = input.data();
+    const char* end   = begin + input.size();
+
+    ParseError spiritError, scannerError;
+    ParseDiagnostics spiritSkipped, scannerSkipped;
+    ParseOptions spiritOptions, scannerOptions;
+    spiritOptions.lenient = scannerOptions.lenient = lenient;
+    spiritOptions.error                            = &spiritError;
+    spiritOptions.diagnostics                      = &spiritSkipped;
+    scannerOptions.error                           = &scannerError;
+    scannerOptions.diagnostics                     = &scannerSkipped;
+
+    auto expected
+      = parseBufferImpl<ObjParserSemanticActions<ObjAggregate, It>,
+                        ObjAggregate>(begin, end, spiritOptions);
+    auto actual = parseBufferImpl<ObjScanner, ObjAggregate>(
+      begin, end, scannerOptions);
+    ASSERT_EQ(expected.has_value(), actual.has_value());
+    EXPECT_STREQ(spiritError.message, scannerError.message);
+    EXPECT_EQ(spiritError.offset, scannerError.offset);
+    EXPECT_EQ(spiritSkipped.malformed, scannerSkipped.malformed);
+    EXPECT_EQ(spiritSkipped.unknown, scannerSkipped.unknown);
+    EXPECT_EQ(spiritSkipped.skippedLines(), scannerSkipped.skippedLines());
+    EXPECT_EQ(
+      spiritSkipped.firstSkipped.offset, scannerSkipped.firstSkipped.offset);
+    if (expected)
+    {
+      checkExpectedAggregate(*actual, *expected);
+    }
+  };
+
+  // The inputs of the tests above, and the corners of the grammar
+  compare(CALLBACK_INPUT, false);
+  for (const std::string input :
+       {"",
+        "\n",
+        " \t ",
+        "v 1 2 3",
+        "v 1 2 3 abc\r\n",
+        "vn 0 0\n1\n",
+        "# comment\n\n  vt\n",
+        "f 1 2 3\nf a b c",
+        "vp 0.5\n",
+        "v n 1 2 3\n",
+        "f 1 2 3/\nf 1 2 3/4/\nf 1 2 3//\nf\n",
+        "f 1 2/3 4//5 6/7/8 -1/-2\n",
+        "f 1 / 2 3/ /4 5 /6/ 7\n",
+        "v1 2 3\nvn1 2 3\nvt1\nf1 2 3\n",
+        "v 1.5-2+3\n",
+        "vninf 1 2\n",
+        "f 2147483647 -2147483648 1\n",
+        "f 2147483648 1 1\n",
+        "f 99999999999999999999 1 1\n",
+        "f -2147483649 1 1\n",
+        "mtllibfoo\nusemtl\nmtllib a b # c\r",
+        "v 1 2 3 # trailing comment\r\n \t \n\t# indented\nv 4 5 6\rf 1 2 1",
+        "v 1 2 3\no cube\nvp 0.5 0.5\ng side\ns 1\nv 4 5 6\nl 1 2\n"
+        "p 1\nvn 1 2\nf 1 2 1\ncurv 0 1 2\nv 7 8 9\nf 1 2 3\n"})
+  {
+    compare(input, false);
+    compare(input, true);
+  }
+
+  // A failed vn falls back to a position, as in the grammar
+  static const std::string NAN_POSITION = "vnan 1 2\n";
+  auto nanPosition = parseAsAggregate<ScannerBackend>(
+    NAN_POSITION.data(), NAN_POSITION.data() + NAN_POSITION.size(), {});
+  ASSERT_TRUE(nanPosition.has_value());
+  ASSERT_EQ(1u, nanPosition->positions.size());
+  EXPECT_TRUE(std::isnan(nanPosition->positions[0].x));
+
+  std::mt19937 rng(15);
+  for (int i = 0; i < 500; ++i)
+  {
+    const std::string input = randomObj(rng, 50, i % 2 == 1);
+    compare(input, false);
+    const std::string mutated = mutateObj(rng, input);
+    compare(mutated, false);
+    compare(mutated, true);
+  }
+
+  // Through the library interface, in chunks and from a file
+  const std::string input = randomObj(rng, 2000, true);
+  auto expected
+    = parseAsAggregate(input.data(), input.data() + input.size(), {});
+  ASSERT_FALSE(expected.has_value());
+  ParseOptions options;
+  options.lenient      = true;
+  options.threadCount  = 4;
+  options.minChunkSize = 1;
+  expected
+    = parseAsAggregate(input.data(), input.data() + input.size(), options);
+  auto actual = parseAsAggregate<ScannerBackend>(
+    input.data(), input.data() + input.size(), options);
+  ASSERT_TRUE(expected.has_value() && actual.has_value());
+  checkExpectedAggregate(*actual, *expected);
+
+  static const std::string FILE_NAME = "test_scanner.obj";
+  writeTestFile(FILE_NAME, input);
+  for (bool memoryMap : {false, true})
+  {
+    LoadOptions loadOptions;
+    loadOptions.memoryMap = memoryMap;
+    loadOptions.lenient   = true;
+    auto loaded = loadAsAggregate<ScannerBackend>(FILE_NAME, loadOptions);
+    ASSERT_TRUE(loaded.has_value());
+    checkExpectedAggregate(*loaded, *expected);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, LineIndexFindsAndClassifiesLines)
+{
+  using namespace ObjParser;
+  using Type = LineType;
+
+  static const std::string INPUT = "v 1 2 3\r\n"
+                                   "  vn 0 0 1\r"
+                                   "\tvt 0.5\n"
+                                   "f 1 2 3\n"
+                                   "\n"
+                                   "# comment\n"
+                                   "mtllib a.mtl\n"
+                                   "usemtlx\n"
+                                   "vp 1 2\n"
+                                   "v1 2 3\n"
+                                   "   ";
+  const std::vector<std::pair<size_t, Type>> expected = {
+    {0, Type::Position},
+    {11, Type::Normal},
+    {21, Type::TexCoord},
+    {28, Type::Face},
+    {36, Type::Blank},
+    {37, Type::Comment},
+    {47, Type::Material},
+    {60, Type::Material},
+    {68, Type::Other},
+    {75, Type::Other},
+    {85, Type::Blank},
+  };
+
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+  {
+    const LineIndex index
+      = buildLineIndex(INPUT.data(), INPUT.data() + INPUT.size(), level);
+    ASSERT_EQ(expected.size(), index.size());
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+      EXPECT_EQ(expected[i].first, size_t(index.line(i) - INPUT.data()));
+      EXPECT_EQ(expected[i].second, index.type(i));
+    }
+  }
+
+  // Every kernel agrees with the scalar one, whatever the alignment of the
+  // line ends relative to the vector width
+  std::mt19937 rng(16);
+  for (int i = 0; i < 200; ++i)
+  {
+    std::string input = randomObj(rng, 40, true);
+    for (char& c : input)
+    {
+      c = (c == '\n' && rng() % 4 == 0) ? '\r' : c;
+    }
+    const char* begin = input.data() + rng() % 8;
+    const char* end   = input.data() + input.size();
+    const LineIndex scalar = buildLineIndex(begin, end, SimdLevel::Scalar);
+    EXPECT_EQ(scalar.lines, buildLineIndex(begin, end, SimdLevel::Sse2).lines);
+    EXPECT_EQ(scalar.lines, buildLineIndex(begin, end, SimdLevel::Avx2).lines);
+    EXPECT_EQ(scalar.lines, buildLineIndex(begin, end).lines);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, LineIndexedParseMatches)
+{
+  using namespace ObjParser;
+
+  std::mt19937 rng(16);
+  std::string input;
+  for (int i = 0; i < 20; ++i)
+  {
+    input += randomObj(rng, 200, false);
+  }
+  std::string withBadLines = input;
+  withBadLines += randomObj(rng, 1000, true);
+
+  ParseOptions options;
+  options.lenient = true;
+  auto expected   = parseAsAggregate(
+    withBadLines.data(), withBadLines.data() + withBadLines.size(), options);
+  ASSERT_TRUE(expected.has_value());
+
+  for (unsigned threads : {1u, 4u})
+  {
+    ParseDiagnostics plain, indexed;
+    options.threadCount  = threads;
+    options.minChunkSize = 1;
+    options.presize      = true;
+    options.diagnostics  = &plain;
+    options.lineIndex    = false;
+    auto scanned         = parseAsAggregate<ScannerBackend>(
+      withBadLines.data(), withBadLines.data() + withBadLines.size(), options);
+    options.diagnostics = &indexed;
+    options.lineIndex   = true;
+    auto spirit         = parseAsAggregate(
+      withBadLines.data(), withBadLines.data() + withBadLines.size(), options);
+    auto scannedIndexed = parseAsAggregate<ScannerBackend>(
+      withBadLines.data(), withBadLines.data() + withBadLines.size(), options);
+    ASSERT_TRUE(scanned && spirit && scannedIndexed);
+    checkExpectedAggregate(*scanned, *expected);
+    checkExpectedAggregate(*spirit, *expected);
+    checkExpectedAggregate(*scannedIndexed, *expected);
+    EXPECT_EQ(plain.skippedLines(), indexed.skippedLines());
+    EXPECT_EQ(plain.firstSkipped.offset, indexed.firstSkipped.offset);
+
+    // The index gives the same presize counts as countElements()
+    const char* begin = input.data();
+    const char* end   = begin + input.size();
+    const ObjCounts counts = countElements(begin, end);
+    const LineIndex index  = buildLineIndex(begin, end);
+    const ObjCounts fromIndex = countElements(index, 0, index.size());
+    EXPECT_EQ(counts.positions, fromIndex.positions);
+    EXPECT_EQ(counts.normals, fromIndex.normals);
+    EXPECT_EQ(counts.texCoords, fromIndex.texCoords);
+    EXPECT_EQ(counts.faces, fromIndex.faces);
+    EXPECT_EQ(counts.faceCorners, fromIndex.faceCorners);
+  }
+
+  // Strict failures are reported at the same place
+  ParseError plainError, indexedError;
+  ParseOptions strict;
+  strict.error = &plainError;
+  EXPECT_FALSE(parseAsAggregate<ScannerBackend>(
+    withBadLines.data(), withBadLines.data() + withBadLines.size(), strict));
+  strict.error     = &indexedError;
+  strict.lineIndex = true;
+  EXPECT_FALSE(parseAsAggregate<ScannerBackend>(
+    withBadLines.data(), withBadLines.data() + withBadLines.size(), strict));
+  EXPECT_EQ(plainError.offset, indexedError.offset);
+  EXPECT_STREQ(plainError.snippet, indexedError.snippet);
+}
+
+//------------------------------------------------------------------------------
+// Random text for face corners: pieces of well formed corners mixed with
+// blanks, signs, overflowing and over long indices and stray characters
+std::string
+randomCornerText(std::mt19937& rng)
+{
+  static const char* PIECES[] = {
+    "1", "23", "456", "12345678", "123456789", "0000000001", "2147483647",
+    "2147483648", "-2147483648", "-2147483649", "-7", "+8", "/", "/", "/",
+    "//", " ", "\t", "- 1", "x", "#", "\r\n",
+  };
+  auto pick = [&](auto& array) {
+    return array[rng() % (sizeof(array) / sizeof(array[0]))];
+  };
+  auto number = [&] { return std::to_string(int(rng() % 100000) - 1000); };
+
+  std::string out;
+  if (rng() % 2 == 0)
+  {
+    static const char* FORMS[] = {"", "/", "//", "/ /"};
+    out = number();
+    switch (rng() % 4)
+    {
+    case 0: break;
+    case 1: out += "/" + number(); break;
+    case 2: out += "//" + number(); break;
+    default: out += "/" + number() + "/" + number(); break;
+    }
+    out += pick(FORMS);
+  }
+  for (int i = rng() % 6; i > 0; --i)
+  {
+    out += pick(PIECES);
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, FaceCornerParserMatchesIntRule)
+{
+  namespace qi = boost::spirit::qi;
+  using ObjParser::FaceTriplet;
+
+  // The int_ based rule the grammars used before
+  using boost::phoenix::bind;
+  using qi::_1;
+  using qi::_val;
+  using qi::int_;
+  auto _vertex = bind(&FaceTriplet::vertexIndex, _val);
+  auto _uv     = bind(&FaceTriplet::uvIndex, _val);
+  auto _normal = bind(&FaceTriplet::normalIndex, _val);
+
+  qi::rule<const char*, FaceTriplet(), qi::blank_type> reference;
+  // clang-format off
+  reference = int_[_vertex = _1] >> -('/' >> (
+      (int_[_uv = _1] >> -('/' >> int_[_normal = _1]))
+      | ('/' >> int_[_normal = _1])
+    ));
+  // clang-format on
+
+  auto check = [&](const std::string& text, size_t length) {
+    SCOPED_TRACE(testing::PrintToString(text.substr(0, length)));
+    const char* last = text.data() + length;
+
+    const char* expectedEnd = text.data();
+    FaceTriplet expected;
+    const bool ok = qi::phrase_parse(
+      expectedEnd,
+      last,
+      reference,
+      qi::blank,
+      qi::skip_flag::dont_postskip,
+      expected);
+
+    const char* end = text.data();
+    FaceTriplet corner;
+    ASSERT_EQ(ok, ObjParser::parseFaceCorner(end, last, corner));
+    EXPECT_EQ(expectedEnd - text.data(), end - text.data());
+    EXPECT_EQ(expected, corner);
+
+    std::string::const_iterator it = text.begin();
+    FaceTriplet scalar;
+    ASSERT_EQ(
+      ok,
+      ObjParser::detail::parseFaceCornerScalar(
+        it, text.cbegin() + length, scalar));
+    EXPECT_EQ(expectedEnd - text.data(), it - text.begin());
+    EXPECT_EQ(expected, scalar);
+  };
+
+  for (std::string text :
+       {"1/2/3 4/5/6 7/8/9\n#########", "  -1//-2 -3//-4 -5//-6\n######"})
+  {
+    check(text, text.size());
+  }
+
+  std::mt19937 rng(17);
+  int fastPathCount = 0;
+  for (int i = 0; i < 20000; ++i)
+  {
+    const std::string text = std::string(rng() % 3, ' ')
+                             + randomCornerText(rng) + " "
+                             + randomCornerText(rng) + "\nf 1 2 3\n";
+    check(text, text.size());
+    check(text, rng() % (text.size() + 1));
+    if (HasFatalFailure())
+    {
+      return;
+    }
+
+#ifdef OBJPARSER_HAS_SSE2
+    FaceTriplet corner;
+    const char* c = text.data();
+    ObjParser::detail::skipFaceBlanks(c, text.data() + text.size());
+    fastPathCount += (text.data() + text.size() - c >= 40
+                      && ObjParser::detail::parseFaceCornerSse2(c, corner))
+                       ? 1
+                       : 0;
+#endif
+  }
+
+#ifdef OBJPARSER_HAS_SSE2
+  // About half the inputs start with a well formed corner, most of which the
+  // fast path takes
+  EXPECT_GT(fastPathCount, 4000);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// A mesh whose faces all have the given arity and corner form (0 to 3 for v,
+// v/vt, v//vn and v/vt/vn). With breaks, about one line in twenty is one that
+// does not fit that layout, or with badLines one the grammar rejects.
+std::string
+uniformObj(
+  std::mt19937& rng, int form, int arity, bool breaks, bool badLines = false)
+{
+  static const char* BREAKS[] = {
+    "# comment", "", "usemtl steel", "mtllib a.mtl", "v 1 2 3 0.5",
+    "v 1 2 3 # c", "  v 1 2 3", "vt 0.5", "vt 0.5 0.5 0.5", "f 1 2 3 4 5",
+    "f 1/1 2/2 3/3", "f 1//1 2//2 3//3 4//4", "f 1 / 2 3", "f +1 2 3",
+    "f 1234567890 1 1", "v 1 2 3\r", "vn 1 2 3 \t",
+  };
+  static const char* BAD[] = {"f 1/", "v 1 2", "vn 1 x", "o cube", "f"};
+  static const char* ENDINGS[] = {"\n", "\n", "\n", "\r\n", " \n"};
+
+  auto pick = [&](auto& array) {
+    return array[rng() % (sizeof(array) / sizeof(array[0]))];
+  };
+  auto number = [&] { return std::to_string(int(rng() % 2000) - 1000); };
+  auto index  = [&] { return std::to_string(int(rng() % 200000) - 100); };
+
+  std::string out;
+  auto line = [&](const std::string& text) {
+    out += text + pick(ENDINGS);
+    if (breaks && rng() % 20 == 0)
+    {
+      out += std::string(pick(BREAKS)) + "\n";
+    }
+    if (badLines && rng() % 50 == 0)
+    {
+      out += std::string(pick(BAD)) + "\n";
+    }
+  };
+
+  for (int i = 0; i < 100; ++i)
+  {
+    line("v " + number() + ".5 " + number() + " " + number() + "e-3");
+    line("vn " + number() + " " + number() + ".25 " + number());
+    line("vt 0." + number().substr(1) + " " + number());
+  }
+  for (int i = 0; i < 200; ++i)
+  {
+    std::string face = "f";
+    for (int corner = 0; corner < arity; ++corner)
+    {
+      face += " " + index();
+      face += (form == 1 || form == 3) ? "/" + index() : "";
+      face += (form == 2) ? "//" + index() : "";
+      face += (form == 3) ? "/" + index() : "";
+    }
+    line(face);
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, UniformFastPathMatchesGrammar)
+{
+  using namespace ObjParser;
+  using It = const char*;
+
+  auto compare = [](const std::string& input, bool lenient) {
+    SCOPED_TRACE(input.substr(0, 200));
+    const char* begin = input.data();
+    const char* end   = begin + input.size();
+
+    ParseError generalError, uniformError;
+    ParseDiagnostics generalSkipped, uniformSkipped;
+    ParseOptions general, fast;
+    general.lenient = fast.lenient = lenient;
+    general.error                  = &generalError;
+    general.diagnostics            = &generalSkipped;
+    fast.error                     = &uniformError;
+    fast.diagnostics               = &uniformSkipped;
+    fast.uniform                   = true;
+
+    auto expected
+      = parseBufferImpl<ObjParserSemanticActions<ObjAggregate, It>,
+                        ObjAggregate>(begin, end, general);
+    auto aggregate
+      = parseBufferImpl<ObjParserSemanticActions<ObjAggregate, It>,
+                        ObjAggregate>(begin, end, fast);
+    ASSERT_EQ(expected.has_value(), aggregate.has_value());
+    EXPECT_STREQ(generalError.message, uniformError.message);
+    EXPECT_EQ(generalError.offset, uniformError.offset);
+    EXPECT_EQ(generalSkipped.malformed, uniformSkipped.malformed);
+    EXPECT_EQ(generalSkipped.skippedLines(), uniformSkipped.skippedLines());
+    EXPECT_EQ(
+      generalSkipped.firstSkipped.offset, uniformSkipped.firstSkipped.offset);
+
+    auto scanned  = parseBufferImpl<ObjScanner, ObjAggregate>(begin, end, fast);
+    auto variant  = parseBufferImpl<ObjParserVariant<ObjVariantVec, It>,
+                                   ObjVariantVec>(begin, end, fast);
+    auto flat     = parseBufferImpl<ObjParserFlatActions<ObjFlatAggregate, It>,
+                                ObjFlatAggregate>(begin, end, fast);
+    auto soa      = parseBufferImpl<ObjParserSoaActions<ObjSoaAggregate, It>,
+                               ObjSoaAggregate>(begin, end, fast);
+    fast.threadCount  = 4;
+    fast.minChunkSize = 256;
+    auto parallel     = parseAsFlatAggregate(begin, end, fast);
+    ASSERT_EQ(expected.has_value(), scanned.has_value());
+    ASSERT_EQ(expected.has_value(), variant.has_value());
+    ASSERT_EQ(expected.has_value(), flat.has_value());
+    ASSERT_EQ(expected.has_value(), soa.has_value());
+    ASSERT_EQ(expected.has_value(), parallel.has_value());
+    if (expected)
+    {
+      checkExpectedAggregate(*aggregate, *expected);
+      checkExpectedAggregate(*scanned, *expected);
+      EXPECT_EQ(
+        (parseBufferImpl<ObjParserVariant<ObjVariantVec, It>, ObjVariantVec>(
+          begin, end, general)),
+        variant);
+      checkExpectedFlatAggregate(*flat, *expected);
+      checkExpectedSoaAggregate(*soa, *expected);
+      checkExpectedFlatAggregate(*parallel, *expected);
+    }
+  };
+
+  compare(CALLBACK_INPUT, false);
+  for (const std::string input :
+       {"", "\n", "v", "v 1 2 3", "f 1 2 3", "f 1 2 3\nf 1/", "vn 0 0\n1\n"})
+  {
+    compare(input, false);
+    compare(input, true);
+  }
+
+  std::mt19937 rng(18);
+  for (int form = 0; form < 4; ++form)
+  {
+    for (int arity = 3; arity <= 5; ++arity)
+    {
+      const std::string clean = uniformObj(rng, form, arity, false);
+      compare(clean, false);
+
+      // A file in a specialised layout is parsed by the fast path alone
+      const char* end   = clean.data() + clean.size();
+      const char* faces = clean.data() + clean.find("\nf ") + 1;
+      const char* first = clean.data();
+      ObjAggregate data;
+      uniform::parseLines(
+        uniform::sampleFaceLayout(faces, end), first, end, data);
+      EXPECT_EQ((arity == 5) ? faces : end, first) << form << " " << arity;
+      EXPECT_EQ(300u, data.positions.size() + data.normals.size()
+                        + data.texCoords.size());
+
+      // Lines outside the layout are still valid, so these parse in full
+      const std::string broken = uniformObj(rng, form, arity, true);
+      EXPECT_TRUE(
+        parseAsFlatAggregate(broken.data(), broken.data() + broken.size(), {})
+          .has_value());
+      compare(broken, false);
+      const std::string withBadLines = uniformObj(rng, form, arity, true, true);
+      compare(withBadLines, false);
+      compare(withBadLines, true);
+    }
+  }
+  for (int i = 0; i < 50; ++i)
+  {
+    compare(randomObj(rng, 50, false), false);
+    compare(randomObj(rng, 50, true), true);
+  }
+}
+
+//------------------------------------------------------------------------------
+// The part of a full parse that an attribute mask selects
+template <ObjParser::Attributes MASK>
+ObjParser::ObjSelectedAggregate<MASK>
+selectAttributes(const ObjParser::ObjAggregate& full)
+{
+  ObjParser::ObjSelectedAggregate<MASK> data;
+  for (const auto& v : full.positions)
+  {
+    storeSelected(data, v);
+  }
+  for (const auto& n : full.normals)
+  {
+    storeSelected(data, n);
+  }
+  for (const auto& uv : full.texCoords)
+  {
+    storeSelected(data, uv);
+  }
+  for (const auto& face : full.faces)
+  {
+    storeSelectedFace(data, face);
+  }
+  return data;
+}
+
+//------------------------------------------------------------------------------
+template <ObjParser::Attributes MASK>
+void
+checkSelected(
+  const ObjParser::ObjSelectedAggregate<MASK>& actual,
+  const ObjParser::ObjSelectedAggregate<MASK>& expected)
+{
+  EXPECT_EQ(expected.positions, actual.positions);
+  EXPECT_EQ(expected.normals, actual.normals);
+  EXPECT_EQ(expected.texCoords, actual.texCoords);
+  EXPECT_TRUE(expected.faceCorners == actual.faceCorners);
+  EXPECT_EQ(expected.faceOffsets, actual.faceOffsets);
+}
+
+//------------------------------------------------------------------------------
+// Every backend and option, against the same parse with nothing left out
+template <ObjParser::Attributes MASK>
+void
+compareSelected(const std::string& input)
+{
+  using namespace ObjParser;
+  using Data = ObjSelectedAggregate<MASK>;
+  using It   = const char*;
+
+  SCOPED_TRACE(input.substr(0, 200));
+  const char* begin = input.data();
+  const char* end   = begin + input.size();
+
+  auto full = parseAsAggregate(begin, end);
+  ASSERT_TRUE(full.has_value());
+  const Data expected = selectAttributes<MASK>(*full);
+
+  ParseOptions threaded;
+  threaded.threadCount  = 4;
+  threaded.minChunkSize = 256;
+  ParseOptions indexed;
+  indexed.lineIndex = true;
+  indexed.presize   = true;
+  ParseOptions fast;
+  fast.uniform = true;
+
+  std::vector<std::optional<Data>> parsed;
+  parsed.push_back(parseAsAggregate<SpiritBackend, MASK>(begin, end));
+  parsed.push_back(parseAsAggregate<ScannerBackend, MASK>(begin, end));
+  parsed.push_back(parseAsAggregate<SpiritBackend, MASK>(
+    input.begin(), input.end()));
+  parsed.push_back(parseAsAggregate<SpiritBackend, MASK>(begin, end, threaded));
+  parsed.push_back(
+    parseAsAggregate<ScannerBackend, MASK>(begin, end, threaded));
+  parsed.push_back(parseAsAggregate<ScannerBackend, MASK>(begin, end, indexed));
+  parsed.push_back(parseAsAggregate<SpiritBackend, MASK>(begin, end, fast));
+  parsed.push_back(parseBufferImpl<X3Grammar<Data, It>, Data>(begin, end, {}));
+  for (size_t i = 0; i < parsed.size(); ++i)
+  {
+    SCOPED_TRACE(i);
+    ASSERT_TRUE(parsed[i].has_value());
+    checkSelected(*parsed[i], expected);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, SelectedAttributesMatchFullParse)
+{
+  using namespace ObjParser;
+  using A = Attributes;
+
+  // Face channels that are not selected take no space
+  static_assert(sizeof(SelectedCorner<A::Faces>) == sizeof(int));
+  static_assert(
+    sizeof(SelectedCorner<A::Faces | A::FaceNormals>) == 2 * sizeof(int));
+  static_assert(sizeof(SelectedCorner<A::All>) == sizeof(FaceTriplet));
+  static_assert(
+    std::is_same_v<SelectedAggregate<A::All>, ObjAggregate>);
+
+  std::mt19937 rng(19);
+  std::vector<std::string> inputs = {CALLBACK_INPUT, "", "f 1 2 3", "vn 1 2 3"};
+  for (int i = 0; i < 20; ++i)
+  {
+    inputs.push_back(randomObj(rng, 200, false));
+  }
+  inputs.push_back(uniformObj(rng, 3, 3, false));
+  inputs.push_back(uniformObj(rng, 2, 4, true));
+
+  // Keywords without a blank after them are parsed, not skipped
+  inputs.push_back("v1 2 3\nvn1 2 3\nvt1\nf1 2 3\n");
+
+  for (const std::string& input : inputs)
+  {
+    compareSelected<A::Positions | A::Faces>(input);
+    compareSelected<A::Positions | A::Normals | A::Faces | A::FaceNormals>(
+      input);
+    compareSelected<A::TexCoords | A::Faces | A::FaceUvs>(input);
+    compareSelected<A::Normals>(input);
+    compareSelected<A::Positions | A::Normals | A::TexCoords>(input);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, SelectedAttributesSkipLinesUnread)
+{
+  using namespace ObjParser;
+  using A = Attributes;
+
+  // Lines of a type left out are not checked, lines of any other type are
+  const std::string input = "v 1 2 3\nvn 1 x\nvt\nf 1 2 3\n";
+  const char* begin       = input.data();
+  const char* end         = begin + input.size();
+  EXPECT_FALSE(parseAsAggregate(begin, end).has_value());
+  auto spirit = parseAsAggregate<SpiritBackend, A::Positions | A::Faces>(
+    begin, end);
+  auto scanned = parseAsAggregate<ScannerBackend, A::Positions | A::Faces>(
+    begin, end);
+  ASSERT_TRUE(spirit.has_value());
+  ASSERT_TRUE(scanned.has_value());
+  EXPECT_EQ(1u, spirit->positions.size());
+  EXPECT_EQ(1u, spirit->faceCount());
+  checkSelected(*scanned, *spirit);
+  EXPECT_FALSE((parseAsAggregate<SpiritBackend, A::Positions | A::Normals>(
+                  begin, end))
+                 .has_value());
+  EXPECT_FALSE((parseAsAggregate<ScannerBackend, A::Positions | A::Normals>(
+                  begin, end))
+                 .has_value());
+
+  // Streamed and mapped loads
+  static const std::string FILE_NAME = "test_selected.obj";
+  writeTestFile(FILE_NAME, input);
+  LoadOptions streamOptions;
+  streamOptions.memoryMap = false;
+  auto mapped = loadAsAggregate<SpiritBackend, A::Positions | A::Faces>(
+    FILE_NAME);
+  auto streamed = loadAsAggregate<ScannerBackend, A::Positions | A::Faces>(
+    FILE_NAME, streamOptions);
+  ASSERT_TRUE(mapped.has_value());
+  ASSERT_TRUE(streamed.has_value());
+  checkSelected(*mapped, *spirit);
+  checkSelected(*streamed, *spirit);
+  std::remove(FILE_NAME.c_str());
+}
+
+//------------------------------------------------------------------------------
+// OBJ text whose faces refer back to the elements before them, about half the
+// time with relative indices. With badIndices about one corner in fifty has
+// an index of zero or a relative one before the first element.
+std::string
+relativeObj(std::mt19937& rng, size_t lineCount, bool badIndices)
+{
+  size_t counts[3] = {0, 0, 0};    // positions, texture coordinates, normals
+  auto index       = [&](size_t kind) {
+    const size_t count = counts[kind];
+    if (badIndices && rng() % 50 == 0)
+    {
+      return (rng() % 2) ? std::string("0") : "-" + std::to_string(count + 1);
+    }
+    if (count != 0 && rng() % 2)
+    {
+      return "-" + std::to_string(1 + rng() % count);
+    }
+    return std::to_string(1 + rng() % 100);
+  };
+
+  std::string out;
+  for (size_t line = 0; line < lineCount; ++line)
+  {
+    const unsigned kind = rng() % 4;
+    if (kind == 0)
+    {
+      out += "v 1 2 3\n";
+      ++counts[0];
+    }
+    else if (kind == 1)
+    {
+      out += "vt 0.5 0.5\n";
+      ++counts[1];
+    }
+    else if (kind == 2)
+    {
+      out += "vn 0 0 1\n";
+      ++counts[2];
+    }
+    else
+    {
+      const unsigned form = rng() % 4;
+      out += "f";
+      for (unsigned i = 3 + rng() % 2; i > 0; --i)
+      {
+        out += " " + index(0);
+        out += (form == 1 || form == 3) ? "/" + index(1) : "";
+        out += (form == 2) ? "//" + index(2) : "";
+        out += (form == 3) ? "/" + index(2) : "";
+      }
+      out += (rng() % 2) ? " # face\n" : "\n";
+    }
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+// Resolves the faces of an ordered parse independently of the library.
+// Faces with an index that cannot be resolved are dropped, and counted.
+ObjParser::ObjFlatAggregate
+resolveReference(const ObjParser::ObjVariantVec& elements, size_t& dropped)
+{
+  using namespace ObjParser;
+
+  ObjFlatAggregate data;
+  auto resolve = [](int index, size_t count) -> int64_t {
+    return (index > 0)   ? index - 1
+           : (index < 0) ? int64_t(count) + index
+                         : -1;
+  };
+  for (const auto& element : elements)
+  {
+    if (auto v = boost::get<VertexPosition>(&element))
+    {
+      data.positions.push_back(*v);
+    }
+    else if (auto n = boost::get<VertexNormal>(&element))
+    {
+      data.normals.push_back(*n);
+    }
+    else if (auto uv = boost::get<VertexTextureCoordinate>(&element))
+    {
+      data.texCoords.push_back(*uv);
+    }
+    else
+    {
+      Face face = boost::get<Face>(element);
+      bool ok   = true;
+      for (FaceTriplet& corner : face)
+      {
+        const int64_t v   = resolve(corner.vertexIndex, data.positions.size());
+        const int64_t uv  = resolve(corner.uvIndex, data.texCoords.size());
+        const int64_t n   = resolve(corner.normalIndex, data.normals.size());
+        ok                = ok && v >= 0 && (corner.uvIndex == 0 || uv >= 0)
+             && (corner.normalIndex == 0 || n >= 0);
+        corner.vertexIndex = int(v);
+        corner.uvIndex     = int(corner.uvIndex ? uv : -1);
+        corner.normalIndex = int(corner.normalIndex ? n : -1);
+      }
+      if (!ok)
+      {
+        ++dropped;
+        continue;
+      }
+      data.faceCorners.insert(data.faceCorners.end(), face.begin(), face.end());
+      data.faceOffsets.push_back(data.faceCorners.size());
+    }
+  }
+  return data;
+}
+
+//------------------------------------------------------------------------------
+void
+checkResolved(
+  const ObjParser::ObjResolvedAggregate& actual,
+  const ObjParser::ObjFlatAggregate& expected)
+{
+  EXPECT_EQ(expected.positions, actual.positions);
+  EXPECT_EQ(expected.normals, actual.normals);
+  EXPECT_EQ(expected.texCoords, actual.texCoords);
+  EXPECT_EQ(expected.faceOffsets, actual.faceOffsets);
+  ASSERT_EQ(expected.faceCorners.size(), actual.faceCorners.size());
+  for (size_t i = 0; i < actual.faceCorners.size(); ++i)
+  {
+    // ABSENT is the unsigned view of -1
+    const ObjParser::FaceTriplet& corner = expected.faceCorners[i];
+    EXPECT_EQ(uint32_t(corner.vertexIndex), actual.faceCorners[i].vertexIndex);
+    EXPECT_EQ(uint32_t(corner.uvIndex), actual.faceCorners[i].uvIndex);
+    EXPECT_EQ(uint32_t(corner.normalIndex), actual.faceCorners[i].normalIndex);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, ResolvedIndicesMatchReference)
+{
+  using namespace ObjParser;
+  using Data = ObjResolvedAggregate;
+  using It   = const char*;
+
+  auto compare = [](const std::string& input, bool lenient) {
+    SCOPED_TRACE(input.substr(0, 200));
+    const char* begin = input.data();
+    const char* end   = begin + input.size();
+
+    ParseOptions serial;
+    serial.lenient = lenient;
+    size_t dropped = 0;
+    auto elements  = parseBufferImpl<VariantGrammar<ObjVariantVec, It>,
+                                    ObjVariantVec>(begin, end, serial);
+    ASSERT_TRUE(elements.has_value());
+    const ObjFlatAggregate expected = resolveReference(*elements, dropped);
+    const bool expectSuccess        = lenient || dropped == 0;
+
+    ParseOptions threaded = serial;
+    threaded.threadCount  = 4;
+    threaded.minChunkSize = 256;
+    ParseOptions indexed  = threaded;
+    indexed.lineIndex     = true;
+    indexed.presize       = true;
+    ParseOptions fast     = threaded;
+    fast.uniform          = true;
+
+    std::vector<std::optional<Data>> parsed;
+    parsed.push_back(parseAsResolvedAggregate(begin, end, serial));
+    parsed.push_back(parseAsResolvedAggregate(begin, end, threaded));
+    parsed.push_back(parseAsResolvedAggregate(begin, end, indexed));
+    parsed.push_back(parseAsResolvedAggregate(begin, end, fast));
+    parsed.push_back(
+      parseParallelImpl<X3Grammar<Data, It>, Data>(begin, end, threaded));
+    if (!lenient)
+    {
+      parsed.push_back(parseAsResolvedAggregate(input.begin(), input.end()));
+    }
+    for (size_t i = 0; i < parsed.size(); ++i)
+    {
+      SCOPED_TRACE(i);
+      ASSERT_EQ(expectSuccess, parsed[i].has_value());
+      if (expectSuccess)
+      {
+        checkResolved(*parsed[i], expected);
+      }
+    }
+  };
+
+  compare(CALLBACK_INPUT, false);
+  for (const std::string input :
+       {"", "v 1 2 3\nf -1 -1 -1", "f 1 2 3", "v 1 2 3\nf 0 1 1",
+        "v 1 2 3\nf -2 -1 -1", "v 1 2 3\nvt 1\nf -1/-1 1/1 1/-2",
+        "v 1 2 3\nvn 0 0 1\nf 1//-1 1//1 -1//0"})
+  {
+    compare(input, false);
+    compare(input, true);
+  }
+
+  std::mt19937 rng(20);
+  for (int i = 0; i < 20; ++i)
+  {
+    compare(relativeObj(rng, 1000, false), false);
+    compare(relativeObj(rng, 1000, true), false);
+    compare(relativeObj(rng, 1000, true), true);
+  }
+  for (int form = 0; form < 4; ++form)
+  {
+    compare(uniformObj(rng, form, 3, false), false);
+    compare(uniformObj(rng, form, 4, true), false);
+  }
+
+  // Keywords the element count pre-pass does not recognise force the
+  // parallel parse back to a serial one
+  std::string unusual = relativeObj(rng, 1000, false);
+  unusual.insert(unusual.find('\n', unusual.size() / 2) + 1, "v1 2 3\nvt1\n");
+  compare(unusual + "f -1/-1 -2/-1 -3/-1\n", false);
+}
+
+//------------------------------------------------------------------------------
+// The vertex indices of each triangle
+std::vector<std::array<int, 3>>
+triangleIndices(const std::vector<ObjParser::FaceTriplet>& corners)
+{
+  std::vector<std::array<int, 3>> triangles;
+  for (size_t i = 0; i + 2 < corners.size(); i += 3)
+  {
+    triangles.push_back({corners[i].vertexIndex,
+                         corners[i + 1].vertexIndex,
+                         corners[i + 2].vertexIndex});
+  }
+  return triangles;
+}
+
+//------------------------------------------------------------------------------
+// Twice the area of each triangle, measured along normal. Triangles wound the
+// other way to the normal come out negative.
+std::vector<double>
+triangleAreas(
+  const ObjParser::ObjAggregate& data,
+  const std::vector<ObjParser::FaceTriplet>& corners,
+  const std::array<double, 3>& normal)
+{
+  std::vector<double> areas;
+  for (const auto& t : triangleIndices(corners))
+  {
+    const auto& a = data.positions[t[0] - 1];
+    const auto& b = data.positions[t[1] - 1];
+    const auto& c = data.positions[t[2] - 1];
+    const double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    const double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    areas.push_back(
+      (uy * vz - uz * vy) * normal[0] + (uz * vx - ux * vz) * normal[1]
+      + (ux * vy - uy * vx) * normal[2]);
+  }
+  return areas;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, TriangulateFansConvexFaces)
+{
+  using namespace ObjParser;
+  const std::string input = R"obj(
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+v -1 0.5 0
+f 1 2 3
+f 1/1 2/2 3/3 4/4
+f 2 3 4 5 1
+f 1 2
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  const auto corners = triangulate(*data);
+  const std::vector<std::array<int, 3>> expected
+    = {{1, 2, 3}, {1, 2, 3}, {1, 3, 4}, {2, 3, 4}, {2, 4, 5}, {2, 5, 1}};
+  EXPECT_EQ(expected, triangleIndices(corners));
+  ASSERT_EQ(3 * expected.size(), corners.size());
+  EXPECT_EQ((FaceTriplet{4, 4, 0}), corners[8]);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, TriangulateClipsConcaveFaces)
+{
+  using namespace ObjParser;
+
+  // An L shape and a comb, each once in the xy plane wound anticlockwise and
+  // once in the xz plane wound clockwise as seen from +y
+  const std::string input = R"obj(
+v 0 0 0
+v 2 0 0
+v 2 1 0
+v 1 1 0
+v 1 2 0
+v 0 2 0
+f 1 2 3 4 5 6
+f 4 5 6 1 2 3
+v 0 0 0
+v 4 0 0
+v 4 2 0
+v 3 2 0
+v 3 1 0
+v 2 1 0
+v 2 2 0
+v 1 2 0
+v 1 1 0
+v 0 1 0
+f 7 8 9 10 11 12 13 14 15 16
+v 0 0 0
+v 0 0 2
+v 1 0 2
+v 1 0 1
+v 2 0 1
+v 2 0 0
+f 17 18 19 20 21 22
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  const auto corners = triangulate(*data);
+  ASSERT_EQ(3 * (4 + 4 + 8 + 4), corners.size());
+
+  auto check = [&](size_t first, size_t count, auto normal, double area) {
+    std::vector<FaceTriplet> face(
+      corners.begin() + 3 * first, corners.begin() + 3 * (first + count));
+    double sum = 0.0;
+    for (double a : triangleAreas(*data, face, normal))
+    {
+      EXPECT_GT(a, 0.0);
+      sum += a;
+    }
+    EXPECT_DOUBLE_EQ(2.0 * area, sum);
+  };
+  check(0, 4, std::array<double, 3>{0, 0, 1}, 3.0);
+  check(4, 4, std::array<double, 3>{0, 0, 1}, 3.0);
+  check(8, 8, std::array<double, 3>{0, 0, 1}, 6.0);
+  check(16, 4, std::array<double, 3>{0, 1, 0}, 3.0);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, TriangulateClipsNonPlanarFaces)
+{
+  using namespace ObjParser;
+  const std::string input = R"obj(
+v 0 0 0
+v 1 0 0
+v 1 1 0.5
+v 0 1 0
+f 1 2 3 4
+f -4 -3 -2 -1
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  // The convex but bent face is clipped from its first ear, and the one with
+  // relative indices, whose positions are unknown, is fanned
+  const std::vector<std::array<int, 3>> expected
+    = {{4, 1, 2}, {2, 3, 4}, {-4, -3, -2}, {-4, -2, -1}};
+  EXPECT_EQ(expected, triangleIndices(triangulate(*data)));
+
+  // Resolved indices have positions
+  auto resolved = parseAsResolvedAggregate(input.begin(), input.end());
+  ASSERT_TRUE(resolved.has_value());
+  const auto corners = triangulate(*resolved);
+  ASSERT_EQ(12u, corners.size());
+  const uint32_t expectedResolved[] = {3, 0, 1, 1, 2, 3, 3, 0, 1, 1, 2, 3};
+  for (size_t i = 0; i < corners.size(); ++i)
+  {
+    EXPECT_EQ(expectedResolved[i], corners[i].vertexIndex);
+    EXPECT_EQ(ResolvedCorner::ABSENT, corners[i].uvIndex);
+  }
+
+  TriangulateOptions loose;
+  loose.planarTolerance = 1.0f;
+  const std::vector<std::array<int, 3>> fanned
+    = {{1, 2, 3}, {1, 3, 4}, {-4, -3, -2}, {-4, -2, -1}};
+  EXPECT_EQ(fanned, triangleIndices(triangulate(*data, loose)));
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, TriangulateMatchesAcrossLayoutsAndThreads)
+{
+  using namespace ObjParser;
+
+  // Regular and star shaped polygons of 3 to 12 corners
+  std::mt19937 rng(21);
+  std::string input;
+  int vertices = 0;
+  for (int face = 0; face < 2000; ++face)
+  {
+    const int arity = 3 + rng() % 10;
+    const bool star = rng() % 2;
+    std::string corners;
+    for (int i = 0; i < arity; ++i)
+    {
+      const double angle  = 6.283185307179586 * i / arity;
+      const double radius = (star && i % 2) ? 0.4 : 1.0;
+      input += "v " + std::to_string(radius * std::cos(angle)) + " "
+               + std::to_string(radius * std::sin(angle)) + " 0\n";
+      corners += " " + std::to_string(++vertices);
+    }
+    input += "f" + corners + "\n";
+  }
+
+  auto aggregate = parseAsAggregate(input.begin(), input.end());
+  auto flat      = parseAsFlatAggregate(input.begin(), input.end());
+  auto resolved  = parseAsResolvedAggregate(input.begin(), input.end());
+  ASSERT_TRUE(aggregate.has_value());
+  ASSERT_TRUE(flat.has_value());
+  ASSERT_TRUE(resolved.has_value());
+
+  const auto expected = triangulate(*aggregate);
+  size_t triangles    = 0;
+  for (const Face& face : aggregate->faces)
+  {
+    triangles += face.size() - 2;
+  }
+  EXPECT_EQ(3 * triangles, expected.size());
+  for (double area : triangleAreas(*aggregate, expected, {0, 0, 1}))
+  {
+    EXPECT_GT(area, 0.0);
+  }
+
+  TriangulateOptions threaded;
+  threaded.threadCount       = 4;
+  threaded.minFacesPerThread = 100;
+  EXPECT_EQ(expected, triangulate(*aggregate, threaded));
+  EXPECT_EQ(expected, triangulate(*flat, threaded));
+
+  const auto zeroBased = triangulate(*resolved, threaded);
+  ASSERT_EQ(expected.size(), zeroBased.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+  {
+    EXPECT_EQ(uint32_t(expected[i].vertexIndex - 1), zeroBased[i].vertexIndex);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Unifies corners with a std::map, numbering combinations as they first appear
+std::pair<std::vector<std::array<int, 3>>, std::vector<uint32_t>>
+unifyReference(const std::vector<ObjParser::FaceTriplet>& corners)
+{
+  std::map<std::array<int, 3>, uint32_t> numbers;
+  std::vector<std::array<int, 3>> vertices;
+  std::vector<uint32_t> indices;
+  for (const auto& corner : corners)
+  {
+    const std::array<int, 3> key
+      = {corner.vertexIndex, corner.uvIndex, corner.normalIndex};
+    auto inserted = numbers.emplace(key, uint32_t(vertices.size()));
+    if (inserted.second)
+    {
+      vertices.push_back(key);
+    }
+    indices.push_back(inserted.first->second);
+  }
+  return {vertices, indices};
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, UnifiedMeshSharesEqualCorners)
+{
+  using namespace ObjParser;
+  const std::string input = R"obj(
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+vt 0.25 0.5
+vt 0.75 0.5
+vn 0 0 1
+f 1/1/1 2/2/1 3/1/1 4/2/1
+f 3/1/1 2/2/1 1
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  auto mesh = buildUnifiedMesh(*data);
+  ASSERT_TRUE(mesh.has_value());
+  const std::vector<uint32_t> indices = {0, 1, 2, 0, 2, 3, 2, 1, 4};
+  EXPECT_EQ(indices, mesh->indices);
+  ASSERT_EQ(5u, mesh->vertices.size());
+
+  const UnifiedVertex& second = mesh->vertices[1];
+  EXPECT_EQ(1.0f, second.position[0]);
+  EXPECT_EQ(0.0f, second.position[1]);
+  EXPECT_EQ(1.0f, second.normal[2]);
+  EXPECT_EQ(0.75f, second.texCoord[0]);
+  EXPECT_EQ(0.5f, second.texCoord[1]);
+
+  // The last corner has no uv or normal
+  const UnifiedVertex& last = mesh->vertices[4];
+  EXPECT_EQ(0.0f, last.position[0]);
+  EXPECT_EQ(0.0f, last.normal[2]);
+  EXPECT_EQ(0.0f, last.texCoord[0]);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, UnifiedMeshRejectsMissingElements)
+{
+  using namespace ObjParser;
+  for (const std::string input :
+       {"v 0 0 0\nf 1 1 2", "v 0 0 0\nf 1/1 1/1 1/1", "v 0 0 0\nf 1//1 1 1",
+        "v 0 0 0\nf -1 -1 -1", "v 0 0 0\nf -2147483648 1 1",
+        "v 0 0 0\nvt 0 0\nf 1/1 1/-2147483648 1/1"})
+  {
+    SCOPED_TRACE(input);
+    auto data = parseAsAggregate(input.begin(), input.end());
+    ASSERT_TRUE(data.has_value());
+    EXPECT_FALSE(buildUnifiedMesh(*data).has_value());
+  }
+
+  // Relative indices are fine once resolved
+  const std::string input = "v 0 0 0\nf -1 -1 -1";
+  auto resolved = parseAsResolvedAggregate(input.begin(), input.end());
+  ASSERT_TRUE(resolved.has_value());
+  auto mesh = buildUnifiedMesh(*resolved);
+  ASSERT_TRUE(mesh.has_value());
+  EXPECT_EQ(1u, mesh->vertices.size());
+  EXPECT_EQ((std::vector<uint32_t>{0, 0, 0}), mesh->indices);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, UnifiedMeshMatchesReference)
+{
+  using namespace ObjParser;
+
+  // Corners drawn from few enough combinations that most repeat
+  std::mt19937 rng(22);
+  std::string input;
+  for (int i = 0; i < 50; ++i)
+  {
+    input += "v " + std::to_string(i) + " 0 0\n";
+    input += "vt 0." + std::to_string(i) + " 0\n";
+    input += "vn 0 " + std::to_string(i) + " 0\n";
+  }
+  for (int face = 0; face < 20000; ++face)
+  {
+    const unsigned form = rng() % 4;
+    input += "f";
+    for (int corner = 0; corner < 3; ++corner)
+    {
+      input += " " + std::to_string(1 + rng() % 50);
+      input += (form == 1 || form == 3) ? "/" + std::to_string(1 + rng() % 5)
+                                        : "";
+      input += (form == 2) ? "//" + std::to_string(1 + rng() % 5) : "";
+      input += (form == 3) ? "/" + std::to_string(1 + rng() % 5) : "";
+    }
+    input += "\n";
+  }
+
+  auto aggregate = parseAsAggregate(input.begin(), input.end());
+  auto resolved  = parseAsResolvedAggregate(input.begin(), input.end());
+  ASSERT_TRUE(aggregate.has_value());
+  ASSERT_TRUE(resolved.has_value());
+
+  const auto corners  = triangulate(*aggregate);
+  const auto expected = unifyReference(corners);
+
+  UnifyOptions threaded;
+  threaded.threadCount         = 4;
+  threaded.minCornersPerThread = 1000;
+  for (const UnifyOptions& options : {UnifyOptions(), threaded})
+  {
+    auto mesh = buildUnifiedMesh(*aggregate, options);
+    ASSERT_TRUE(mesh.has_value());
+    EXPECT_EQ(expected.second, mesh->indices);
+    ASSERT_EQ(expected.first.size(), mesh->vertices.size());
+    for (size_t i = 0; i < mesh->vertices.size(); ++i)
+    {
+      const auto& key = expected.first[i];
+      const auto& v   = mesh->vertices[i];
+      EXPECT_EQ(float(key[0] - 1), v.position[0]);
+      EXPECT_EQ(key[1] ? aggregate->texCoords[key[1] - 1].u : 0.0f,
+                v.texCoord[0]);
+      EXPECT_EQ(key[2] ? float(key[2] - 1) : 0.0f, v.normal[1]);
+    }
+
+    auto fromResolved = buildUnifiedMesh(*resolved, options);
+    ASSERT_TRUE(fromResolved.has_value());
+    EXPECT_EQ(expected.second, fromResolved->indices);
+  }
+}
+
+//------------------------------------------------------------------------------
+static const std::string CUBE_INPUT = R"obj(
+v 0 0 0
+v 1 0 0
+v 1 1 0
+v 0 1 0
+v 0 0 1
+v 1 0 1
+v 1 1 1
+v 0 1 1
+f 1 4 3 2
+f 5 6 7 8
+f 1 2 6 5
+f 2 3 7 6
+f 3 4 8 7
+f 4 1 5 8
+)obj";
+
+//------------------------------------------------------------------------------
+// The normal a corner points at
+ObjParser::VertexNormal
+cornerNormal(const ObjParser::ObjAggregate& data, size_t face, size_t corner)
+{
+  return data.normals[data.faces[face][corner].normalIndex - 1];
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateNormalsSmoothsAndCreases)
+{
+  using namespace ObjParser;
+  auto data = parseAsAggregate(CUBE_INPUT.begin(), CUBE_INPUT.end());
+  ASSERT_TRUE(data.has_value());
+
+  // Smoothed over every edge, each cube corner points out along its diagonal
+  ObjAggregate smooth = *data;
+  ASSERT_TRUE(generateNormals(smooth));
+  ASSERT_EQ(8u, smooth.normals.size());
+  const float d = 1.0f / std::sqrt(3.0f);
+  for (size_t face = 0; face < smooth.faces.size(); ++face)
+  {
+    for (size_t corner = 0; corner < 4; ++corner)
+    {
+      const VertexPosition& p
+        = smooth.positions[smooth.faces[face][corner].vertexIndex - 1];
+      const VertexNormal n = cornerNormal(smooth, face, corner);
+      EXPECT_NEAR(p.x ? d : -d, n.i, 1e-6f);
+      EXPECT_NEAR(p.y ? d : -d, n.j, 1e-6f);
+      EXPECT_NEAR(p.z ? d : -d, n.k, 1e-6f);
+    }
+  }
+
+  // With a crease below 90 degrees every corner takes its face normal
+  NormalOptions creased;
+  creased.creaseAngle = 60.0f;
+  ObjAggregate hard   = *data;
+  ASSERT_TRUE(generateNormals(hard, creased));
+  EXPECT_EQ(24u, hard.normals.size());
+  const VertexNormal faceNormals[] = {
+    {0, 0, -1}, {0, 0, 1}, {0, -1, 0}, {1, 0, 0}, {0, 1, 0}, {-1, 0, 0}};
+  for (size_t face = 0; face < hard.faces.size(); ++face)
+  {
+    for (size_t corner = 0; corner < 4; ++corner)
+    {
+      EXPECT_EQ(faceNormals[face], cornerNormal(hard, face, corner));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateNormalsWeighting)
+{
+  using namespace ObjParser;
+
+  // Two right angles at the origin, one with a hundred times the area
+  const std::string input = R"obj(
+v 0 0 0
+v 10 0 0
+v 0 10 0
+v 0 1 0
+v 0 0 1
+f 1 2 3
+f 1 4 5
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  ObjAggregate byArea = *data;
+  ASSERT_TRUE(generateNormals(byArea));
+  const VertexNormal area = cornerNormal(byArea, 0, 0);
+  EXPECT_NEAR(100.0f, area.k / area.i, 1e-3f);
+  EXPECT_EQ(0.0f, area.j);
+
+  NormalOptions options;
+  options.weighting    = NormalWeighting::Angle;
+  ObjAggregate byAngle = *data;
+  ASSERT_TRUE(generateNormals(byAngle, options));
+  const VertexNormal angle = cornerNormal(byAngle, 0, 0);
+  EXPECT_NEAR(angle.i, angle.k, 1e-6f);
+  EXPECT_NEAR(std::sqrt(0.5f), angle.k, 1e-6f);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateNormalsKeepsExistingNormals)
+{
+  using namespace ObjParser;
+  const std::string input = R"obj(
+v 0 0 0
+v 1 0 0
+v 0 1 0
+v 0 0 1
+vn 1 0 0
+f 1//1 2//1 3//1
+f 1 3 4
+)obj";
+  auto data = parseAsAggregate(input.begin(), input.end());
+  ASSERT_TRUE(data.has_value());
+
+  ObjAggregate kept = *data;
+  ASSERT_TRUE(generateNormals(kept));
+  ASSERT_EQ(4u, kept.normals.size());
+  EXPECT_EQ((VertexNormal{1, 0, 0}), kept.normals[0]);
+  for (const FaceTriplet& corner : kept.faces[0])
+  {
+    EXPECT_EQ(1, corner.normalIndex);
+  }
+  for (const FaceTriplet& corner : kept.faces[1])
+  {
+    EXPECT_GT(corner.normalIndex, 1);
+  }
+
+  NormalOptions options;
+  options.replaceExisting = true;
+  ObjAggregate replaced   = *data;
+  ASSERT_TRUE(generateNormals(replaced, options));
+  EXPECT_EQ(4u, replaced.normals.size());
+  EXPECT_EQ((VertexNormal{0, 0, 1}), cornerNormal(replaced, 0, 1));
+
+  // Relative indices cannot be followed after the parse
+  const std::string relative = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -3 -2 -1\n";
+  auto unresolved = parseAsAggregate(relative.begin(), relative.end());
+  ASSERT_TRUE(unresolved.has_value());
+  ObjAggregate untouched = *unresolved;
+  EXPECT_FALSE(generateNormals(untouched));
+  EXPECT_TRUE(untouched.normals.empty());
+  EXPECT_EQ(unresolved->faces, untouched.faces);
+
+  auto resolved = parseAsResolvedAggregate(relative.begin(), relative.end());
+  ASSERT_TRUE(resolved.has_value());
+  ASSERT_TRUE(generateNormals(*resolved));
+  ASSERT_EQ(3u, resolved->normals.size());
+  EXPECT_EQ((VertexNormal{0, 0, 1}), resolved->normals[2]);
+  EXPECT_EQ(2u, resolved->faceCorners[2].normalIndex);
+}
+
+//------------------------------------------------------------------------------
+// An "f" line whose corners all carry the same suffix
+std::string
+faceLine(std::initializer_list<int> indices, const std::string& suffix)
+{
+  std::string line = "f";
+  for (int index : indices)
+  {
+    line += " " + std::to_string(index) + suffix;
+  }
+  return line + "\n";
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateNormalsMatchesAcrossLayoutsAndThreads)
+{
+  using namespace ObjParser;
+
+  // A bumpy grid of quads and triangles, some of its corners with normals
+  std::mt19937 rng(23);
+  const int size = 60;
+  std::string input;
+  for (int y = 0; y <= size; ++y)
+  {
+    for (int x = 0; x <= size; ++x)
+    {
+      input += "v " + std::to_string(x) + " " + std::to_string(y) + " "
+               + std::to_string(int(rng() % 3)) + "\n";
+    }
+  }
+  input += "vn 0 0 1\n";
+  for (int y = 0; y < size; ++y)
+  {
+    for (int x = 0; x < size; ++x)
+    {
+      const int i0 = y * (size + 1) + x + 1;
+      const int i1 = i0 + 1;
+      const int i2 = i0 + size + 1;
+      const int i3 = i2 + 1;
+      const std::string n = (rng() % 10 == 0) ? "//1" : "";
+      if (rng() % 2)
+      {
+        input += faceLine({i0, i1, i3, i2}, n);
+      }
+      else
+      {
+        input += faceLine({i0, i1, i3}, n) + faceLine({i0, i3, i2}, n);
+      }
+    }
+  }
+
+  auto aggregate = parseAsAggregate(input.begin(), input.end());
+  auto flat      = parseAsFlatAggregate(input.begin(), input.end());
+  auto soa       = parseAsSoaAggregate(input.begin(), input.end());
+  auto resolved  = parseAsResolvedAggregate(input.begin(), input.end());
+  ASSERT_TRUE(aggregate && flat && soa && resolved);
+
+  for (float crease : {180.0f, 30.0f})
+  {
+    for (NormalWeighting weighting :
+         {NormalWeighting::Area, NormalWeighting::Angle})
+    {
+      SCOPED_TRACE(crease);
+      NormalOptions serial;
+      serial.creaseAngle = crease;
+      serial.weighting   = weighting;
+      NormalOptions threaded     = serial;
+      threaded.threadCount       = 4;
+      threaded.minFacesPerThread = 100;
+
+      ObjAggregate expected = *aggregate;
+      ASSERT_TRUE(generateNormals(expected, serial));
+      ObjAggregate actual = *aggregate;
+      ASSERT_TRUE(generateNormals(actual, threaded));
+      EXPECT_EQ(expected.normals, actual.normals);
+      EXPECT_EQ(expected.faces, actual.faces);
+
+      ObjFlatAggregate flatActual = *flat;
+      ASSERT_TRUE(generateNormals(flatActual, threaded));
+      EXPECT_EQ(expected.normals, flatActual.normals);
+      ObjSoaAggregate soaActual = *soa;
+      ASSERT_TRUE(generateNormals(soaActual, threaded));
+      ASSERT_EQ(expected.normals.size(), soaActual.normals.size());
+      for (size_t i = 0; i < expected.normals.size(); ++i)
+      {
+        EXPECT_EQ(expected.normals[i], soaActual.normals[i]);
+      }
+      EXPECT_EQ(flatActual.faceCorners, soaActual.faceCorners);
+
+      ObjResolvedAggregate resolvedActual = *resolved;
+      ASSERT_TRUE(generateNormals(resolvedActual, threaded));
+      EXPECT_EQ(expected.normals, resolvedActual.normals);
+      size_t c = 0;
+      for (const Face& face : expected.faces)
+      {
+        for (const FaceTriplet& corner : face)
+        {
+          EXPECT_EQ(
+            uint32_t(corner.normalIndex - 1),
+            resolvedActual.faceCorners[c++].normalIndex);
+        }
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// A vertex facing +z with the texture coordinate (u, v)
+ObjParser::UnifiedVertex
+planarVertex(float x, float y, float u, float v)
+{
+  return {{x, y, 0.0f}, {0.0f, 0.0f, 1.0f}, {u, v}};
+}
+
+//------------------------------------------------------------------------------
+void
+expectTangent(
+  float x, float y, float z, float sign, const ObjParser::UnifiedTangent& t)
+{
+  EXPECT_NEAR(x, t.tangent[0], 1e-6f);
+  EXPECT_NEAR(y, t.tangent[1], 1e-6f);
+  EXPECT_NEAR(z, t.tangent[2], 1e-6f);
+  EXPECT_EQ(sign, t.sign);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateTangentsFollowTextureDirection)
+{
+  using namespace ObjParser;
+
+  // A quad whose texture runs along x, then the same quad mirrored in u
+  ObjUnifiedMesh mesh;
+  mesh.vertices = {
+    planarVertex(0, 0, 0, 0),
+    planarVertex(1, 0, 1, 0),
+    planarVertex(1, 1, 1, 1),
+    planarVertex(0, 1, 0, 1)};
+  mesh.indices = {0, 1, 2, 0, 2, 3};
+
+  ObjUnifiedMesh mirrored = mesh;
+  for (UnifiedVertex& vertex : mirrored.vertices)
+  {
+    vertex.texCoord[0] = 1.0f - vertex.texCoord[0];
+  }
+
+  ASSERT_TRUE(generateTangents(mesh));
+  ASSERT_EQ(4u, mesh.tangents.size());
+  for (const UnifiedTangent& t : mesh.tangents)
+  {
+    expectTangent(1, 0, 0, 1, t);
+  }
+
+  ASSERT_TRUE(generateTangents(mirrored));
+  ASSERT_EQ(4u, mirrored.vertices.size());
+  for (const UnifiedTangent& t : mirrored.tangents)
+  {
+    expectTangent(-1, 0, 0, -1, t);
+  }
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateTangentsSplitMirroredVertices)
+{
+  using namespace ObjParser;
+
+  // Two triangles sharing the edge x = 0, the texture mirrored across it
+  ObjUnifiedMesh mesh;
+  mesh.vertices = {
+    planarVertex(0, 0, 0, 0),
+    planarVertex(1, 0, 1, 0),
+    planarVertex(0, 1, 0, 1),
+    planarVertex(-1, 0, 1, 0)};
+  mesh.indices = {0, 1, 2, 0, 2, 3};
+
+  ASSERT_TRUE(generateTangents(mesh));
+  ASSERT_EQ(6u, mesh.vertices.size());
+  ASSERT_EQ(6u, mesh.tangents.size());
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 4, 5, 3}), mesh.indices);
+  for (uint32_t v : {0, 1, 2})
+  {
+    expectTangent(1, 0, 0, 1, mesh.tangents[v]);
+  }
+  for (uint32_t v : {3, 4, 5})
+  {
+    expectTangent(-1, 0, 0, -1, mesh.tangents[v]);
+  }
+  EXPECT_EQ(0.0f, mesh.vertices[4].position[1]);
+  EXPECT_EQ(1.0f, mesh.vertices[5].position[1]);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, GenerateTangentsMatchAcrossSimdAndThreads)
+{
+  using namespace ObjParser;
+
+  // Random triangles over a shared pool of vertices, some of them without
+  // texture area
+  std::mt19937 rng(24);
+  std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+  ObjUnifiedMesh mesh;
+  for (int i = 0; i < 500; ++i)
+  {
+    UnifiedVertex vertex;
+    for (float& value : vertex.position)
+    {
+      value = coordinate(rng);
+    }
+    for (float& value : vertex.normal)
+    {
+      value = coordinate(rng);
+    }
+    vertex.texCoord[0] = (i % 50 == 0) ? 0.5f : coordinate(rng);
+    vertex.texCoord[1] = (i % 50 == 0) ? 0.5f : coordinate(rng);
+    mesh.vertices.push_back(vertex);
+  }
+  for (int i = 0; i < 3 * 2003; ++i)
+  {
+    mesh.indices.push_back(uint32_t(rng() % 500));
+  }
+
+  TangentOptions serial;
+  serial.simdLevel        = SimdLevel::Scalar;
+  ObjUnifiedMesh expected = mesh;
+  ASSERT_TRUE(generateTangents(expected, serial));
+  EXPECT_GT(expected.vertices.size(), mesh.vertices.size());
+
+  for (size_t v = 0; v < expected.vertices.size(); ++v)
+  {
+    const float* t = expected.tangents[v].tangent;
+    const float* n = expected.vertices[v].normal;
+    const float nn = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    EXPECT_NEAR(1.0f, t[0] * t[0] + t[1] * t[1] + t[2] * t[2], 1e-5f);
+    EXPECT_NEAR(0.0f, (t[0] * n[0] + t[1] * n[1] + t[2] * n[2]) / nn, 1e-4f);
+  }
+
+  for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+  {
+    for (unsigned threads : {1u, 4u})
+    {
+      SCOPED_TRACE(threads);
+      TangentOptions options;
+      options.simdLevel             = level;
+      options.threadCount           = threads;
+      options.minTrianglesPerThread = 64;
+
+      ObjUnifiedMesh actual = mesh;
+      ASSERT_TRUE(generateTangents(actual, options));
+      EXPECT_EQ(expected.indices, actual.indices);
+      ASSERT_EQ(expected.tangents.size(), actual.tangents.size());
+      for (size_t v = 0; v < expected.tangents.size(); ++v)
+      {
+        const UnifiedTangent& e = expected.tangents[v];
+        const UnifiedTangent& a = actual.tangents[v];
+        EXPECT_EQ(e.tangent[0], a.tangent[0]);
+        EXPECT_EQ(e.tangent[1], a.tangent[1]);
+        EXPECT_EQ(e.tangent[2], a.tangent[2]);
+        EXPECT_EQ(e.sign, a.sign);
+      }
+    }
+  }
+
+  mesh.indices.back() = 500;
+  ObjUnifiedMesh untouched = mesh;
+  EXPECT_FALSE(generateTangents(untouched));
+  EXPECT_TRUE(untouched.tangents.empty());
+  EXPECT_EQ(mesh.indices, untouched.indices);
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, AnalyzeVertexCacheCountsMisses)
+{
+  using namespace ObjParser;
+  VertexCacheStatistics single = analyzeVertexCache({0, 1, 2}, 3);
+  EXPECT_EQ(3u, single.transformed);
+  EXPECT_EQ(3.0f, single.acmr);
+  EXPECT_EQ(1.0f, single.atvr);
+
+  VertexCacheStatistics shared = analyzeVertexCache({0, 1, 2, 2, 1, 3}, 4);
+  EXPECT_EQ(4u, shared.transformed);
+  EXPECT_EQ(2.0f, shared.acmr);
+  EXPECT_EQ(1.0f, shared.atvr);
+
+  // FIFO: hits do not refresh a vertex, so 0 is gone after three more loads
+  VertexCacheStatistics fifo
+    = analyzeVertexCache({0, 1, 2, 0, 3, 4, 5, 0, 1}, 6, 3);
+  EXPECT_EQ(8u, fifo.transformed);
+  EXPECT_EQ(8.0f / 6.0f, fifo.atvr);
+}
+
+//------------------------------------------------------------------------------
+// The triangles of mesh as position triples, rotated to start at their
+// smallest vertex so that they compare whatever the vertex numbering
+std::vector<std::array<float, 9>>
+meshTriangles(const ObjParser::ObjUnifiedMesh& mesh)
+{
+  std::vector<std::array<float, 9>> triangles;
+  for (size_t t = 0; t < mesh.indices.size(); t += 3)
+  {
+    std::array<float, 9> corners;
+    for (size_t k = 0; k < 3; ++k)
+    {
+      const float* p = mesh.vertices[mesh.indices[t + k]].position;
+      std::copy(p, p + 3, corners.begin() + 3 * k);
+    }
+    triangles.push_back(corners);
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return triangles;
+}
+
+//------------------------------------------------------------------------------
+TEST_F(TestFixture, OptimizeMeshReordersForCacheAndFetch)
+{
+  using namespace ObjParser;
+
+  // A grid whose triangles are shuffled, as an unhelpful exporter might
+  const int size = 40;
+  ObjUnifiedMesh mesh;
+  for (int y = 0; y <= size; ++y)
+  {
+    for (int x = 0; x <= size; ++x)
+    {
+      mesh.vertices.push_back(planarVertex(float(x), float(y), 0, 0));
+      mesh.tangents.push_back({{1, 0, 0}, float(x)});
+    }
+  }
+  std::vector<std::array<uint32_t, 3>> triangles;
+  for (int y = 0; y < size; ++y)
+  {
+    for (int x = 0; x < size; ++x)
+    {
+      const uint32_t i0 = y * (size + 1) + x;
+      triangles.push_back({i0, i0 + 1, i0 + size + 2});
+      triangles.push_back({i0, i0 + size + 2, i0 + size + 1});
+    }
+  }
+  std::shuffle(triangles.begin(), triangles.end(), std::mt19937(25));
+  for (const auto& triangle : triangles)
+  {
+    mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+  }
+  const auto expected = meshTriangles(mesh);
+
+  const VertexCacheStatistics before = analyzeVertexCache(mesh);
+  ASSERT_TRUE(optimizeVertexCache(mesh));
+  const VertexCacheStatistics after = analyzeVertexCache(mesh);
+  EXPECT_GT(before.acmr, 2.5f);
+  EXPECT_LT(after.acmr, 0.8f);
+  EXPECT_LT(after.atvr, 1.4f);
+  EXPECT_EQ(expected, meshTriangles(mesh));
+
+  // Renumbering moves the vertices but leaves the cache behaviour alone
+  ASSERT_TRUE(optimizeVertexFetch(mesh));
+  EXPECT_EQ(after.transformed, analyzeVertexCache(mesh).transformed);
+  EXPECT_EQ(expected, meshTriangles(mesh));
+  uint32_t next = 0;
+  for (uint32_t index : mesh.indices)
+  {
+    ASSERT_LE(index, next);
+    next = std::max(next, index + 1);
+  }
+  for (size_t v = 0; v < mesh.vertices.size(); ++v)
+  {
+    EXPECT_EQ(mesh.vertices[v].position[0], mesh.tangents[v].sign);
+  }
+
+  mesh.indices.back() = uint32_t(mesh.vertices.size());
+  const ObjUnifiedMesh broken = mesh;
+  EXPECT_FALSE(optimizeVertexCache(mesh));
+  EXPECT_FALSE(optimizeVertexFetch(mesh));
+  EXPECT_EQ(broken.indices, mesh.indices);
+}
+
 //------------------------------------------------------------------------------
 }    // namespace
 